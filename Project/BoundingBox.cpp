@@ -0,0 +1,38 @@
+#include "BoundingBox.hpp"
+
+namespace gps {
+
+    BoundingBox::BoundingBox(glm::vec3 min, glm::vec3 max) {
+        this->min = min;
+        this->max = max;
+    }
+
+    bool BoundingBox::isEmpty() const {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+
+    glm::vec3 BoundingBox::getCenter() const {
+        return (min + max) * 0.5f;
+    }
+
+    glm::vec3 BoundingBox::getExtent() const {
+        return max - min;
+    }
+
+    BoundingBox BoundingBox::transform(const glm::mat4& matrix) const {
+        if (isEmpty())
+            return *this;
+
+        //Arvo's method - transform the center and the absolute extent instead of all 8 corners
+        glm::vec3 center = glm::vec3(matrix * glm::vec4(getCenter(), 1.0f));
+        glm::vec3 halfExtent = getExtent() * 0.5f;
+        glm::vec3 newHalfExtent(0.0f);
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                newHalfExtent[i] += glm::abs(matrix[j][i]) * halfExtent[j];
+            }
+        }
+
+        return BoundingBox(center - newHalfExtent, center + newHalfExtent);
+    }
+}
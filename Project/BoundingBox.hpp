@@ -0,0 +1,44 @@
+#ifndef BoundingBox_hpp
+#define BoundingBox_hpp
+
+#include <glm/glm.hpp>
+
+#include <cfloat>
+
+namespace gps {
+
+    //axis aligned bounding box
+    struct BoundingBox
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+
+        //creates an empty (inverted) box, ready to be expanded
+        BoundingBox() : min(FLT_MAX), max(-FLT_MAX) {}
+        BoundingBox(glm::vec3 min, glm::vec3 max);
+
+        //inlined, these run for every triangle and every candidate split while building the bvh
+        void expand(glm::vec3 point) {
+            min = glm::min(min, point);
+            max = glm::max(max, point);
+        }
+        void expand(const BoundingBox& other) {
+            min = glm::min(min, other.min);
+            max = glm::max(max, other.max);
+        }
+
+        bool isEmpty() const;
+        glm::vec3 getCenter() const;
+        glm::vec3 getExtent() const;
+        float getSurfaceArea() const {
+            glm::vec3 e = glm::max(max - min, glm::vec3(0.0f));
+            return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+        }
+
+        //returns the box enclosing this box after the given transformation
+        BoundingBox transform(const glm::mat4& matrix) const;
+    };
+
+}
+
+#endif /* BoundingBox_hpp */
@@ -0,0 +1,613 @@
+#include "Bvh.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <functional>
+
+namespace gps {
+
+    //number of candidate split planes per axis
+    static const int SAH_BINS = 16;
+    //leaves are split even when the heuristic disagrees once they hold more triangles than this
+    static const int MAX_LEAF_TRIANGLES = 8;
+    //cost of visiting a node relative to intersecting a triangle
+    static const float TRAVERSAL_COST = 1.0f;
+    //nodes smaller than this are not split further on the calling thread before going wide
+    static const int MIN_PARALLEL_TRIANGLES = 4096;
+    //traversal stack entries; walking a tree pushes at most one entry per level plus the two children of the deepest
+    //inner node, so the builder stops splitting one level short of it
+    static const int TRAVERSAL_STACK_SIZE = 256;
+    static const int MAX_BUILD_DEPTH = TRAVERSAL_STACK_SIZE - 1;
+
+    static int BinIndex(float centroid, float centroidMin, float binScale, int binCount) {
+        int bin = (int)((centroid - centroidMin) * binScale);
+        return std::min(std::max(bin, 0), binCount - 1);
+    }
+
+    //slab test, returns the entry distance in tEnter
+    static bool IntersectBox(const BoundingBox& box, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float& tEnter) {
+        glm::vec3 t1 = (box.min - origin) * inverseDirection;
+        glm::vec3 t2 = (box.max - origin) * inverseDirection;
+        glm::vec3 tMin = glm::min(t1, t2);
+        glm::vec3 tMax = glm::max(t1, t2);
+
+        tEnter = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+        float tExit = std::min(std::min(tMax.x, tMax.y), std::min(tMax.z, maxDistance));
+        return tEnter <= tExit;
+    }
+
+    Bvh::Bvh() {
+        this->nodeCount = 0;
+    }
+
+    int Bvh::AddObject(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices, const glm::mat4& transform) {
+        Object object;
+        object.positions = positions;
+        object.indices = indices;
+        object.transform = transform;
+        object.firstTriangle = (int)triangles.size();
+        object.triangleCount = (int)(indices.size() / 3);
+        object.moved = false;
+
+        int objectId = (int)objects.size();
+        objects.push_back(object);
+
+        for (int i = 0; i < object.triangleCount; i++) {
+            Triangle triangle;
+            triangle.objectId = objectId;
+            triangle.triangleId = object.firstTriangle + i;
+            triangleSlots.push_back((int)triangles.size());
+            triangles.push_back(triangle);
+        }
+        UpdateTriangles(objectId);
+
+        return objectId;
+    }
+
+    void Bvh::Clear() {
+        objects.clear();
+        triangles.clear();
+        triangleSlots.clear();
+        buildReferences.clear();
+        nodes.clear();
+        nodeParents.clear();
+        triangleLeaves.clear();
+        nodeObjects.clear();
+        nodeRefitQueued.clear();
+        nodeCount = 0;
+    }
+
+    void Bvh::Build(ThreadPool* pool) {
+        for (size_t i = 0; i < objects.size(); i++) {
+            if (objects[i].moved) {
+                UpdateTriangles((int)i);
+                objects[i].moved = false;
+            }
+        }
+
+        int triangleCount = (int)triangles.size();
+        if (triangleCount == 0) {
+            nodes.clear();
+            nodeCount = 0;
+            return;
+        }
+
+        buildReferences.resize(triangleCount);
+        for (int i = 0; i < triangleCount; i++) {
+            const Triangle& triangle = triangles[i];
+            BuildReference& reference = buildReferences[i];
+            reference.bounds = BoundingBox(triangle.v0, triangle.v0);
+            reference.bounds.expand(triangle.v1);
+            reference.bounds.expand(triangle.v2);
+            reference.centroid = (triangle.v0 + triangle.v1 + triangle.v2) / 3.0f;
+            reference.slot = i;
+        }
+
+        //a binary tree with one triangle per leaf has 2n - 1 nodes
+        int maxNodes = 2 * triangleCount - 1;
+        nodes.resize(maxNodes);
+        nodeParents.assign(maxNodes, -1);
+
+        BvhNode& root = nodes[0];
+        root.leftFirst = 0;
+        root.count = triangleCount;
+        root.bounds = ComputeReferenceBounds(0, triangleCount);
+
+        //children are always allocated after their parent, which Refit relies on
+        std::atomic<int> nextNode(1);
+
+        if (pool == NULL || pool->getThreadCount() == 0) {
+            BuildSubtree(0, 0, nextNode);
+        }
+        else {
+            //split breadth first until there are enough independent subtrees to keep every worker busy
+            size_t targetSubtrees = (size_t)pool->getThreadCount() * 4;
+            //node and depth of every subtree
+            std::vector<std::pair<int, int> > subtrees;
+            std::vector<int> frontier(1, 0);
+            int depth = 0;
+
+            while (!frontier.empty() && frontier.size() + subtrees.size() < targetSubtrees) {
+                std::vector<int> nextFrontier;
+                for (size_t i = 0; i < frontier.size(); i++) {
+                    if (nodes[frontier[i]].count < MIN_PARALLEL_TRIANGLES) {
+                        subtrees.push_back(std::make_pair(frontier[i], depth));
+                        continue;
+                    }
+                    int left = SplitNode(frontier[i], depth, nextNode);
+                    if (left >= 0) {
+                        nextFrontier.push_back(left);
+                        nextFrontier.push_back(left + 1);
+                    }
+                }
+                frontier = nextFrontier;
+                depth++;
+            }
+            for (size_t i = 0; i < frontier.size(); i++)
+                subtrees.push_back(std::make_pair(frontier[i], depth));
+
+            pool->ParallelFor(subtrees.size(), 1, [this, &subtrees, &nextNode](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++)
+                    BuildSubtree(subtrees[i].first, subtrees[i].second, nextNode);
+            });
+        }
+
+        nodeCount = nextNode.load();
+        nodes.resize(nodeCount);
+        nodeParents.resize(nodeCount);
+        nodeRefitQueued.assign(nodeCount, 0);
+
+        //store the triangles in leaf order
+        std::vector<Triangle> sortedTriangles(triangleCount);
+        for (int i = 0; i < triangleCount; i++) {
+            sortedTriangles[i] = triangles[buildReferences[i].slot];
+            triangleSlots[sortedTriangles[i].triangleId] = i;
+        }
+        triangles.swap(sortedTriangles);
+        buildReferences.clear();
+
+        triangleLeaves.resize(triangleCount);
+        for (int n = 0; n < nodeCount; n++) {
+            for (int i = 0; i < nodes[n].count; i++)
+                triangleLeaves[nodes[n].leftFirst + i] = n;
+        }
+
+        //bottom up, lets frustum queries stop at the first node owned by a single object
+        nodeObjects.resize(nodeCount);
+        for (int n = nodeCount - 1; n >= 0; n--) {
+            const BvhNode& node = nodes[n];
+            if (node.count > 0) {
+                int objectId = triangles[node.leftFirst].objectId;
+                for (int i = 1; i < node.count && objectId >= 0; i++) {
+                    if (triangles[node.leftFirst + i].objectId != objectId)
+                        objectId = -1;
+                }
+                nodeObjects[n] = objectId;
+            }
+            else {
+                nodeObjects[n] = nodeObjects[node.leftFirst] == nodeObjects[node.leftFirst + 1] ? nodeObjects[node.leftFirst] : -1;
+            }
+        }
+    }
+
+    void Bvh::SetTransform(int objectId, const glm::mat4& transform) {
+        objects[objectId].transform = transform;
+        objects[objectId].moved = true;
+    }
+
+    void Bvh::Refit() {
+        std::vector<int> queuedNodes;
+
+        for (size_t i = 0; i < objects.size(); i++) {
+            Object& object = objects[i];
+            if (!object.moved)
+                continue;
+
+            UpdateTriangles((int)i);
+            object.moved = false;
+
+            if (nodeCount == 0)
+                continue;
+
+            //queue the leaves of the object and all their ancestors, once
+            for (int t = object.firstTriangle; t < object.firstTriangle + object.triangleCount; t++) {
+                int node = triangleLeaves[triangleSlots[t]];
+                while (node >= 0 && !nodeRefitQueued[node]) {
+                    nodeRefitQueued[node] = 1;
+                    queuedNodes.push_back(node);
+                    node = nodeParents[node];
+                }
+            }
+        }
+
+        //children have larger indices than their parents, so this updates the tree bottom up
+        std::sort(queuedNodes.begin(), queuedNodes.end(), std::greater<int>());
+        for (size_t i = 0; i < queuedNodes.size(); i++) {
+            BvhNode& node = nodes[queuedNodes[i]];
+            if (node.count > 0) {
+                node.bounds = ComputeLeafBounds(node.leftFirst, node.count);
+            }
+            else {
+                node.bounds = nodes[node.leftFirst].bounds;
+                node.bounds.expand(nodes[node.leftFirst + 1].bounds);
+            }
+            nodeRefitQueued[queuedNodes[i]] = 0;
+        }
+    }
+
+    void Bvh::QueryFrustum(const Frustum& frustum, std::vector<bool>& visibleObjects) const {
+        visibleObjects.assign(objects.size(), false);
+        if (nodeCount == 0)
+            return;
+
+        //node index and whether its parent was already fully inside
+        std::vector<std::pair<int, bool> > stack;
+        stack.push_back(std::make_pair(0, false));
+
+        while (!stack.empty()) {
+            int nodeIndex = stack.back().first;
+            bool inside = stack.back().second;
+            stack.pop_back();
+
+            //nothing left to learn below a node owned by an object that is already visible
+            int objectId = nodeObjects[nodeIndex];
+            if (objectId >= 0 && visibleObjects[objectId])
+                continue;
+
+            const BvhNode& node = nodes[nodeIndex];
+            if (!inside) {
+                FRUSTUM_TEST test = frustum.classify(node.bounds);
+                if (test == FRUSTUM_OUTSIDE)
+                    continue;
+                inside = test == FRUSTUM_INSIDE;
+            }
+
+            if (objectId >= 0 && inside) {
+                visibleObjects[objectId] = true;
+            }
+            else if (node.count > 0) {
+                for (int i = 0; i < node.count; i++)
+                    visibleObjects[triangles[node.leftFirst + i].objectId] = true;
+            }
+            else {
+                stack.push_back(std::make_pair(node.leftFirst, inside));
+                stack.push_back(std::make_pair(node.leftFirst + 1, inside));
+            }
+        }
+    }
+
+    bool Bvh::Intersect(const Ray& ray, float maxDistance, RayHit& hit) const {
+        if (nodeCount == 0)
+            return false;
+
+        glm::vec3 inverseDirection = glm::vec3(1.0f) / ray.direction;
+        bool found = false;
+        hit.distance = maxDistance;
+
+        int stack[TRAVERSAL_STACK_SIZE];
+        int stackSize = 0;
+        float tEnter;
+        if (!IntersectBox(nodes[0].bounds, ray.origin, inverseDirection, hit.distance, tEnter))
+            return false;
+        stack[stackSize++] = 0;
+
+        while (stackSize > 0) {
+            const BvhNode& node = nodes[stack[--stackSize]];
+
+            if (node.count > 0) {
+                for (int i = 0; i < node.count; i++) {
+                    if (IntersectTriangle(ray, node.leftFirst + i, hit.distance, hit))
+                        found = true;
+                }
+                continue;
+            }
+
+            //visit the nearer child first so the far one is more likely to be culled by the closer hit
+            assert(stackSize + 2 <= TRAVERSAL_STACK_SIZE);
+            float tLeft, tRight;
+            bool hitLeft = IntersectBox(nodes[node.leftFirst].bounds, ray.origin, inverseDirection, hit.distance, tLeft);
+            bool hitRight = IntersectBox(nodes[node.leftFirst + 1].bounds, ray.origin, inverseDirection, hit.distance, tRight);
+
+            if (hitLeft && hitRight) {
+                bool leftFirst = tLeft <= tRight;
+                stack[stackSize++] = leftFirst ? node.leftFirst + 1 : node.leftFirst;
+                stack[stackSize++] = leftFirst ? node.leftFirst : node.leftFirst + 1;
+            }
+            else if (hitLeft) {
+                stack[stackSize++] = node.leftFirst;
+            }
+            else if (hitRight) {
+                stack[stackSize++] = node.leftFirst + 1;
+            }
+        }
+
+        return found;
+    }
+
+    bool Bvh::IntersectAny(const Ray& ray, float maxDistance) const {
+        if (nodeCount == 0)
+            return false;
+
+        glm::vec3 inverseDirection = glm::vec3(1.0f) / ray.direction;
+        RayHit hit;
+
+        int stack[TRAVERSAL_STACK_SIZE];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+
+        while (stackSize > 0) {
+            const BvhNode& node = nodes[stack[--stackSize]];
+
+            float tEnter;
+            if (!IntersectBox(node.bounds, ray.origin, inverseDirection, maxDistance, tEnter))
+                continue;
+
+            if (node.count > 0) {
+                for (int i = 0; i < node.count; i++) {
+                    if (IntersectTriangle(ray, node.leftFirst + i, maxDistance, hit))
+                        return true;
+                }
+            }
+            else {
+                assert(stackSize + 2 <= TRAVERSAL_STACK_SIZE);
+                stack[stackSize++] = node.leftFirst + 1;
+                stack[stackSize++] = node.leftFirst;
+            }
+        }
+
+        return false;
+    }
+
+    void Bvh::QueryRay(const Ray& ray, float maxDistance, std::vector<RayHit>& hits) const {
+        hits.clear();
+        if (nodeCount == 0)
+            return;
+
+        glm::vec3 inverseDirection = glm::vec3(1.0f) / ray.direction;
+        RayHit hit;
+
+        int stack[TRAVERSAL_STACK_SIZE];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+
+        while (stackSize > 0) {
+            const BvhNode& node = nodes[stack[--stackSize]];
+
+            float tEnter;
+            if (!IntersectBox(node.bounds, ray.origin, inverseDirection, maxDistance, tEnter))
+                continue;
+
+            if (node.count > 0) {
+                for (int i = 0; i < node.count; i++) {
+                    if (IntersectTriangle(ray, node.leftFirst + i, maxDistance, hit))
+                        hits.push_back(hit);
+                }
+            }
+            else {
+                assert(stackSize + 2 <= TRAVERSAL_STACK_SIZE);
+                stack[stackSize++] = node.leftFirst + 1;
+                stack[stackSize++] = node.leftFirst;
+            }
+        }
+
+        std::sort(hits.begin(), hits.end(), [](const RayHit& a, const RayHit& b) { return a.distance < b.distance; });
+    }
+
+    int Bvh::getObjectCount() const {
+        return (int)objects.size();
+    }
+
+    int Bvh::getTriangleCount() const {
+        return (int)triangles.size();
+    }
+
+    int Bvh::getNodeCount() const {
+        return nodeCount;
+    }
+
+    BoundingBox Bvh::getBounds() const {
+        if (nodeCount == 0)
+            return BoundingBox();
+        return nodes[0].bounds;
+    }
+
+    BoundingBox Bvh::getObjectBounds(int objectId) const {
+        const Object& object = objects[objectId];
+        BoundingBox bounds;
+        for (int t = object.firstTriangle; t < object.firstTriangle + object.triangleCount; t++) {
+            const Triangle& triangle = triangles[triangleSlots[t]];
+            bounds.expand(triangle.v0);
+            bounds.expand(triangle.v1);
+            bounds.expand(triangle.v2);
+        }
+        return bounds;
+    }
+
+    void Bvh::UpdateTriangles(int objectId) {
+        const Object& object = objects[objectId];
+
+        for (int i = 0; i < object.triangleCount; i++) {
+            Triangle& triangle = triangles[triangleSlots[object.firstTriangle + i]];
+            triangle.v0 = glm::vec3(object.transform * glm::vec4(object.positions[object.indices[3 * i + 0]], 1.0f));
+            triangle.v1 = glm::vec3(object.transform * glm::vec4(object.positions[object.indices[3 * i + 1]], 1.0f));
+            triangle.v2 = glm::vec3(object.transform * glm::vec4(object.positions[object.indices[3 * i + 2]], 1.0f));
+        }
+    }
+
+    BoundingBox Bvh::ComputeLeafBounds(int first, int count) const {
+        BoundingBox bounds;
+        for (int i = first; i < first + count; i++) {
+            bounds.expand(triangles[i].v0);
+            bounds.expand(triangles[i].v1);
+            bounds.expand(triangles[i].v2);
+        }
+        return bounds;
+    }
+
+    BoundingBox Bvh::ComputeReferenceBounds(int first, int count) const {
+        BoundingBox bounds;
+        for (int i = first; i < first + count; i++)
+            bounds.expand(buildReferences[i].bounds);
+        return bounds;
+    }
+
+    bool Bvh::FindSplit(const BvhNode& node, Split& split) const {
+        if (node.count <= 1)
+            return false;
+
+        BoundingBox centroidBounds;
+        for (int i = node.leftFirst; i < node.leftFirst + node.count; i++)
+            centroidBounds.expand(buildReferences[i].centroid);
+
+        float bestCost = FLT_MAX;
+        //small nodes do not need many candidate planes, the sweep would cost more than the binning
+        int binCount = std::min(SAH_BINS, std::max(node.count, 2));
+
+        for (int a = 0; a < 3; a++) {
+            float extent = centroidBounds.max[a] - centroidBounds.min[a];
+            if (extent <= 0.0f)
+                continue;
+
+            float scale = binCount / extent;
+            BoundingBox binBounds[SAH_BINS];
+            int binCounts[SAH_BINS] = { 0 };
+
+            for (int i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+                const BuildReference& reference = buildReferences[i];
+                int bin = BinIndex(reference.centroid[a], centroidBounds.min[a], scale, binCount);
+                binCounts[bin]++;
+                binBounds[bin].expand(reference.bounds);
+            }
+
+            //sweep from both sides to get the bounds and count left and right of every plane
+            BoundingBox leftBoxes[SAH_BINS - 1], rightBoxes[SAH_BINS - 1];
+            int leftCount[SAH_BINS - 1], rightCount[SAH_BINS - 1];
+            BoundingBox leftBox, rightBox;
+            int leftSum = 0, rightSum = 0;
+            for (int i = 0; i < binCount - 1; i++) {
+                leftSum += binCounts[i];
+                leftCount[i] = leftSum;
+                leftBox.expand(binBounds[i]);
+                leftBoxes[i] = leftBox;
+
+                rightSum += binCounts[binCount - 1 - i];
+                rightCount[binCount - 2 - i] = rightSum;
+                rightBox.expand(binBounds[binCount - 1 - i]);
+                rightBoxes[binCount - 2 - i] = rightBox;
+            }
+
+            for (int i = 0; i < binCount - 1; i++) {
+                if (leftCount[i] == 0 || rightCount[i] == 0)
+                    continue;
+                float cost = leftCount[i] * leftBoxes[i].getSurfaceArea() + rightCount[i] * rightBoxes[i].getSurfaceArea();
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    split.axis = a;
+                    split.bin = i;
+                    split.binCount = binCount;
+                    split.centroidMin = centroidBounds.min[a];
+                    split.binScale = scale;
+                    split.leftBounds = leftBoxes[i];
+                    split.rightBounds = rightBoxes[i];
+                }
+            }
+        }
+
+        //every centroid coincides, there is no plane separating them
+        if (bestCost == FLT_MAX)
+            return false;
+
+        float nodeArea = node.bounds.getSurfaceArea();
+        float leafCost = node.count * nodeArea;
+        float splitCost = TRAVERSAL_COST * nodeArea + bestCost;
+
+        return splitCost < leafCost || node.count > MAX_LEAF_TRIANGLES;
+    }
+
+    int Bvh::SplitNode(int nodeIndex, int depth, std::atomic<int>& nextNode) {
+        Split split;
+        if (depth >= MAX_BUILD_DEPTH || !FindSplit(nodes[nodeIndex], split))
+            return -1;
+
+        BvhNode& node = nodes[nodeIndex];
+        std::vector<BuildReference>::iterator first = buildReferences.begin() + node.leftFirst;
+        std::vector<BuildReference>::iterator middle = std::partition(first, first + node.count, [&](const BuildReference& reference) {
+            return BinIndex(reference.centroid[split.axis], split.centroidMin, split.binScale, split.binCount) <= split.bin;
+        });
+
+        int leftCount = (int)(middle - first);
+        if (leftCount == 0 || leftCount == node.count)
+            return -1;
+
+        int left = nextNode.fetch_add(2);
+
+        nodes[left].leftFirst = node.leftFirst;
+        nodes[left].count = leftCount;
+        nodes[left].bounds = split.leftBounds;
+
+        nodes[left + 1].leftFirst = node.leftFirst + leftCount;
+        nodes[left + 1].count = node.count - leftCount;
+        nodes[left + 1].bounds = split.rightBounds;
+
+        nodeParents[left] = nodeIndex;
+        nodeParents[left + 1] = nodeIndex;
+
+        node.leftFirst = left;
+        node.count = 0;
+
+        return left;
+    }
+
+    void Bvh::BuildSubtree(int nodeIndex, int depth, std::atomic<int>& nextNode) {
+        //node and its depth
+        std::vector<std::pair<int, int> > stack(1, std::make_pair(nodeIndex, depth));
+
+        while (!stack.empty()) {
+            int current = stack.back().first;
+            int currentDepth = stack.back().second;
+            stack.pop_back();
+
+            int left = SplitNode(current, currentDepth, nextNode);
+            if (left >= 0) {
+                stack.push_back(std::make_pair(left, currentDepth + 1));
+                stack.push_back(std::make_pair(left + 1, currentDepth + 1));
+            }
+        }
+    }
+
+    //Moller-Trumbore, triangles are hit from both sides
+    bool Bvh::IntersectTriangle(const Ray& ray, int slot, float maxDistance, RayHit& hit) const {
+        const Triangle& triangle = triangles[slot];
+        glm::vec3 edge1 = triangle.v1 - triangle.v0;
+        glm::vec3 edge2 = triangle.v2 - triangle.v0;
+
+        glm::vec3 p = glm::cross(ray.direction, edge2);
+        float determinant = glm::dot(edge1, p);
+        if (std::fabs(determinant) < 1e-9f)
+            return false;
+
+        float inverseDeterminant = 1.0f / determinant;
+        glm::vec3 s = ray.origin - triangle.v0;
+        float u = glm::dot(s, p) * inverseDeterminant;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+
+        glm::vec3 q = glm::cross(s, edge1);
+        float v = glm::dot(ray.direction, q) * inverseDeterminant;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+
+        float t = glm::dot(edge2, q) * inverseDeterminant;
+        if (t <= 0.0f || t >= maxDistance)
+            return false;
+
+        hit.distance = t;
+        hit.objectId = triangle.objectId;
+        hit.triangleIndex = triangle.triangleId - objects[triangle.objectId].firstTriangle;
+        hit.u = u;
+        hit.v = v;
+        return true;
+    }
+}
@@ -0,0 +1,144 @@
+#ifndef Bvh_hpp
+#define Bvh_hpp
+
+#include "BoundingBox.hpp"
+#include "Frustum.hpp"
+#include "ThreadPool.hpp"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <vector>
+
+namespace gps {
+
+    struct Ray
+    {
+        glm::vec3 origin;
+        glm::vec3 direction;
+    };
+
+    struct RayHit
+    {
+        float distance;
+        //object the triangle belongs to and the triangle index inside that object
+        int objectId;
+        int triangleIndex;
+        //barycentric coordinates of the hit point
+        float u;
+        float v;
+    };
+
+    struct BvhNode
+    {
+        BoundingBox bounds;
+        //first triangle for leaves, left child for inner nodes (the right child is leftFirst + 1)
+        int leftFirst;
+        //number of triangles, 0 for inner nodes
+        int count;
+    };
+
+    //bounding volume hierarchy over the triangles of every added object
+    //built with the binned surface area heuristic; moving objects are handled by refitting
+    class Bvh
+    {
+    public:
+        Bvh();
+
+        //adds an indexed triangle list in object space, placed in the world by transform
+        //returns the id of the object, ids are consecutive starting from 0
+        int AddObject(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices, const glm::mat4& transform);
+        //removes every object and node
+        void Clear();
+
+        //builds the tree, the top levels are split on the calling thread and the subtrees are built on the pool
+        void Build(ThreadPool* pool = NULL);
+
+        //moves an object; the tree is updated on the next Refit call
+        void SetTransform(int objectId, const glm::mat4& transform);
+        //recomputes the bounds of the nodes touched by moved objects, keeping the topology
+        void Refit();
+
+        //flags every object with at least one triangle inside the frustum
+        void QueryFrustum(const Frustum& frustum, std::vector<bool>& visibleObjects) const;
+        //nearest hit along the ray, closer than maxDistance
+        bool Intersect(const Ray& ray, float maxDistance, RayHit& hit) const;
+        //true if anything is hit closer than maxDistance - cheaper than Intersect, used for visibility rays
+        bool IntersectAny(const Ray& ray, float maxDistance) const;
+        //every hit along the ray closer than maxDistance, sorted front to back
+        void QueryRay(const Ray& ray, float maxDistance, std::vector<RayHit>& hits) const;
+
+        int getObjectCount() const;
+        int getTriangleCount() const;
+        int getNodeCount() const;
+        BoundingBox getBounds() const;
+        BoundingBox getObjectBounds(int objectId) const;
+
+    private:
+        struct Object {
+            std::vector<glm::vec3> positions;
+            std::vector<unsigned int> indices;
+            glm::mat4 transform;
+            int firstTriangle;
+            int triangleCount;
+            bool moved;
+        };
+
+        struct Triangle {
+            glm::vec3 v0;
+            glm::vec3 v1;
+            glm::vec3 v2;
+            int objectId;
+            //index in object order, firstTriangle of the object + local index
+            int triangleId;
+        };
+
+        //compact per triangle data partitioned while building, so splits read memory sequentially
+        struct BuildReference {
+            BoundingBox bounds;
+            glm::vec3 centroid;
+            int slot;
+        };
+
+        //best plane found for a node, with the bounds of both sides
+        struct Split {
+            int axis;
+            int bin;
+            int binCount;
+            float centroidMin;
+            float binScale;
+            BoundingBox leftBounds;
+            BoundingBox rightBounds;
+        };
+
+        std::vector<Object> objects;
+        //stored in leaf order once built, so leaves read contiguous triangles
+        std::vector<Triangle> triangles;
+        //position in triangles of every triangle id
+        std::vector<int> triangleSlots;
+        std::vector<BuildReference> buildReferences;
+        std::vector<BvhNode> nodes;
+        std::vector<int> nodeParents;
+        //leaf holding each triangle slot, used to find the nodes a moved object touches
+        std::vector<int> triangleLeaves;
+        //object owning every triangle below the node, -1 if the subtree mixes objects
+        std::vector<int> nodeObjects;
+        //nodes already queued by the current refit
+        std::vector<unsigned char> nodeRefitQueued;
+        int nodeCount;
+
+        void UpdateTriangles(int objectId);
+        BoundingBox ComputeLeafBounds(int first, int count) const;
+        BoundingBox ComputeReferenceBounds(int first, int count) const;
+        //returns false if the node should stay a leaf
+        bool FindSplit(const BvhNode& node, Split& split) const;
+        //splits one node at depth (0 for the root) in two and returns the index of the left child, or -1 if it became
+        //a leaf
+        int SplitNode(int nodeIndex, int depth, std::atomic<int>& nextNode);
+        void BuildSubtree(int nodeIndex, int depth, std::atomic<int>& nextNode);
+        bool IntersectTriangle(const Ray& ray, int slot, float maxDistance, RayHit& hit) const;
+    };
+
+}
+
+#endif /* Bvh_hpp */
@@ -19,6 +19,14 @@ namespace gps {
         return glm::lookAt(cameraPosition, cameraTarget, cameraUpDirection);
     }
 
+    glm::mat4 Camera::getViewMatrix(glm::vec3 position) {
+        return glm::lookAt(position, position + cameraFrontDirection, cameraUpDirection);
+    }
+
+    glm::vec3 Camera::getPosition() {
+        return cameraPosition;
+    }
+
     //update the camera internal parameters following a camera move event
     void Camera::move(MOVE_DIRECTION direction, float speed) {
         //TODO
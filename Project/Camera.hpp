@@ -17,6 +17,9 @@ namespace gps {
         Camera(glm::vec3 cameraPosition, glm::vec3 cameraTarget, glm::vec3 cameraUp);
         //return the view matrix, using the glm::lookAt() function
         glm::mat4 getViewMatrix();
+        //the view matrix with the camera moved to position, looking the same way
+        glm::mat4 getViewMatrix(glm::vec3 position);
+        glm::vec3 getPosition();
         //update the camera internal parameters following a camera move event
         void move(MOVE_DIRECTION direction, float speed);
         //update the camera internal parameters following a camera rotate event
@@ -0,0 +1,220 @@
+#include "CascadedShadowMap.hpp"
+#include "RenderStats.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+    //blend between logarithmic (1) and uniform (0) split distances
+    const float SPLIT_LAMBDA = 0.8f;
+    //cascades move in steps of this fraction of their radius and are that much larger, so the cached static
+    //casters stay usable until the camera has moved a fair distance
+    const float CACHE_STEP = 0.125f;
+
+    CascadedShadowMap::CascadedShadowMap() {
+        this->resolution = 0;
+        this->cascadeCount = 0;
+        this->depthTexture = 0;
+        this->sampler = 0;
+        this->framebuffer = 0;
+        this->staticDepthTexture = 0;
+        this->staticFramebuffer = 0;
+        this->staticRebuildCount = 0;
+        for (int i = 0; i < MAX_CASCADES; i++) {
+            this->lightSpaceMatrices[i] = glm::mat4(1.0f);
+            this->splitDistances[i] = 0.0f;
+            this->texelSizes[i] = 0.0f;
+            this->staticLightSpaceMatrices[i] = glm::mat4(1.0f);
+            this->staticValid[i] = false;
+        }
+    }
+
+    void CascadedShadowMap::Create(int resolution, int cascadeCount) {
+        this->resolution = resolution;
+        this->cascadeCount = std::min(std::max(cascadeCount, 1), (int)MAX_CASCADES);
+
+        //linear filtering with depth comparison gives a 2x2 percentage closer filter per lookup
+        glGenSamplers(1, &sampler);
+        glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glSamplerParameteri(sampler, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glSamplerParameteri(sampler, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        glSamplerParameterfv(sampler, GL_TEXTURE_BORDER_COLOR, borderColor);
+        glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        //the cache is only copied from, never sampled
+        glGenTextures(1, &staticDepthTexture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, staticDepthTexture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, this->cascadeCount, 0,
+                     GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        glGenFramebuffers(1, &staticFramebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, staticFramebuffer);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticDepthTexture, 0, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        InvalidateStaticCache();
+    }
+
+    void CascadedShadowMap::Update(const glm::mat4& view, float fov, float aspect, float nearPlane, float farPlane,
+                                   const glm::vec3& lightDirection, const BoundingBox& casterBounds) {
+        glm::mat4 inverseView = glm::inverse(view);
+        float tanY = std::tan(fov * 0.5f);
+        float tanX = tanY * aspect;
+        glm::vec3 light = glm::normalize(lightDirection);
+        glm::vec3 up = std::fabs(light.x) < 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        //every cascade shares the orientation of the light, only its window over light space differs
+        glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), -light, up);
+
+        float previousSplit = nearPlane;
+        for (int c = 0; c < cascadeCount; c++) {
+            float ratio = (float)(c + 1) / (float)cascadeCount;
+            float logSplit = nearPlane * std::pow(farPlane / nearPlane, ratio);
+            float uniformSplit = nearPlane + (farPlane - nearPlane) * ratio;
+            float split = SPLIT_LAMBDA * logSplit + (1.0f - SPLIT_LAMBDA) * uniformSplit;
+
+            //corners of this part of the camera frustum
+            glm::vec3 corners[8];
+            glm::vec3 center(0.0f);
+            for (int i = 0; i < 8; i++) {
+                float depth = (i & 4) != 0 ? split : previousSplit;
+                glm::vec4 corner((i & 1) != 0 ? tanX * depth : -tanX * depth, (i & 2) != 0 ? tanY * depth : -tanY * depth, -depth, 1.0f);
+                corners[i] = glm::vec3(inverseView * corner);
+                center += corners[i] / 8.0f;
+            }
+
+            //a bounding sphere keeps the size of the cascade constant while the camera turns, rounded so it does not flicker
+            float radius = 0.0f;
+            for (int i = 0; i < 8; i++)
+                radius = std::max(radius, glm::length(corners[i] - center));
+            radius = std::ceil(radius * 16.0f) / 16.0f;
+
+            //the center moves over a grid of whole texels, so shadow edges stay still when the camera moves and the
+            //light frustum only changes when the camera crosses a grid line
+            float extent = radius * (1.0f + CACHE_STEP);
+            float texelSize = 2.0f * extent / resolution;
+            float step = std::max(std::floor(radius * CACHE_STEP / texelSize), 1.0f) * texelSize;
+            glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+            lightCenter = glm::floor(lightCenter / step + 0.5f) * step;
+
+            //casters between the light and the cascade are rendered too
+            float nearDepth = -lightCenter.z - extent;
+            if (!casterBounds.isEmpty()) {
+                for (int i = 0; i < 8; i++) {
+                    glm::vec4 corner((i & 1) != 0 ? casterBounds.max.x : casterBounds.min.x,
+                                     (i & 2) != 0 ? casterBounds.max.y : casterBounds.min.y,
+                                     (i & 4) != 0 ? casterBounds.max.z : casterBounds.min.z, 1.0f);
+                    nearDepth = std::min(nearDepth, -(lightView * corner).z);
+                }
+            }
+            nearDepth = std::floor(nearDepth / step) * step;
+            glm::mat4 lightProjection = glm::ortho(lightCenter.x - extent, lightCenter.x + extent,
+                                                   lightCenter.y - extent, lightCenter.y + extent,
+                                                   nearDepth, -lightCenter.z + extent);
+
+            lightSpaceMatrices[c] = lightProjection * lightView;
+            splitDistances[c] = split;
+            texelSizes[c] = texelSize;
+            previousSplit = split;
+
+            if (lightSpaceMatrices[c] != staticLightSpaceMatrices[c])
+                staticValid[c] = false;
+        }
+    }
+
+    void CascadedShadowMap::SetDepthTexture(GLuint texture) {
+        depthTexture = texture;
+    }
+
+    bool CascadedShadowMap::isStaticCacheValid(int cascade) const {
+        return staticValid[cascade];
+    }
+
+    void CascadedShadowMap::InvalidateStaticCache() {
+        for (int i = 0; i < MAX_CASCADES; i++)
+            staticValid[i] = false;
+    }
+
+    void CascadedShadowMap::BeginStaticCascade(int cascade) {
+        glBindFramebuffer(GL_FRAMEBUFFER, staticFramebuffer);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticDepthTexture, 0, cascade);
+        glViewport(0, 0, resolution, resolution);
+        glClear(GL_DEPTH_BUFFER_BIT);
+
+        staticLightSpaceMatrices[cascade] = lightSpaceMatrices[cascade];
+        staticValid[cascade] = true;
+        staticRebuildCount++;
+    }
+
+    void CascadedShadowMap::BeginCascade(int cascade) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFramebuffer);
+        glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticDepthTexture, 0, cascade);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+        glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0, cascade);
+        glBlitFramebuffer(0, 0, resolution, resolution, 0, 0, resolution, resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, resolution, resolution);
+    }
+
+    void CascadedShadowMap::End(int width, int height, GLuint sceneFramebuffer) {
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+        glViewport(0, 0, width, height);
+    }
+
+    void CascadedShadowMap::BindForSampling(gps::Shader shader, int textureUnit) const {
+        glActiveTexture(GL_TEXTURE0 + textureUnit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, depthTexture);
+        glBindSampler(textureUnit, sampler);
+        glActiveTexture(GL_TEXTURE0);
+
+        glUniform1i(glGetUniformLocation(shader.shaderProgram, "shadowMap"), textureUnit);
+        glUniform1i(glGetUniformLocation(shader.shaderProgram, "cascadeCount"), cascadeCount);
+        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "lightSpaceTrMatrices"), cascadeCount, GL_FALSE,
+                           glm::value_ptr(lightSpaceMatrices[0]));
+        glUniform1fv(glGetUniformLocation(shader.shaderProgram, "cascadeSplits"), cascadeCount, splitDistances);
+        glUniform1fv(glGetUniformLocation(shader.shaderProgram, "cascadeTexelSizes"), cascadeCount, texelSizes);
+    }
+
+    int CascadedShadowMap::getCascadeCount() const {
+        return cascadeCount;
+    }
+
+    int CascadedShadowMap::getResolution() const {
+        return resolution;
+    }
+
+    const glm::mat4& CascadedShadowMap::getLightSpaceMatrix(int cascade) const {
+        return lightSpaceMatrices[cascade];
+    }
+
+    float CascadedShadowMap::getSplitDistance(int cascade) const {
+        return splitDistances[cascade];
+    }
+
+    GLuint CascadedShadowMap::getDepthTexture() const {
+        return depthTexture;
+    }
+
+    int CascadedShadowMap::getStaticRebuildCount() const {
+        return staticRebuildCount;
+    }
+
+}
@@ -0,0 +1,83 @@
+#ifndef CascadedShadowMap_hpp
+#define CascadedShadowMap_hpp
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "BoundingBox.hpp"
+#include "Shader.hpp"
+
+namespace gps {
+
+    //directional light shadows: the camera frustum is split by distance and every part gets its own orthographic
+    //shadow map, one layer of a depth texture array, so near geometry gets as many texels as far geometry.
+    //the static casters of each cascade are kept in a second array and only rendered again when the light frustum
+    //of the cascade changes, every frame copies them and adds the moving casters on top. the array of the frame is
+    //not kept, it is handed in by the caller (a transient texture of the render graph)
+    class CascadedShadowMap
+    {
+    public:
+        static const int MAX_CASCADES = 4;
+
+        CascadedShadowMap();
+
+        //allocates the static depth texture array, the framebuffers and the sampler
+        void Create(int resolution, int cascadeCount);
+
+        //the array the cascades of this frame are rendered into and sampled from, getCascadeCount() layers of
+        //getResolution() squared in GL_DEPTH_COMPONENT24; set before BeginCascade
+        void SetDepthTexture(GLuint texture);
+
+        //splits [nearPlane, farPlane] of the camera and fits a light frustum around each part; casterBounds (world space)
+        //pulls the light near planes back so that everything casting into a cascade is rendered into it
+        void Update(const glm::mat4& view, float fov, float aspect, float nearPlane, float farPlane,
+                    const glm::vec3& lightDirection, const BoundingBox& casterBounds);
+
+        //false once the light frustum of the cascade moved away from the one its static casters were rendered with
+        bool isStaticCacheValid(int cascade) const;
+        //forces the static casters of every cascade to be rendered again, for when they move
+        void InvalidateStaticCache();
+        //renders into the cached static layer of one cascade, the depth is cleared
+        void BeginStaticCascade(int cascade);
+        //renders into the layer of one cascade, starting from a copy of its cached static casters
+        void BeginCascade(int cascade);
+        //back to the default framebuffer
+        void End(int width, int height, GLuint sceneFramebuffer = 0);
+
+        //sets the shadow uniforms of basic.frag and binds the texture array to textureUnit
+        void BindForSampling(gps::Shader shader, int textureUnit) const;
+
+        int getCascadeCount() const;
+        int getResolution() const;
+        //world to light clip space of a cascade
+        const glm::mat4& getLightSpaceMatrix(int cascade) const;
+        //view space distance where a cascade ends
+        float getSplitDistance(int cascade) const;
+        GLuint getDepthTexture() const;
+        //static layers rendered since Create
+        int getStaticRebuildCount() const;
+
+    private:
+        int resolution;
+        int cascadeCount;
+        GLuint depthTexture;
+        //depth comparison and border of the lookups, the texture of the frame changes
+        GLuint sampler;
+        GLuint framebuffer;
+        GLuint staticDepthTexture;
+        GLuint staticFramebuffer;
+
+        glm::mat4 lightSpaceMatrices[MAX_CASCADES];
+        float splitDistances[MAX_CASCADES];
+        //world size of a shadow texel, used to offset the lookups along the normal
+        float texelSizes[MAX_CASCADES];
+
+        //light frusta the static layers were rendered with
+        glm::mat4 staticLightSpaceMatrices[MAX_CASCADES];
+        bool staticValid[MAX_CASCADES];
+        int staticRebuildCount;
+    };
+
+}
+
+#endif /* CascadedShadowMap_hpp */
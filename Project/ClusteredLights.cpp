@@ -0,0 +1,224 @@
+#include "ClusteredLights.hpp"
+#include "RenderStats.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace gps {
+
+    const int CLUSTER_COUNT = ClusteredLights::GRID_X * ClusteredLights::GRID_Y * ClusteredLights::GRID_Z;
+    //room for the lamps, the lantern grid and a few lights in every cluster; the ring grows past it when needed
+    const size_t INITIAL_UPLOAD_SIZE = 256 * 1024;
+
+    ClusteredLights::ClusteredLights() {
+        this->gridFov = 0.0f;
+        this->gridAspect = 0.0f;
+        this->gridNear = 0.0f;
+        this->gridFar = 0.0f;
+        this->depthScale = 0.0f;
+        this->depthBias = 0.0f;
+        this->visibleLightCount = 0;
+        this->directBuffer = 0;
+        this->attachedBuffer = 0;
+        this->lightTexture = 0;
+        this->clusterTexture = 0;
+        this->indexTexture = 0;
+        this->lightOffset = 0;
+        this->clusterOffset = 0;
+        this->indexOffset = 0;
+    }
+
+    void ClusteredLights::Create() {
+        glGenTextures(1, &lightTexture);
+        glGenTextures(1, &clusterTexture);
+        glGenTextures(1, &indexTexture);
+        uploads.Create(INITIAL_UPLOAD_SIZE, true, "light clusters");
+        AttachTextures(uploads.getBuffer());
+
+        clusterData.assign(CLUSTER_COUNT * 2, 0);
+    }
+
+    //the three textures read the whole buffer in their own texel format
+    void ClusteredLights::AttachTextures(GLuint buffer) {
+        attachedBuffer = buffer;
+        glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, attachedBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, clusterTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, attachedBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, attachedBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    //copies size bytes into the part of the frame and sets texel to the one of a texture of texelSize bytes they start
+    //at, false when the part has no room left
+    static bool writeTexels(RingBuffer& ring, const void* data, size_t size, size_t texelSize, GLint& texel) {
+        size_t offset = 0;
+        void* memory = ring.Allocate(size, texelSize, offset);
+        if (memory == NULL)
+            return false;
+        std::memcpy(memory, data, size);
+        texel = (GLint)(offset / texelSize);
+        return true;
+    }
+
+    GLuint ClusteredLights::UploadDirect(size_t lightBytes, size_t clusterBytes, size_t indexBytes) {
+        if (directBuffer == 0)
+            glGenBuffers(1, &directBuffer);
+
+        //every list starts at a multiple of the largest texel
+        size_t alignment = sizeof(glm::vec4);
+        size_t clusterStart = (lightBytes + alignment - 1) / alignment * alignment;
+        size_t indexStart = (clusterStart + clusterBytes + alignment - 1) / alignment * alignment;
+        glBindBuffer(GL_TEXTURE_BUFFER, directBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, indexStart + indexBytes, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, lightBytes, &lightData[0]);
+        glBufferSubData(GL_TEXTURE_BUFFER, clusterStart, clusterBytes, &clusterData[0]);
+        glBufferSubData(GL_TEXTURE_BUFFER, indexStart, indexBytes, &lightIndices[0]);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        lightOffset = 0;
+        clusterOffset = (GLint)(clusterStart / (2 * sizeof(GLuint)));
+        indexOffset = (GLint)(indexStart / sizeof(GLuint));
+        return directBuffer;
+    }
+
+    void ClusteredLights::SetLights(const std::vector<PointLight>& lights) {
+        this->lights = lights;
+    }
+
+    const std::vector<PointLight>& ClusteredLights::getLights() const {
+        return lights;
+    }
+
+    void ClusteredLights::BuildGrid(float fov, float aspect, float nearPlane, float farPlane) {
+        gridFov = fov;
+        gridAspect = aspect;
+        gridNear = nearPlane;
+        gridFar = farPlane;
+        depthScale = GRID_Z / std::log(farPlane / nearPlane);
+        depthBias = -std::log(nearPlane) * depthScale;
+
+        float tanY = std::tan(fov * 0.5f);
+        float tanX = tanY * aspect;
+        clusterBounds.resize(CLUSTER_COUNT);
+        for (int z = 0; z < GRID_Z; z++) {
+            float sliceNear = nearPlane * std::pow(farPlane / nearPlane, (float)z / GRID_Z);
+            float sliceFar = nearPlane * std::pow(farPlane / nearPlane, (float)(z + 1) / GRID_Z);
+            for (int y = 0; y < GRID_Y; y++) {
+                for (int x = 0; x < GRID_X; x++) {
+                    //the tile spans these normalized device coordinates, at both ends of the slice
+                    glm::vec2 ndcMin(-1.0f + 2.0f * x / GRID_X, -1.0f + 2.0f * y / GRID_Y);
+                    glm::vec2 ndcMax(-1.0f + 2.0f * (x + 1) / GRID_X, -1.0f + 2.0f * (y + 1) / GRID_Y);
+                    BoundingBox bounds;
+                    for (int i = 0; i < 8; i++) {
+                        float depth = (i & 4) != 0 ? sliceFar : sliceNear;
+                        bounds.expand(glm::vec3(((i & 1) != 0 ? ndcMax.x : ndcMin.x) * tanX * depth,
+                                                ((i & 2) != 0 ? ndcMax.y : ndcMin.y) * tanY * depth, -depth));
+                    }
+                    clusterBounds[(z * GRID_Y + y) * GRID_X + x] = bounds;
+                }
+            }
+        }
+    }
+
+    int ClusteredLights::getSlice(float distance) const {
+        float slice = std::log(std::max(distance, gridNear)) * depthScale + depthBias;
+        return std::min(std::max((int)slice, 0), GRID_Z - 1);
+    }
+
+    void ClusteredLights::Update(const glm::mat4& view, float fov, float aspect, float nearPlane, float farPlane) {
+        if (fov != gridFov || aspect != gridAspect || nearPlane != gridNear || farPlane != gridFar)
+            BuildGrid(fov, aspect, nearPlane, farPlane);
+
+        lightData.resize(std::max(lights.size(), (size_t)1) * 2);
+        assignments.clear();
+        visibleLightCount = 0;
+        for (size_t i = 0; i < lights.size(); i++) {
+            glm::vec3 position = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+            float radius = lights[i].radius;
+            lightData[i * 2] = glm::vec4(position, radius);
+            lightData[i * 2 + 1] = glm::vec4(lights[i].color, 0.0f);
+
+            float distance = -position.z;
+            if (distance + radius < nearPlane || distance - radius > farPlane)
+                continue;
+            visibleLightCount++;
+
+            //only the slices the sphere overlaps are tested, a sphere against the box of every tile in them
+            int firstSlice = getSlice(distance - radius);
+            int lastSlice = getSlice(distance + radius);
+            for (int z = firstSlice; z <= lastSlice; z++) {
+                for (int c = z * GRID_X * GRID_Y; c < (z + 1) * GRID_X * GRID_Y; c++) {
+                    glm::vec3 closest = glm::clamp(position, clusterBounds[c].min, clusterBounds[c].max);
+                    glm::vec3 d = closest - position;
+                    if (glm::dot(d, d) <= radius * radius)
+                        assignments.push_back(glm::uvec2((GLuint)c, (GLuint)i));
+                }
+            }
+        }
+
+        //counting sort of the pairs by cluster, every cluster gets a contiguous list
+        std::fill(clusterData.begin(), clusterData.end(), 0);
+        for (size_t i = 0; i < assignments.size(); i++)
+            clusterData[assignments[i].x * 2 + 1]++;
+        GLuint offset = 0;
+        for (int c = 0; c < CLUSTER_COUNT; c++) {
+            clusterData[c * 2] = offset;
+            offset += clusterData[c * 2 + 1];
+            clusterData[c * 2 + 1] = 0;
+        }
+        lightIndices.resize(std::max(assignments.size(), (size_t)1));
+        for (size_t i = 0; i < assignments.size(); i++) {
+            GLuint c = assignments[i].x;
+            lightIndices[clusterData[c * 2] + clusterData[c * 2 + 1]++] = assignments[i].y;
+        }
+
+        //the part of the frame is made large enough for the three of them, with room to align each
+        size_t lightBytes = lightData.size() * sizeof(glm::vec4);
+        size_t clusterBytes = clusterData.size() * sizeof(GLuint);
+        size_t indexBytes = lightIndices.size() * sizeof(GLuint);
+        uploads.BeginFrame(lightBytes + clusterBytes + indexBytes + 3 * sizeof(glm::vec4));
+        GLuint source = uploads.getBuffer();
+        if (!writeTexels(uploads, &lightData[0], lightBytes, sizeof(glm::vec4), lightOffset) ||
+            !writeTexels(uploads, &clusterData[0], clusterBytes, 2 * sizeof(GLuint), clusterOffset) ||
+            !writeTexels(uploads, &lightIndices[0], indexBytes, sizeof(GLuint), indexOffset))
+            source = UploadDirect(lightBytes, clusterBytes, indexBytes);
+        if (source != attachedBuffer)
+            AttachTextures(source);
+        uploads.Flush();
+    }
+
+    void ClusteredLights::BindForSampling(gps::Shader shader, int firstTextureUnit, int width, int height) const {
+        glActiveTexture(GL_TEXTURE0 + firstTextureUnit);
+        glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+        glActiveTexture(GL_TEXTURE0 + firstTextureUnit + 1);
+        glBindTexture(GL_TEXTURE_BUFFER, clusterTexture);
+        glActiveTexture(GL_TEXTURE0 + firstTextureUnit + 2);
+        glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+        glActiveTexture(GL_TEXTURE0);
+
+        glUniform1i(glGetUniformLocation(shader.shaderProgram, "pointLights"), firstTextureUnit);
+        glUniform1i(glGetUniformLocation(shader.shaderProgram, "lightClusters"), firstTextureUnit + 1);
+        glUniform1i(glGetUniformLocation(shader.shaderProgram, "lightIndices"), firstTextureUnit + 2);
+        glUniform3i(glGetUniformLocation(shader.shaderProgram, "clusterOffsets"), lightOffset, clusterOffset, indexOffset);
+        glUniform3i(glGetUniformLocation(shader.shaderProgram, "clusterGrid"), GRID_X, GRID_Y, GRID_Z);
+        glUniform2f(glGetUniformLocation(shader.shaderProgram, "clusterTileScale"),
+                    (float)GRID_X / std::max(width, 1), (float)GRID_Y / std::max(height, 1));
+        glUniform2f(glGetUniformLocation(shader.shaderProgram, "clusterDepthScaleBias"), depthScale, depthBias);
+    }
+
+    int ClusteredLights::getLightCount() const {
+        return (int)lights.size();
+    }
+
+    int ClusteredLights::getVisibleLightCount() const {
+        return visibleLightCount;
+    }
+
+    int ClusteredLights::getLightIndexCount() const {
+        return (int)assignments.size();
+    }
+
+}
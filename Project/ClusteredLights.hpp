@@ -0,0 +1,99 @@
+#ifndef ClusteredLights_hpp
+#define ClusteredLights_hpp
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "BoundingBox.hpp"
+#include "RingBuffer.hpp"
+#include "Shader.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    //point light with a finite range, it adds nothing past radius
+    struct PointLight {
+        glm::vec3 position;
+        float radius;
+        glm::vec3 color;
+    };
+
+    //clustered forward lighting: the view frustum is divided into a grid of clusters (screen tiles times exponential
+    //depth slices) and every cluster lists the lights reaching it, so basic.frag only loops over the few lights near
+    //the fragment. the lights, the lists and the grid are texture buffers, OpenGL 4.1 has no storage buffers; all
+    //three are written into one ring buffer every frame and basic.frag reads them from where this frame's part starts
+    class ClusteredLights
+    {
+    public:
+        static const int GRID_X = 16;
+        static const int GRID_Y = 9;
+        static const int GRID_Z = 24;
+
+        ClusteredLights();
+
+        //allocates the ring buffer and the texture buffers over it
+        void Create();
+
+        void SetLights(const std::vector<PointLight>& lights);
+        const std::vector<PointLight>& getLights() const;
+
+        //assigns the lights to the clusters of the camera frustum and uploads the lists, view moves the light positions
+        //to eye space
+        void Update(const glm::mat4& view, float fov, float aspect, float nearPlane, float farPlane);
+
+        //sets the cluster uniforms of basic.frag and binds the buffers to firstTextureUnit and the two units after it,
+        //width and height are the size of the framebuffer the tiles are laid over
+        void BindForSampling(gps::Shader shader, int firstTextureUnit, int width, int height) const;
+
+        int getLightCount() const;
+        //lights in the view frustum after the last Update
+        int getVisibleLightCount() const;
+        //sum of the lengths of every cluster list after the last Update
+        int getLightIndexCount() const;
+
+    private:
+        std::vector<PointLight> lights;
+
+        //eye space bounds of every cluster, rebuilt when the projection changes
+        std::vector<BoundingBox> clusterBounds;
+        float gridFov;
+        float gridAspect;
+        float gridNear;
+        float gridFar;
+        //depth slice of a view distance d is log(d) * depthScale + depthBias
+        float depthScale;
+        float depthBias;
+
+        //per light (eye position, radius) and (color, 0)
+        std::vector<glm::vec4> lightData;
+        //per cluster first index and count
+        std::vector<GLuint> clusterData;
+        std::vector<GLuint> lightIndices;
+        //(cluster, light) pairs found by Update, sorted by cluster into lightIndices
+        std::vector<glm::uvec2> assignments;
+        int visibleLightCount;
+
+        RingBuffer uploads;
+        //the lists of a frame the ring had no room for, uploaded with glBufferSubData; made the first time it happens
+        GLuint directBuffer;
+        //the buffer the textures were last attached to: the ring, a new one when it grows, or directBuffer
+        GLuint attachedBuffer;
+        GLuint lightTexture;
+        GLuint clusterTexture;
+        GLuint indexTexture;
+        //first texel of the lights, the clusters and the light indices of the last Update in their texture buffers
+        GLint lightOffset;
+        GLint clusterOffset;
+        GLint indexOffset;
+
+        void BuildGrid(float fov, float aspect, float nearPlane, float farPlane);
+        void AttachTextures(GLuint buffer);
+        //uploads the three lists to directBuffer and returns it
+        GLuint UploadDirect(size_t lightBytes, size_t clusterBytes, size_t indexBytes);
+        int getSlice(float distance) const;
+    };
+
+}
+
+#endif /* ClusteredLights_hpp */
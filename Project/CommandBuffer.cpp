@@ -0,0 +1,143 @@
+#include "CommandBuffer.hpp"
+#include "RingBuffer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace gps {
+
+    //the arena a list starts with, grown by doubling
+    const size_t INITIAL_ARENA_SIZE = 4096;
+    //of the updates written into the upload ring, enough for the matrices of the instance data
+    const size_t UPLOAD_ALIGNMENT = 16;
+
+    CommandBuffer::CommandBuffer() {
+        this->used = 0;
+        this->openCommand = 0;
+        this->uploads = NULL;
+    }
+
+    void CommandBuffer::Reset() {
+        used = 0;
+    }
+
+    void CommandBuffer::SetUploadBuffer(RingBuffer* uploads) {
+        this->uploads = uploads;
+    }
+
+    void* CommandBuffer::Allocate(size_t size) {
+        if (used + size > arena.size())
+            arena.resize(std::max(std::max(arena.size() * 2, used + size), INITIAL_ARENA_SIZE));
+        void* memory = &arena[used];
+        used += size;
+        return memory;
+    }
+
+    void CommandBuffer::BeginCommand(CommandType type) {
+        openCommand = used;
+        CommandHeader header;
+        header.type = type;
+        header.size = 0;
+        std::memcpy(Allocate(sizeof(header)), &header, sizeof(header));
+    }
+
+    //pads the command to whole words and writes its size into the header
+    void CommandBuffer::EndCommand() {
+        Allocate((4 - used % 4) % 4);
+        uint32_t size = (uint32_t)(used - openCommand);
+        std::memcpy(&arena[openCommand + offsetof(CommandHeader, size)], &size, sizeof(size));
+    }
+
+    void CommandBuffer::BindProgram(uint32_t program) {
+        BeginCommand(BIND_PROGRAM);
+        BindProgramCommand command = { program };
+        std::memcpy(Allocate(sizeof(command)), &command, sizeof(command));
+        EndCommand();
+    }
+
+    void CommandBuffer::BindVertexArray(uint32_t vertexArray) {
+        BeginCommand(BIND_VERTEX_ARRAY);
+        BindVertexArrayCommand command = { vertexArray };
+        std::memcpy(Allocate(sizeof(command)), &command, sizeof(command));
+        EndCommand();
+    }
+
+    void CommandBuffer::BindTexture(uint32_t unit, TextureTarget target, uint32_t texture) {
+        assert(unit < MAX_TEXTURE_UNITS);
+        BeginCommand(BIND_TEXTURE);
+        BindTextureCommand command = { unit, (uint32_t)target, texture };
+        std::memcpy(Allocate(sizeof(command)), &command, sizeof(command));
+        EndCommand();
+    }
+
+    void CommandBuffer::BeginUniforms() {
+        BeginCommand(SET_UNIFORMS);
+    }
+
+    void CommandBuffer::SetUniform(int32_t location, int32_t value) {
+        UniformValue uniform = { location, UNIFORM_INT };
+        std::memcpy(Allocate(sizeof(uniform)), &uniform, sizeof(uniform));
+        std::memcpy(Allocate(sizeof(value)), &value, sizeof(value));
+    }
+
+    void CommandBuffer::SetUniform(int32_t location, const glm::vec3& value) {
+        UniformValue uniform = { location, UNIFORM_VEC3 };
+        std::memcpy(Allocate(sizeof(uniform)), &uniform, sizeof(uniform));
+        std::memcpy(Allocate(sizeof(value)), &value[0], sizeof(value));
+    }
+
+    void CommandBuffer::SetUniform(int32_t location, const glm::ivec3& value) {
+        UniformValue uniform = { location, UNIFORM_IVEC3 };
+        std::memcpy(Allocate(sizeof(uniform)), &uniform, sizeof(uniform));
+        std::memcpy(Allocate(sizeof(value)), &value[0], sizeof(value));
+    }
+
+    void CommandBuffer::EndUniforms() {
+        EndCommand();
+    }
+
+    void* CommandBuffer::UpdateBuffer(uint32_t buffer, uint32_t offset, size_t size) {
+        //without a mapping the ring would be one more copy, glBufferSubData of the list is as good
+        if (uploads != NULL && uploads->isPersistent()) {
+            size_t sourceOffset;
+            void* memory = uploads->Allocate(size, UPLOAD_ALIGNMENT, sourceOffset);
+            if (memory != NULL) {
+                CopyBuffer(uploads->getBuffer(), (uint32_t)sourceOffset, buffer, offset, size);
+                return memory;
+            }
+        }
+
+        BeginCommand(UPDATE_BUFFER);
+        UpdateBufferCommand command = { buffer, offset, (uint32_t)size };
+        std::memcpy(Allocate(sizeof(command)), &command, sizeof(command));
+        //the payload may move while the arena grows, its offset does not
+        size_t payload = used;
+        Allocate(size);
+        EndCommand();
+        return &arena[payload];
+    }
+
+    void CommandBuffer::CopyBuffer(uint32_t source, uint32_t sourceOffset, uint32_t buffer, uint32_t offset, size_t size) {
+        BeginCommand(COPY_BUFFER);
+        CopyBufferCommand command = { source, sourceOffset, buffer, offset, (uint32_t)size };
+        std::memcpy(Allocate(sizeof(command)), &command, sizeof(command));
+        EndCommand();
+    }
+
+    void CommandBuffer::DrawIndexed(uint32_t indexCount, uint32_t instanceCount) {
+        BeginCommand(DRAW_INDEXED);
+        DrawIndexedCommand command = { indexCount, instanceCount };
+        std::memcpy(Allocate(sizeof(command)), &command, sizeof(command));
+        EndCommand();
+    }
+
+    const unsigned char* CommandBuffer::getData() const {
+        return arena.empty() ? NULL : &arena[0];
+    }
+
+    size_t CommandBuffer::getSize() const {
+        return used;
+    }
+
+}
@@ -0,0 +1,140 @@
+#ifndef CommandBuffer_hpp
+#define CommandBuffer_hpp
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    class RingBuffer;
+
+    //draw commands recorded without calling the graphics API, so any thread can record a list; a backend
+    //(GLCommandBackend) replays the lists on the thread owning the context. the commands are packed one after the
+    //other in a linear arena that keeps its memory across frames, recording allocates nothing once a list has reached
+    //its usual size. objects are the names the backend gave them, uniforms are set by location. the data of buffer
+    //updates is carried in the list, or written straight into a mapped upload ring set with SetUploadBuffer
+    class CommandBuffer
+    {
+    public:
+        //texture units the lists may bind textures to
+        static const uint32_t MAX_TEXTURE_UNITS = 16;
+
+        enum CommandType {
+            BIND_PROGRAM,
+            BIND_VERTEX_ARRAY,
+            //a texture to a target of a texture unit, 0 unbinds
+            BIND_TEXTURE,
+            //uniform values of the bound program, the header is followed by UniformValue entries
+            SET_UNIFORMS,
+            //followed by the size bytes written to the buffer at offset
+            UPDATE_BUFFER,
+            //size bytes from the upload ring to the buffer at offset, copied by the gpu
+            COPY_BUFFER,
+            //indexed triangles with 32 bit indices from the bound vertex array
+            DRAW_INDEXED
+        };
+
+        enum TextureTarget {
+            TEXTURE_2D,
+            TEXTURE_2D_ARRAY
+        };
+
+        enum UniformType {
+            UNIFORM_INT,
+            UNIFORM_VEC3,
+            UNIFORM_IVEC3
+        };
+
+        //every command starts with a header, size counts the header, the command and its payload
+        struct CommandHeader {
+            uint32_t type;
+            uint32_t size;
+        };
+
+        struct BindProgramCommand {
+            uint32_t program;
+        };
+
+        struct BindVertexArrayCommand {
+            uint32_t vertexArray;
+        };
+
+        struct BindTextureCommand {
+            uint32_t unit;
+            uint32_t target;
+            uint32_t texture;
+        };
+
+        //followed by 1 (UNIFORM_INT) or 3 (UNIFORM_VEC3, UNIFORM_IVEC3) words of value
+        struct UniformValue {
+            int32_t location;
+            uint32_t type;
+        };
+
+        struct UpdateBufferCommand {
+            uint32_t buffer;
+            uint32_t offset;
+            uint32_t size;
+        };
+
+        struct CopyBufferCommand {
+            uint32_t source;
+            uint32_t sourceOffset;
+            uint32_t buffer;
+            uint32_t offset;
+            uint32_t size;
+        };
+
+        struct DrawIndexedCommand {
+            uint32_t indexCount;
+            uint32_t instanceCount;
+        };
+
+        CommandBuffer();
+
+        //forgets the commands, the arena is kept
+        void Reset();
+        //the ring UpdateBuffer writes into when it is mapped and has room, NULL keeps the data in the list. the
+        //ring is written from the recording thread, it must not begin a new frame before the list is replayed
+        void SetUploadBuffer(RingBuffer* uploads);
+
+        void BindProgram(uint32_t program);
+        void BindVertexArray(uint32_t vertexArray);
+        //unit is below MAX_TEXTURE_UNITS
+        void BindTexture(uint32_t unit, TextureTarget target, uint32_t texture);
+
+        //the uniforms set between BeginUniforms and EndUniforms are one SET_UNIFORMS command
+        void BeginUniforms();
+        void SetUniform(int32_t location, int32_t value);
+        void SetUniform(int32_t location, const glm::vec3& value);
+        void SetUniform(int32_t location, const glm::ivec3& value);
+        void EndUniforms();
+
+        //returns where to write the size bytes uploaded, valid until the next command is recorded
+        void* UpdateBuffer(uint32_t buffer, uint32_t offset, size_t size);
+        void CopyBuffer(uint32_t source, uint32_t sourceOffset, uint32_t buffer, uint32_t offset, size_t size);
+
+        void DrawIndexed(uint32_t indexCount, uint32_t instanceCount);
+
+        const unsigned char* getData() const;
+        //bytes of commands recorded since Reset
+        size_t getSize() const;
+
+    private:
+        std::vector<unsigned char> arena;
+        size_t used;
+        RingBuffer* uploads;
+        //offset of the header of the SET_UNIFORMS command being recorded
+        size_t openCommand;
+
+        void* Allocate(size_t size);
+        void BeginCommand(CommandType type);
+        void EndCommand();
+    };
+
+}
+
+#endif /* CommandBuffer_hpp */
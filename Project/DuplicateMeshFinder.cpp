@@ -0,0 +1,248 @@
+#include "DuplicateMeshFinder.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace gps {
+
+    const float NORMAL_TOLERANCE = 0.01f;
+    const float TEXCOORD_TOLERANCE = 0.0001f;
+    //the invariants are rounded to buckets this wide (relative to the size of the mesh)
+    const float INVARIANT_QUANTUM = 1.0f / 64.0f;
+
+    //eigen decomposition of a symmetric matrix with cyclic Jacobi rotations, the eigenvectors are the columns of vectors
+    template <int N>
+    static void jacobiEigen(double a[N][N], double values[N], double vectors[N][N]) {
+        for (int i = 0; i < N; i++)
+            for (int j = 0; j < N; j++)
+                vectors[i][j] = i == j ? 1.0 : 0.0;
+
+        for (int sweep = 0; sweep < 32; sweep++) {
+            double diagonal = 0.0, offDiagonal = 0.0;
+            for (int p = 0; p < N; p++) {
+                diagonal += a[p][p] * a[p][p];
+                for (int q = p + 1; q < N; q++)
+                    offDiagonal += a[p][q] * a[p][q];
+            }
+            if (offDiagonal <= 1e-24 * diagonal)
+                break;
+
+            for (int p = 0; p < N; p++) {
+                for (int q = p + 1; q < N; q++) {
+                    if (std::fabs(a[p][q]) < 1e-300)
+                        continue;
+
+                    //rotation zeroing a[p][q]
+                    double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+                    double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+                    double c = 1.0 / std::sqrt(t * t + 1.0);
+                    double s = t * c;
+
+                    for (int k = 0; k < N; k++) {
+                        double akp = a[k][p], akq = a[k][q];
+                        a[k][p] = c * akp - s * akq;
+                        a[k][q] = s * akp + c * akq;
+                    }
+                    for (int k = 0; k < N; k++) {
+                        double apk = a[p][k], aqk = a[q][k];
+                        a[p][k] = c * apk - s * aqk;
+                        a[q][k] = s * apk + c * aqk;
+                    }
+                    for (int k = 0; k < N; k++) {
+                        double vkp = vectors[k][p], vkq = vectors[k][q];
+                        vectors[k][p] = c * vkp - s * vkq;
+                        vectors[k][q] = s * vkp + c * vkq;
+                    }
+                }
+            }
+        }
+
+        for (int i = 0; i < N; i++)
+            values[i] = a[i][i];
+    }
+
+    //FNV-1a over the bytes of a value
+    template <typename T>
+    static void hashCombine(uint64_t& hash, const T& value) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+        for (size_t i = 0; i < sizeof(T); i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+    }
+
+    DuplicateMeshFinder::DuplicateMeshFinder(float tolerance) {
+        this->tolerance = tolerance;
+        this->duplicateCount = 0;
+    }
+
+    DuplicateMeshFinder::Signature DuplicateMeshFinder::ComputeSignature(const Mesh& mesh) const {
+        Signature signature;
+        signature.hash = 14695981039346656037ULL;
+        signature.centroid = glm::vec3(0.0f);
+        signature.size = glm::length(mesh.getBounds().getExtent());
+
+        //topology and materials have to match exactly
+        hashCombine(signature.hash, mesh.vertices.size());
+        hashCombine(signature.hash, mesh.indices.size());
+        for (size_t i = 0; i < mesh.indices.size(); i++)
+            hashCombine(signature.hash, mesh.indices[i]);
+        for (size_t i = 0; i < mesh.textures.size(); i++) {
+            for (size_t c = 0; c < mesh.textures[i].path.size(); c++)
+                hashCombine(signature.hash, mesh.textures[i].path[c]);
+        }
+        hashCombine(signature.hash, mesh.material.ambient);
+        hashCombine(signature.hash, mesh.material.diffuse);
+        hashCombine(signature.hash, mesh.material.specular);
+        if (mesh.vertices.empty())
+            return signature;
+
+        //canonical frame: the centroid and the principal axes, whose spreads do not change under a rigid transform
+        glm::dvec3 centroid(0.0);
+        for (size_t i = 0; i < mesh.vertices.size(); i++)
+            centroid += glm::dvec3(mesh.vertices[i].Position);
+        centroid /= (double)mesh.vertices.size();
+        signature.centroid = glm::vec3(centroid);
+
+        double covariance[3][3] = {};
+        for (size_t i = 0; i < mesh.vertices.size(); i++) {
+            glm::dvec3 d = glm::dvec3(mesh.vertices[i].Position) - centroid;
+            for (int r = 0; r < 3; r++)
+                for (int c = 0; c < 3; c++)
+                    covariance[r][c] += d[r] * d[c];
+        }
+        double spreads[3], axes[3][3];
+        jacobiEigen<3>(covariance, spreads, axes);
+
+        double radius = std::sqrt((spreads[0] + spreads[1] + spreads[2]) / (double)mesh.vertices.size());
+        for (int i = 0; i < 3; i++)
+            spreads[i] = std::sqrt(std::max(spreads[i], 0.0) / (double)mesh.vertices.size());
+        if (spreads[0] < spreads[1]) std::swap(spreads[0], spreads[1]);
+        if (spreads[1] < spreads[2]) std::swap(spreads[1], spreads[2]);
+        if (spreads[0] < spreads[1]) std::swap(spreads[0], spreads[1]);
+
+        //the radius on a 1% logarithmic scale, the spreads relative to it
+        int32_t radiusBucket = radius > 0.0 ? (int32_t)std::floor(std::log(radius) / std::log(1.01)) : INT32_MIN;
+        hashCombine(signature.hash, radiusBucket);
+        for (int i = 0; i < 3; i++) {
+            int32_t spreadBucket = radius > 0.0 ? (int32_t)std::floor(spreads[i] / radius / INVARIANT_QUANTUM) : 0;
+            hashCombine(signature.hash, spreadBucket);
+        }
+
+        return signature;
+    }
+
+    bool DuplicateMeshFinder::SolveTransform(const Mesh& reference, const Signature& referenceSignature,
+                                             const Mesh& mesh, const Signature& signature, glm::mat4& transform) const {
+        if (reference.vertices.size() != mesh.vertices.size() || reference.indices != mesh.indices)
+            return false;
+        if (reference.textures.size() != mesh.textures.size())
+            return false;
+        for (size_t i = 0; i < mesh.textures.size(); i++) {
+            if (reference.textures[i].path != mesh.textures[i].path)
+                return false;
+        }
+        //untextured meshes are coloured from their material
+        if (reference.material.ambient != mesh.material.ambient || reference.material.diffuse != mesh.material.diffuse ||
+            reference.material.specular != mesh.material.specular)
+            return false;
+
+        //exporters keep the vertex order of a copied shape, so vertex i of both meshes is the same point;
+        //the rotation is found with Horn's quaternion method on the centered positions
+        double s[3][3] = {};
+        for (size_t i = 0; i < mesh.vertices.size(); i++) {
+            glm::dvec3 a = glm::dvec3(reference.vertices[i].Position - referenceSignature.centroid);
+            glm::dvec3 b = glm::dvec3(mesh.vertices[i].Position - signature.centroid);
+            for (int r = 0; r < 3; r++)
+                for (int c = 0; c < 3; c++)
+                    s[r][c] += a[r] * b[c];
+        }
+
+        double n[4][4] = {
+            { s[0][0] + s[1][1] + s[2][2], s[1][2] - s[2][1], s[2][0] - s[0][2], s[0][1] - s[1][0] },
+            { s[1][2] - s[2][1], s[0][0] - s[1][1] - s[2][2], s[0][1] + s[1][0], s[2][0] + s[0][2] },
+            { s[2][0] - s[0][2], s[0][1] + s[1][0], -s[0][0] + s[1][1] - s[2][2], s[1][2] + s[2][1] },
+            { s[0][1] - s[1][0], s[2][0] + s[0][2], s[1][2] + s[2][1], -s[0][0] - s[1][1] + s[2][2] }
+        };
+        double values[4], vectors[4][4];
+        jacobiEigen<4>(n, values, vectors);
+
+        int largest = 0;
+        for (int i = 1; i < 4; i++) {
+            if (values[i] > values[largest])
+                largest = i;
+        }
+        double w = vectors[0][largest], x = vectors[1][largest], y = vectors[2][largest], z = vectors[3][largest];
+
+        glm::mat3 rotation;
+        rotation[0] = glm::vec3(1.0 - 2.0 * (y * y + z * z), 2.0 * (x * y + w * z), 2.0 * (x * z - w * y));
+        rotation[1] = glm::vec3(2.0 * (x * y - w * z), 1.0 - 2.0 * (x * x + z * z), 2.0 * (y * z + w * x));
+        rotation[2] = glm::vec3(2.0 * (x * z + w * y), 2.0 * (y * z - w * x), 1.0 - 2.0 * (x * x + y * y));
+        glm::vec3 translation = signature.centroid - rotation * referenceSignature.centroid;
+
+        //every vertex has to land on its copy, otherwise the meshes only share their invariants
+        float positionTolerance = tolerance * glm::max(signature.size, 1e-3f);
+        for (size_t i = 0; i < mesh.vertices.size(); i++) {
+            const Vertex& a = reference.vertices[i];
+            const Vertex& b = mesh.vertices[i];
+            if (glm::length(rotation * a.Position + translation - b.Position) > positionTolerance)
+                return false;
+            if (glm::length(rotation * a.Normal - b.Normal) > NORMAL_TOLERANCE)
+                return false;
+            if (glm::length(a.TexCoords - b.TexCoords) > TEXCOORD_TOLERANCE)
+                return false;
+        }
+
+        transform = glm::mat4(rotation);
+        transform[3] = glm::vec4(translation, 1.0f);
+        return true;
+    }
+
+    std::vector<MeshInstance> DuplicateMeshFinder::Find(const std::vector<Mesh>& meshes) {
+        std::vector<MeshInstance> instances(meshes.size());
+        std::vector<Signature> signatures(meshes.size());
+        //meshes kept so far, by signature hash
+        std::unordered_map<uint64_t, std::vector<int> > references;
+        duplicateCount = 0;
+
+        for (size_t i = 0; i < meshes.size(); i++) {
+            instances[i].mesh = (int)i;
+            instances[i].transform = glm::mat4(1.0f);
+            signatures[i] = ComputeSignature(meshes[i]);
+            if (meshes[i].vertices.empty())
+                continue;
+
+            //only meshes with the same hash are compared
+            std::vector<int>& candidates = references[signatures[i].hash];
+            bool found = false;
+            for (size_t c = 0; c < candidates.size() && !found; c++) {
+                int reference = candidates[c];
+                if (SolveTransform(meshes[reference], signatures[reference], meshes[i], signatures[i], instances[i].transform)) {
+                    instances[i].mesh = reference;
+                    duplicateCount++;
+                    found = true;
+                }
+            }
+            if (!found)
+                candidates.push_back((int)i);
+        }
+
+        return instances;
+    }
+
+    bool DuplicateMeshFinder::FindTransform(const Mesh& reference, const Mesh& mesh, glm::mat4& transform) const {
+        Signature referenceSignature = ComputeSignature(reference);
+        Signature signature = ComputeSignature(mesh);
+        if (referenceSignature.hash != signature.hash)
+            return false;
+        return SolveTransform(reference, referenceSignature, mesh, signature, transform);
+    }
+
+    int DuplicateMeshFinder::getDuplicateCount() const {
+        return duplicateCount;
+    }
+
+}
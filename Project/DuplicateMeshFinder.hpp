@@ -0,0 +1,51 @@
+#ifndef DuplicateMeshFinder_hpp
+#define DuplicateMeshFinder_hpp
+
+#include "Mesh.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    //finds meshes whose geometry is a copy of another mesh moved by a rigid transform (rotation and translation),
+    //as left by exporters that bake the placement of repeated props into the vertices
+    class DuplicateMeshFinder
+    {
+    public:
+        //positions must match within tolerance * the size of the mesh
+        DuplicateMeshFinder(float tolerance = 0.001f);
+
+        //returns one instance per input mesh: the first mesh with the same geometry and the transform placing it
+        //over the input mesh, unique meshes reference themselves with the identity transform
+        std::vector<MeshInstance> Find(const std::vector<Mesh>& meshes);
+
+        //the transform placing reference over mesh, false when mesh is not a copy of it; the meshes can come from
+        //different models, their textures are matched by path
+        bool FindTransform(const Mesh& reference, const Mesh& mesh, glm::mat4& transform) const;
+
+        //meshes found to be copies by the last Find
+        int getDuplicateCount() const;
+
+    private:
+        //transform invariant description of a mesh, equal for every copy
+        struct Signature {
+            uint64_t hash;
+            glm::vec3 centroid;
+            float size;
+        };
+
+        float tolerance;
+        int duplicateCount;
+
+        Signature ComputeSignature(const Mesh& mesh) const;
+        //solves for the rigid transform moving the vertices of reference onto those of mesh and checks every vertex
+        bool SolveTransform(const Mesh& reference, const Signature& referenceSignature,
+                            const Mesh& mesh, const Signature& signature, glm::mat4& transform) const;
+    };
+
+}
+
+#endif /* DuplicateMeshFinder_hpp */
@@ -0,0 +1,256 @@
+#include "EntityRegistry.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace gps {
+
+    //entities per chunk handed to the pool by the systems
+    const size_t SYSTEM_GRAIN_SIZE = 256;
+
+    EntityRegistry::EntityRegistry() {
+        this->lightsChanged = true;
+    }
+
+    int EntityRegistry::CreateModel(const std::string& name) {
+        models.emplace_back();
+        modelNames.push_back(name);
+        modelRenderables.push_back(std::vector<int>());
+        modelAnimatedCounts.push_back(0);
+        return (int)models.size() - 1;
+    }
+
+    Model3D& EntityRegistry::getModel(int model) {
+        return models[model];
+    }
+
+    const Model3D& EntityRegistry::getModel(int model) const {
+        return models[model];
+    }
+
+    const std::string& EntityRegistry::getModelName(int model) const {
+        return modelNames[model];
+    }
+
+    int EntityRegistry::getModelCount() const {
+        return (int)models.size();
+    }
+
+    void EntityRegistry::RemoveLastModel() {
+        models.pop_back();
+        modelNames.pop_back();
+        modelRenderables.pop_back();
+        modelAnimatedCounts.pop_back();
+    }
+
+    const std::vector<int>& EntityRegistry::getModelRenderables(int model) const {
+        return modelRenderables[model];
+    }
+
+    bool EntityRegistry::isModelAnimated(int model) const {
+        return modelAnimatedCounts[model] > 0;
+    }
+
+    void EntityRegistry::SetAnimated(int entity) {
+        animated[entity] = true;
+        if (renderableIndices[entity] >= 0)
+            modelAnimatedCounts[renderableModels[renderableIndices[entity]]]++;
+    }
+
+    int EntityRegistry::CreateEntity(int parent, const glm::mat4& localTransform) {
+        int entity = transforms.AddNode(parent, localTransform);
+        components.push_back(0);
+        renderableIndices.push_back(-1);
+        boundsIndices.push_back(-1);
+        lightIndices.push_back(-1);
+        animatorIndices.push_back(-1);
+        animated.push_back(parent >= 0 && animated[parent]);
+        return entity;
+    }
+
+    int EntityRegistry::getEntityCount() const {
+        return (int)components.size();
+    }
+
+    unsigned int EntityRegistry::getComponents(int entity) const {
+        return components[entity];
+    }
+
+    void EntityRegistry::SetLocalTransform(int entity, const glm::mat4& localTransform) {
+        transforms.SetLocalTransform(entity, localTransform);
+    }
+
+    const glm::mat4& EntityRegistry::getWorldTransform(int entity) const {
+        return transforms.getWorldTransform(entity);
+    }
+
+    const glm::mat3& EntityRegistry::getNormalMatrix(int entity) const {
+        return transforms.getNormalMatrix(entity);
+    }
+
+    bool EntityRegistry::isMoved(int entity) const {
+        return transforms.isUpdated(entity);
+    }
+
+    int EntityRegistry::AddRenderable(int entity, int model) {
+        int renderable = (int)renderableEntities.size();
+        renderableEntities.push_back(entity);
+        renderableModels.push_back(model);
+        renderableInstances.push_back((int)modelRenderables[model].size());
+        renderableFirstObjects.push_back(-1);
+        renderableFirstDraws.push_back(-1);
+        modelRenderables[model].push_back(renderable);
+        if (animated[entity])
+            modelAnimatedCounts[model]++;
+        renderableIndices[entity] = renderable;
+        components[entity] |= COMPONENT_RENDERABLE;
+        return renderable;
+    }
+
+    int EntityRegistry::getRenderableCount() const {
+        return (int)renderableEntities.size();
+    }
+
+    int EntityRegistry::getRenderableEntity(int renderable) const {
+        return renderableEntities[renderable];
+    }
+
+    int EntityRegistry::getRenderableModel(int renderable) const {
+        return renderableModels[renderable];
+    }
+
+    int EntityRegistry::getRenderableInstance(int renderable) const {
+        return renderableInstances[renderable];
+    }
+
+    void EntityRegistry::SetRenderableFirstObject(int renderable, int firstObject) {
+        renderableFirstObjects[renderable] = firstObject;
+    }
+
+    int EntityRegistry::getRenderableFirstObject(int renderable) const {
+        return renderableFirstObjects[renderable];
+    }
+
+    void EntityRegistry::SetRenderableFirstDraw(int renderable, int firstDraw) {
+        renderableFirstDraws[renderable] = firstDraw;
+    }
+
+    int EntityRegistry::getRenderableFirstDraw(int renderable) const {
+        return renderableFirstDraws[renderable];
+    }
+
+    void EntityRegistry::AddBounds(int entity, const BoundingBox& bounds) {
+        boundsIndices[entity] = (int)boundsEntities.size();
+        boundsEntities.push_back(entity);
+        localBounds.push_back(bounds);
+        worldBounds.push_back(bounds.transform(transforms.getWorldTransform(entity)));
+        components[entity] |= COMPONENT_BOUNDS;
+    }
+
+    const BoundingBox& EntityRegistry::getLocalBounds(int entity) const {
+        return localBounds[boundsIndices[entity]];
+    }
+
+    const BoundingBox& EntityRegistry::getWorldBounds(int entity) const {
+        return worldBounds[boundsIndices[entity]];
+    }
+
+    void EntityRegistry::AddLight(int entity, const PointLight& light, bool enabled) {
+        lightIndices[entity] = (int)lightEntities.size();
+        lightEntities.push_back(entity);
+        localLights.push_back(light);
+        lightsEnabled.push_back(enabled);
+        placedLights.push_back(light);
+        components[entity] |= COMPONENT_LIGHT;
+        lightsChanged = true;
+    }
+
+    void EntityRegistry::SetLightEnabled(int entity, bool enabled) {
+        int light = lightIndices[entity];
+        if (lightsEnabled[light] == enabled)
+            return;
+        lightsEnabled[light] = enabled;
+        lightsChanged = true;
+    }
+
+    int EntityRegistry::getEnabledLightCount() const {
+        int count = 0;
+        for (size_t i = 0; i < lightsEnabled.size(); i++) {
+            if (lightsEnabled[i])
+                count++;
+        }
+        return count;
+    }
+
+    void EntityRegistry::AddAnimator(int entity, const glm::vec3& axis, float degreesPerStep) {
+        animatorIndices[entity] = (int)animatorEntities.size();
+        animatorEntities.push_back(entity);
+        animatorBases.push_back(transforms.getLocalTransform(entity));
+        animatorAxes.push_back(axis);
+        animatorSpeeds.push_back(degreesPerStep);
+        animatorAngles.push_back(0.0f);
+        components[entity] |= COMPONENT_ANIMATOR;
+
+        //parents are created before their children, so the descendants of the entity all come after it
+        if (animated[entity])
+            return;
+        SetAnimated(entity);
+        for (int e = entity + 1; e < getEntityCount(); e++) {
+            int parent = transforms.getParent(e);
+            if (!animated[e] && parent >= 0 && animated[parent])
+                SetAnimated(e);
+        }
+    }
+
+    void EntityRegistry::Animate() {
+        for (size_t i = 0; i < animatorAngles.size(); i++)
+            animatorAngles[i] += animatorSpeeds[i];
+    }
+
+    const std::vector<float>& EntityRegistry::getAnimatorAngles() const {
+        return animatorAngles;
+    }
+
+    void EntityRegistry::ApplyAnimators(const std::vector<float>& previous, const std::vector<float>& current, float alpha) {
+        for (size_t i = 0; i < animatorEntities.size(); i++) {
+            float angle = glm::mix(previous[i], current[i], alpha);
+            transforms.SetLocalTransform(animatorEntities[i], glm::rotate(animatorBases[i], glm::radians(angle), animatorAxes[i]));
+        }
+    }
+
+    void EntityRegistry::UpdateTransforms() {
+        transforms.Update();
+        for (size_t i = 0; i < lightEntities.size() && !lightsChanged; i++)
+            lightsChanged = transforms.isUpdated(lightEntities[i]);
+    }
+
+    void EntityRegistry::UpdateBounds(ThreadPool* pool) {
+        pool->ParallelFor(boundsEntities.size(), SYSTEM_GRAIN_SIZE, [this](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                if (transforms.isUpdated(boundsEntities[i]))
+                    worldBounds[i] = localBounds[i].transform(transforms.getWorldTransform(boundsEntities[i]));
+            }
+        });
+    }
+
+    bool EntityRegistry::UpdateLights(ThreadPool* pool) {
+        if (!lightsChanged)
+            return false;
+        pool->ParallelFor(lightEntities.size(), SYSTEM_GRAIN_SIZE, [this](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                placedLights[i].position = glm::vec3(transforms.getWorldTransform(lightEntities[i]) * glm::vec4(localLights[i].position, 1.0f));
+            }
+        });
+        worldLights.clear();
+        for (size_t i = 0; i < placedLights.size(); i++) {
+            if (lightsEnabled[i])
+                worldLights.push_back(placedLights[i]);
+        }
+        lightsChanged = false;
+        return true;
+    }
+
+    const std::vector<PointLight>& EntityRegistry::getWorldLights() const {
+        return worldLights;
+    }
+
+}
@@ -0,0 +1,155 @@
+#ifndef EntityRegistry_hpp
+#define EntityRegistry_hpp
+
+#include <glm/glm.hpp>
+
+#include "BoundingBox.hpp"
+#include "ClusteredLights.hpp"
+#include "Model3D.hpp"
+#include "SceneGraph.hpp"
+#include "ThreadPool.hpp"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    //what an entity has besides its transform, one bit per component
+    enum EntityComponent {
+        COMPONENT_RENDERABLE = 1 << 0,
+        COMPONENT_BOUNDS = 1 << 1,
+        COMPONENT_LIGHT = 1 << 2,
+        COMPONENT_ANIMATOR = 1 << 3
+    };
+
+    //the objects of the scene as entities: ids into structure of arrays storage. every entity has a transform, the node
+    //of the same id in a SceneGraph; every other component is a set of packed arrays with one entry per entity having
+    //it, so a system walks contiguous memory and can split it over the worker pool. the models the renderables draw
+    //are owned here too, each entity drawing a model is one of its instances
+    //Animate and getAnimatorAngles belong to the thread running the simulation, everything else to the thread drawing
+    class EntityRegistry
+    {
+    public:
+        EntityRegistry();
+
+        //an empty model, loaded in place; name labels its passes
+        int CreateModel(const std::string& name);
+        Model3D& getModel(int model);
+        const Model3D& getModel(int model) const;
+        const std::string& getModelName(int model) const;
+        int getModelCount() const;
+        //drops the model created last, before any entity draws it; for a model only loaded to be compared with another
+        void RemoveLastModel();
+        //the renderables drawing a model, in instance order
+        const std::vector<int>& getModelRenderables(int model) const;
+        //true when an entity drawing the model has an animator, on itself or on an ancestor
+        bool isModelAnimated(int model) const;
+
+        //adds an entity placed by localTransform in the space of parent, -1 for a root; a parent is created first
+        int CreateEntity(int parent, const glm::mat4& localTransform);
+        int getEntityCount() const;
+        unsigned int getComponents(int entity) const;
+
+        //transforms, see SceneGraph; the local transform of an entity with an animator is set by ApplyAnimators
+        void SetLocalTransform(int entity, const glm::mat4& localTransform);
+        const glm::mat4& getWorldTransform(int entity) const;
+        const glm::mat3& getNormalMatrix(int entity) const;
+        //true when the last UpdateTransforms moved the entity
+        bool isMoved(int entity) const;
+
+        //the entity draws the next instance of model; returns the renderable
+        int AddRenderable(int entity, int model);
+        int getRenderableCount() const;
+        int getRenderableEntity(int renderable) const;
+        int getRenderableModel(int renderable) const;
+        int getRenderableInstance(int renderable) const;
+        //first bvh object and first gpu driven draw of the placed meshes of the renderable, set by whoever adds them
+        void SetRenderableFirstObject(int renderable, int firstObject);
+        int getRenderableFirstObject(int renderable) const;
+        void SetRenderableFirstDraw(int renderable, int firstDraw);
+        int getRenderableFirstDraw(int renderable) const;
+
+        //box around the entity in its own space, the world bounds follow its transform
+        void AddBounds(int entity, const BoundingBox& localBounds);
+        const BoundingBox& getLocalBounds(int entity) const;
+        const BoundingBox& getWorldBounds(int entity) const;
+
+        //a point light at light.position in the space of the entity
+        void AddLight(int entity, const PointLight& light, bool enabled);
+        void SetLightEnabled(int entity, bool enabled);
+        int getEnabledLightCount() const;
+
+        //turns the entity by degreesPerStep around axis every Animate, after its local transform
+        void AddAnimator(int entity, const glm::vec3& axis, float degreesPerStep);
+        //one simulation step of every animator
+        void Animate();
+        //the angle of every animator, in the order they were added
+        const std::vector<float>& getAnimatorAngles() const;
+        //sets the local transforms of the animated entities alpha of the way from the previous angles to the current
+        void ApplyAnimators(const std::vector<float>& previous, const std::vector<float>& current, float alpha);
+
+        //the systems, once per frame in this order: the world and normal matrices of the moved entities, their world
+        //bounds, then the lights
+        void UpdateTransforms();
+        void UpdateBounds(ThreadPool* pool);
+        //rebuilds the world space lights when one of them moved or was switched since the last rebuild, returns true
+        //when it did
+        bool UpdateLights(ThreadPool* pool);
+        //the enabled lights in world space, as of the last UpdateLights
+        const std::vector<PointLight>& getWorldLights() const;
+
+    private:
+        std::deque<Model3D> models;
+        std::vector<std::string> modelNames;
+        std::vector<std::vector<int> > modelRenderables;
+        //renderables of each model whose entity is animated
+        std::vector<int> modelAnimatedCounts;
+
+        //per entity
+        SceneGraph transforms;
+        std::vector<unsigned int> components;
+        //index of the entity in each packed array, -1 without the component
+        std::vector<int> renderableIndices;
+        std::vector<int> boundsIndices;
+        std::vector<int> lightIndices;
+        std::vector<int> animatorIndices;
+        //true when the entity or one of its ancestors has an animator
+        std::vector<bool> animated;
+
+        //renderables
+        std::vector<int> renderableEntities;
+        std::vector<int> renderableModels;
+        std::vector<int> renderableInstances;
+        std::vector<int> renderableFirstObjects;
+        std::vector<int> renderableFirstDraws;
+
+        //bounds
+        std::vector<int> boundsEntities;
+        std::vector<BoundingBox> localBounds;
+        std::vector<BoundingBox> worldBounds;
+
+        //lights
+        std::vector<int> lightEntities;
+        std::vector<PointLight> localLights;
+        std::vector<bool> lightsEnabled;
+        //world space copy of every light, enabled or not, and the enabled ones
+        std::vector<PointLight> placedLights;
+        std::vector<PointLight> worldLights;
+        bool lightsChanged;
+
+        //animators
+        std::vector<int> animatorEntities;
+        //local transform of the entity before it is turned
+        std::vector<glm::mat4> animatorBases;
+        std::vector<glm::vec3> animatorAxes;
+        std::vector<float> animatorSpeeds;
+        std::vector<float> animatorAngles;
+
+        //marks the entity animated, counting its renderable with its model
+        void SetAnimated(int entity);
+    };
+
+}
+
+#endif /* EntityRegistry_hpp */
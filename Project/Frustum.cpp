@@ -0,0 +1,65 @@
+#include "Frustum.hpp"
+
+namespace gps {
+
+    Frustum::Frustum() {
+        for (int i = 0; i < 6; i++)
+            planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+
+    Frustum::Frustum(const glm::mat4& viewProjection) {
+        //Gribb-Hartmann plane extraction, glm matrices are column major
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+        planes[0] = rows[3] + rows[0];
+        planes[1] = rows[3] - rows[0];
+        planes[2] = rows[3] + rows[1];
+        planes[3] = rows[3] - rows[1];
+        planes[4] = rows[3] + rows[2];
+        planes[5] = rows[3] - rows[2];
+
+        for (int i = 0; i < 6; i++)
+            planes[i] = planes[i] / glm::length(glm::vec3(planes[i]));
+    }
+
+    FRUSTUM_TEST Frustum::classify(const BoundingBox& box) const {
+        FRUSTUM_TEST result = FRUSTUM_INSIDE;
+
+        for (int i = 0; i < 6; i++) {
+            glm::vec3 normal = glm::vec3(planes[i]);
+
+            //the box corner furthest along the plane normal, and the one furthest against it
+            glm::vec3 positive(normal.x >= 0.0f ? box.max.x : box.min.x,
+                               normal.y >= 0.0f ? box.max.y : box.min.y,
+                               normal.z >= 0.0f ? box.max.z : box.min.z);
+            glm::vec3 negative(normal.x >= 0.0f ? box.min.x : box.max.x,
+                               normal.y >= 0.0f ? box.min.y : box.max.y,
+                               normal.z >= 0.0f ? box.min.z : box.max.z);
+
+            if (glm::dot(normal, positive) + planes[i].w < 0.0f)
+                return FRUSTUM_OUTSIDE;
+            if (glm::dot(normal, negative) + planes[i].w < 0.0f)
+                result = FRUSTUM_INTERSECT;
+        }
+
+        return result;
+    }
+
+    bool Frustum::intersects(const BoundingBox& box) const {
+        return classify(box) != FRUSTUM_OUTSIDE;
+    }
+
+    bool Frustum::contains(glm::vec3 point) const {
+        for (int i = 0; i < 6; i++) {
+            if (glm::dot(glm::vec3(planes[i]), point) + planes[i].w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    const glm::vec4& Frustum::getPlane(int index) const {
+        return planes[index];
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef Frustum_hpp
+#define Frustum_hpp
+
+#include "BoundingBox.hpp"
+
+#include <glm/glm.hpp>
+
+namespace gps {
+
+    enum FRUSTUM_TEST {FRUSTUM_OUTSIDE, FRUSTUM_INTERSECT, FRUSTUM_INSIDE};
+
+    //view frustum described by its 6 planes, in the space of the matrix it was built from
+    class Frustum
+    {
+    public:
+        Frustum();
+        //extracts the planes from a (projection * view) or (projection * view * model) matrix
+        Frustum(const glm::mat4& viewProjection);
+
+        //classifies the box as outside, intersecting or fully inside the frustum
+        FRUSTUM_TEST classify(const BoundingBox& box) const;
+        bool intersects(const BoundingBox& box) const;
+        bool contains(glm::vec3 point) const;
+
+        const glm::vec4& getPlane(int index) const;
+
+    private:
+        //left, right, bottom, top, near, far - xyz is the normal pointing inside
+        glm::vec4 planes[6];
+    };
+
+}
+
+#endif /* Frustum_hpp */
@@ -0,0 +1,133 @@
+#include "GLCommandBackend.hpp"
+#include "RenderStats.hpp"
+
+#include <cstring>
+
+namespace gps {
+
+    //what the commands replayed so far left bound, ~0 until a command binds it
+    struct ReplayState {
+        GLuint program;
+        GLuint vertexArray;
+        GLuint textures[CommandBuffer::MAX_TEXTURE_UNITS];
+        //target the texture of each unit was bound to, a unit keeps one texture per target
+        GLuint textureTargets[CommandBuffer::MAX_TEXTURE_UNITS];
+        GLuint activeUnit;
+    };
+
+    template <typename T>
+    static T readCommand(const unsigned char* data) {
+        T command;
+        std::memcpy(&command, data + sizeof(CommandBuffer::CommandHeader), sizeof(command));
+        return command;
+    }
+
+    static void setUniforms(const unsigned char* data, const unsigned char* end) {
+        while (data < end) {
+            CommandBuffer::UniformValue uniform;
+            std::memcpy(&uniform, data, sizeof(uniform));
+            data += sizeof(uniform);
+            if (uniform.type == CommandBuffer::UNIFORM_INT) {
+                GLint value;
+                std::memcpy(&value, data, sizeof(value));
+                glUniform1i(uniform.location, value);
+                data += sizeof(value);
+            } else if (uniform.type == CommandBuffer::UNIFORM_IVEC3) {
+                GLint value[3];
+                std::memcpy(value, data, sizeof(value));
+                glUniform3iv(uniform.location, 1, value);
+                data += sizeof(value);
+            } else {
+                GLfloat value[3];
+                std::memcpy(value, data, sizeof(value));
+                glUniform3fv(uniform.location, 1, value);
+                data += sizeof(value);
+            }
+        }
+    }
+
+    void GLCommandBackend::Replay(const CommandBuffer* lists, size_t count) {
+        ReplayState state;
+        state.program = ~0u;
+        state.vertexArray = ~0u;
+        for (uint32_t i = 0; i < CommandBuffer::MAX_TEXTURE_UNITS; i++) {
+            state.textures[i] = ~0u;
+            state.textureTargets[i] = ~0u;
+        }
+        state.activeUnit = ~0u;
+
+        for (size_t l = 0; l < count; l++) {
+            const unsigned char* data = lists[l].getData();
+            const unsigned char* end = data + lists[l].getSize();
+            while (data < end) {
+                CommandBuffer::CommandHeader header;
+                std::memcpy(&header, data, sizeof(header));
+
+                switch (header.type) {
+                    case CommandBuffer::BIND_PROGRAM: {
+                        CommandBuffer::BindProgramCommand command = readCommand<CommandBuffer::BindProgramCommand>(data);
+                        if (command.program != state.program) {
+                            glUseProgram(command.program);
+                            state.program = command.program;
+                        }
+                        break;
+                    }
+                    case CommandBuffer::BIND_VERTEX_ARRAY: {
+                        CommandBuffer::BindVertexArrayCommand command = readCommand<CommandBuffer::BindVertexArrayCommand>(data);
+                        if (command.vertexArray != state.vertexArray) {
+                            glBindVertexArray(command.vertexArray);
+                            state.vertexArray = command.vertexArray;
+                        }
+                        break;
+                    }
+                    case CommandBuffer::BIND_TEXTURE: {
+                        CommandBuffer::BindTextureCommand command = readCommand<CommandBuffer::BindTextureCommand>(data);
+                        if (command.texture != state.textures[command.unit] ||
+                            command.target != state.textureTargets[command.unit]) {
+                            if (command.unit != state.activeUnit) {
+                                glActiveTexture(GL_TEXTURE0 + command.unit);
+                                state.activeUnit = command.unit;
+                            }
+                            glBindTexture(command.target == CommandBuffer::TEXTURE_2D_ARRAY ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D,
+                                          command.texture);
+                            state.textures[command.unit] = command.texture;
+                            state.textureTargets[command.unit] = command.target;
+                        }
+                        break;
+                    }
+                    case CommandBuffer::SET_UNIFORMS:
+                        setUniforms(data + sizeof(header), data + header.size);
+                        break;
+                    case CommandBuffer::UPDATE_BUFFER: {
+                        CommandBuffer::UpdateBufferCommand command = readCommand<CommandBuffer::UpdateBufferCommand>(data);
+                        glBindBuffer(GL_ARRAY_BUFFER, command.buffer);
+                        glBufferSubData(GL_ARRAY_BUFFER, command.offset, command.size,
+                                        data + sizeof(header) + sizeof(command));
+                        glBindBuffer(GL_ARRAY_BUFFER, 0);
+                        break;
+                    }
+                    case CommandBuffer::COPY_BUFFER: {
+                        CommandBuffer::CopyBufferCommand command = readCommand<CommandBuffer::CopyBufferCommand>(data);
+                        glBindBuffer(GL_COPY_READ_BUFFER, command.source);
+                        glBindBuffer(GL_COPY_WRITE_BUFFER, command.buffer);
+                        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, command.sourceOffset, command.offset,
+                                            command.size);
+                        break;
+                    }
+                    case CommandBuffer::DRAW_INDEXED: {
+                        CommandBuffer::DrawIndexedCommand command = readCommand<CommandBuffer::DrawIndexedCommand>(data);
+                        glDrawElementsInstanced(GL_TRIANGLES, command.indexCount, GL_UNSIGNED_INT, 0, command.instanceCount);
+                        break;
+                    }
+                }
+                data += header.size;
+            }
+        }
+
+        if (state.vertexArray != 0 && state.vertexArray != ~0u)
+            glBindVertexArray(0);
+        if (state.activeUnit != 0 && state.activeUnit != ~0u)
+            glActiveTexture(GL_TEXTURE0);
+    }
+
+}
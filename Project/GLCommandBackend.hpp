@@ -0,0 +1,23 @@
+#ifndef GLCommandBackend_hpp
+#define GLCommandBackend_hpp
+
+#include <GL/glew.h>
+
+#include "CommandBuffer.hpp"
+
+#include <cstddef>
+
+namespace gps {
+
+    //replays command buffers with OpenGL, on the thread owning the context
+    class GLCommandBackend
+    {
+    public:
+        //runs count lists one after the other; binds of the program, vertex array or texture already bound by an
+        //earlier command of the call are skipped. leaves no vertex array bound and texture unit 0 active
+        static void Replay(const CommandBuffer* lists, size_t count);
+    };
+
+}
+
+#endif /* GLCommandBackend_hpp */
@@ -0,0 +1,77 @@
+#include "GLDebug.hpp"
+
+#include <iostream>
+
+namespace gps {
+
+    static const char* getSourceName(GLenum source) {
+        switch (source) {
+            case GL_DEBUG_SOURCE_API: return "api";
+            case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "window system";
+            case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+            case GL_DEBUG_SOURCE_THIRD_PARTY: return "third party";
+            case GL_DEBUG_SOURCE_APPLICATION: return "application";
+            default: return "other";
+        }
+    }
+
+    static const char* getTypeName(GLenum type) {
+        switch (type) {
+            case GL_DEBUG_TYPE_ERROR: return "error";
+            case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated behavior";
+            case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+            case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+            case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+            default: return "other";
+        }
+    }
+
+    //drivers may call it from their own thread, the message is written with a single call
+    static void GLAPIENTRY onDebugMessage(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
+                                          const GLchar* message, const void*) {
+        std::string text = std::string("GL ") + (severity == GL_DEBUG_SEVERITY_HIGH ? "high" :
+                                                 severity == GL_DEBUG_SEVERITY_MEDIUM ? "medium" : "low")
+            + " " + getTypeName(type) + " (" + getSourceName(source) + ", " + std::to_string(id) + "): "
+            + std::string(message, length >= 0 ? (size_t)length : std::char_traits<char>::length(message)) + "\n";
+        std::cerr << text;
+    }
+
+    bool GLDebug::isSupported() {
+        return GLEW_VERSION_4_3 || GLEW_KHR_debug;
+    }
+
+    bool GLDebug::EnableDebugOutput() {
+        if (!isSupported())
+            return false;
+        GLint flags = 0;
+        glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+        if ((flags & GL_CONTEXT_FLAG_DEBUG_BIT) == 0)
+            return false;
+
+        //not GL_DEBUG_OUTPUT_SYNCHRONOUS, the driver reports when it suits it and the frame is not slowed down
+        glEnable(GL_DEBUG_OUTPUT);
+        glDebugMessageCallback(onDebugMessage, NULL);
+        //notifications are every buffer placement and shader recompile the driver makes
+        glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, NULL, GL_FALSE);
+        return true;
+    }
+
+    void GLDebug::PushGroup(const char* name) {
+        if (isSupported())
+            glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+    }
+
+    void GLDebug::PopGroup() {
+        if (isSupported())
+            glPopDebugGroup();
+    }
+
+    void GLDebug::LabelObject(GLenum identifier, GLuint name, const std::string& label) {
+        if (!isSupported() || name == 0)
+            return;
+        //labels are at most 255 characters on some drivers, the end of a long path is the part that tells files apart
+        std::string text = label.size() > 255 ? label.substr(label.size() - 255) : label;
+        glObjectLabel(identifier, name, (GLsizei)text.size(), text.c_str());
+    }
+
+}
@@ -0,0 +1,32 @@
+#ifndef GLDebug_hpp
+#define GLDebug_hpp
+
+#include <GL/glew.h>
+
+#include <string>
+
+namespace gps {
+
+    //KHR_debug (core since OpenGL 4.3): driver messages, debug groups and object labels, shown by tools such as
+    //RenderDoc. every call does nothing on a context without it, macOS stops at 4.1
+    class GLDebug
+    {
+    public:
+        static bool isSupported();
+
+        //registers a callback printing the errors and warnings of the driver as it reports them, instead of polling
+        //glGetError; returns false if the context has no debug output. the context should be a debug context, other
+        //contexts may report nothing
+        static bool EnableDebugOutput();
+
+        //the groups nest, every push needs a pop
+        static void PushGroup(const char* name);
+        static void PopGroup();
+
+        //identifier is GL_BUFFER, GL_VERTEX_ARRAY, GL_TEXTURE, GL_PROGRAM, GL_FRAMEBUFFER...
+        static void LabelObject(GLenum identifier, GLuint name, const std::string& label);
+    };
+
+}
+
+#endif /* GLDebug_hpp */
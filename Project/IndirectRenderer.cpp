@@ -0,0 +1,362 @@
+#include "IndirectRenderer.hpp"
+#include "Frustum.hpp"
+#include "RenderStats.hpp"
+
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+namespace gps {
+
+    const int CULL_GROUP_SIZE = 64;
+    const int PYRAMID_GROUP_SIZE = 8;
+
+    IndirectRenderer::IndirectRenderer() {
+        this->dirtyBegin = 0;
+        this->dirtyEnd = 0;
+        this->uploads = NULL;
+        this->VAO = 0;
+        this->VBO = 0;
+        this->EBO = 0;
+        this->drawIndexBuffer = 0;
+        this->commandBuffer = 0;
+        this->drawInfoBuffer = 0;
+        this->depthFBO = 0;
+        this->depthTexture = 0;
+        this->depthPyramidTexture = 0;
+        this->depthWidth = 0;
+        this->depthHeight = 0;
+        this->pyramidLevels = 0;
+        this->pyramidValid = false;
+    }
+
+    int IndirectRenderer::AddModel(const gps::Model3D& model3D, const glm::mat4& transform) {
+        const std::vector<gps::Mesh>& meshes = model3D.getMeshes();
+        const std::vector<gps::MeshInstance>& placedMeshes = model3D.getMeshInstances();
+        int firstDraw = (int)addedCommands.size();
+
+        //the geometry of a mesh is copied once, every placement of it draws the same range
+        std::vector<DrawElementsIndirectCommand> meshCommands(meshes.size());
+        for (size_t i = 0; i < meshes.size(); i++) {
+            meshCommands[i].count = (GLuint)meshes[i].indices.size();
+            meshCommands[i].instanceCount = 1;
+            meshCommands[i].firstIndex = (GLuint)indices.size();
+            meshCommands[i].baseVertex = (GLint)vertices.size();
+            meshCommands[i].baseInstance = 0;
+
+            vertices.insert(vertices.end(), meshes[i].vertices.begin(), meshes[i].vertices.end());
+            indices.insert(indices.end(), meshes[i].indices.begin(), meshes[i].indices.end());
+        }
+
+        for (size_t i = 0; i < placedMeshes.size(); i++) {
+            const gps::Mesh& mesh = meshes[placedMeshes[i].mesh];
+            addedCommands.push_back(meshCommands[placedMeshes[i].mesh]);
+
+            glm::mat4 model = transform * placedMeshes[i].transform;
+            DrawInfo drawInfo;
+            drawInfo.model = model;
+            drawInfo.normalModel = glm::mat4(glm::inverseTranspose(glm::mat3(model)));
+            drawInfo.boundsMin = glm::vec4(mesh.getBounds().min, 1.0f);
+            drawInfo.boundsMax = glm::vec4(mesh.getBounds().max, 1.0f);
+            drawInfo.textureLayers = glm::ivec4(mesh.getTextureLayers(), 0);
+            addedDrawInfos.push_back(drawInfo);
+            addedTextures.push_back(mesh.textures);
+            placements.push_back(placedMeshes[i].transform);
+        }
+
+        return firstDraw;
+    }
+
+    //orders draws by the ids of their textures
+    static bool lessTextures(const std::vector<gps::Texture>& a, const std::vector<gps::Texture>& b) {
+        for (size_t i = 0; i < a.size() && i < b.size(); i++) {
+            if (a[i].id != b[i].id)
+                return a[i].id < b[i].id;
+        }
+        return a.size() < b.size();
+    }
+
+    void IndirectRenderer::Build() {
+        //draws with the same textures become consecutive, every batch is a single multi draw call
+        std::vector<int> order(addedCommands.size());
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = (int)i;
+        std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+            return lessTextures(addedTextures[a], addedTextures[b]);
+        });
+
+        commands.resize(order.size());
+        drawInfos.resize(order.size());
+        drawSlots.resize(order.size());
+        batches.clear();
+        for (size_t slot = 0; slot < order.size(); slot++) {
+            int draw = order[slot];
+            commands[slot] = addedCommands[draw];
+            //baseInstance feeds the draw index attribute when gl_DrawIDARB is not supported
+            commands[slot].baseInstance = (GLuint)slot;
+            drawInfos[slot] = addedDrawInfos[draw];
+            drawSlots[draw] = (int)slot;
+
+            if (batches.empty() || lessTextures(batches.back().textures, addedTextures[draw])) {
+                Batch batch;
+                batch.textures = addedTextures[draw];
+                batch.firstDraw = (int)slot;
+                batch.drawCount = 0;
+                batches.push_back(batch);
+            }
+            batches.back().drawCount++;
+        }
+
+        std::vector<GLuint> drawIndices(order.size());
+        for (size_t i = 0; i < drawIndices.size(); i++)
+            drawIndices[i] = (GLuint)i;
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glGenBuffers(1, &drawIndexBuffer);
+        glGenBuffers(1, &commandBuffer);
+        glGenBuffers(1, &drawInfoBuffer);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(gps::Vertex), vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+        //same attributes as Mesh
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(gps::Vertex), (GLvoid*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(gps::Vertex), (GLvoid*)offsetof(gps::Vertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(gps::Vertex), (GLvoid*)offsetof(gps::Vertex, TexCoords));
+
+        //one value per instance, starting at the baseInstance of each command
+        glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, drawIndices.size() * sizeof(GLuint), drawIndices.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(3);
+        glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), (GLvoid*)0);
+        glVertexAttribDivisor(3, 1);
+        glBindVertexArray(0);
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawInfoBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, drawInfos.size() * sizeof(DrawInfo), drawInfos.data(), GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        //the geometry now lives on the gpu
+        std::vector<gps::Vertex>().swap(vertices);
+        std::vector<GLuint>().swap(indices);
+        std::vector<DrawElementsIndirectCommand>().swap(addedCommands);
+        std::vector<DrawInfo>().swap(addedDrawInfos);
+        std::vector<std::vector<gps::Texture> >().swap(addedTextures);
+        dirtyBegin = 0;
+        dirtyEnd = 0;
+    }
+
+    void IndirectRenderer::SetTransform(int firstDraw, int drawCount, const glm::mat4& transform) {
+        SetTransform(firstDraw, drawCount, transform, glm::inverseTranspose(glm::mat3(transform)));
+    }
+
+    void IndirectRenderer::SetTransform(int firstDraw, int drawCount, const glm::mat4& transform, const glm::mat3& normalMatrix) {
+        for (int i = firstDraw; i < firstDraw + drawCount; i++) {
+            int slot = drawSlots[i];
+            drawInfos[slot].model = transform * placements[i];
+            drawInfos[slot].normalModel = glm::mat4(normalMatrix * glm::mat3(placements[i]));
+
+            if (dirtyBegin == dirtyEnd) {
+                dirtyBegin = slot;
+                dirtyEnd = slot + 1;
+            } else {
+                dirtyBegin = std::min(dirtyBegin, slot);
+                dirtyEnd = std::max(dirtyEnd, slot + 1);
+            }
+        }
+    }
+
+    void IndirectRenderer::SetUploadBuffer(RingBuffer* uploads) {
+        this->uploads = uploads;
+    }
+
+    void IndirectRenderer::Cull(gps::Shader cullShader, const glm::mat4& view, const glm::mat4& projection) {
+        //only the draws moved since the last frame are uploaded
+        if (dirtyBegin != dirtyEnd) {
+            size_t size = (dirtyEnd - dirtyBegin) * sizeof(DrawInfo);
+            size_t sourceOffset = 0;
+            void* memory = NULL;
+            if (uploads != NULL && uploads->isPersistent())
+                memory = uploads->Allocate(size, sizeof(glm::vec4), sourceOffset);
+            if (memory != NULL) {
+                std::memcpy(memory, &drawInfos[dirtyBegin], size);
+                glBindBuffer(GL_COPY_READ_BUFFER, uploads->getBuffer());
+                glBindBuffer(GL_COPY_WRITE_BUFFER, drawInfoBuffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sourceOffset, dirtyBegin * sizeof(DrawInfo), size);
+                glBindBuffer(GL_COPY_READ_BUFFER, 0);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            } else {
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawInfoBuffer);
+                glBufferSubData(GL_SHADER_STORAGE_BUFFER, dirtyBegin * sizeof(DrawInfo), size, &drawInfos[dirtyBegin]);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            }
+            dirtyBegin = 0;
+            dirtyEnd = 0;
+        }
+
+        cullShader.useShaderProgram();
+
+        gps::Frustum frustum(projection * view);
+        glm::vec4 planes[6];
+        for (int i = 0; i < 6; i++)
+            planes[i] = frustum.getPlane(i);
+        glUniform4fv(glGetUniformLocation(cullShader.shaderProgram, "frustumPlanes"), 6, glm::value_ptr(planes[0]));
+        glUniform1ui(glGetUniformLocation(cullShader.shaderProgram, "drawCount"), (GLuint)commands.size());
+        glUniform1i(glGetUniformLocation(cullShader.shaderProgram, "useDepthPyramid"), pyramidValid);
+        glUniformMatrix4fv(glGetUniformLocation(cullShader.shaderProgram, "pyramidViewProjection"), 1, GL_FALSE, glm::value_ptr(pyramidViewProjection));
+        glUniform1i(glGetUniformLocation(cullShader.shaderProgram, "depthPyramid"), 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, depthPyramidTexture);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, drawInfoBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commandBuffer);
+        glDispatchCompute(((GLuint)commands.size() + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+        //the draw commands are read by the next indirect draw
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    void IndirectRenderer::Draw(gps::Shader shader) {
+        shader.useShaderProgram();
+        GLint firstDrawLoc = glGetUniformLocation(shader.shaderProgram, "firstDraw");
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, drawInfoBuffer);
+
+        size_t textureUnits = 0;
+        //the models drawn are either all packed into texture arrays or none is, as the samplers of the shader
+        GLenum textureTarget = GL_TEXTURE_2D;
+        for (size_t b = 0; b < batches.size(); b++) {
+            const Batch& batch = batches[b];
+            textureUnits = std::max(textureUnits, batch.textures.size());
+
+            //set textures
+            for (GLuint i = 0; i < batch.textures.size(); i++) {
+                glActiveTexture(GL_TEXTURE0 + i);
+                glUniform1i(glGetUniformLocation(shader.shaderProgram, batch.textures[i].type.c_str()), i);
+                textureTarget = batch.textures[i].layer >= 0 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+                glBindTexture(textureTarget, batch.textures[i].id);
+            }
+
+            glUniform1ui(firstDrawLoc, (GLuint)batch.firstDraw);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                (const void*)(batch.firstDraw * sizeof(DrawElementsIndirectCommand)), batch.drawCount, 0);
+        }
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindVertexArray(0);
+        for (GLuint i = 0; i < textureUnits; i++) {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(textureTarget, 0);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void IndirectRenderer::CreateDepthTargets(int width, int height) {
+        if (depthFBO != 0) {
+            glDeleteFramebuffers(1, &depthFBO);
+            glDeleteTextures(1, &depthTexture);
+            glDeleteTextures(1, &depthPyramidTexture);
+        }
+        depthWidth = width;
+        depthHeight = height;
+
+        //same format as the 24 bit depth, 8 bit stencil default framebuffer, blits need matching depth formats
+        glGenTextures(1, &depthTexture);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glGenFramebuffers(1, &depthFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        //the first level is half the screen, every level keeps the farthest depth of the texels below it
+        int pyramidWidth = std::max(width / 2, 1);
+        int pyramidHeight = std::max(height / 2, 1);
+        pyramidLevels = 1;
+        while ((std::max(pyramidWidth, pyramidHeight) >> pyramidLevels) > 0)
+            pyramidLevels++;
+
+        glGenTextures(1, &depthPyramidTexture);
+        glBindTexture(GL_TEXTURE_2D, depthPyramidTexture);
+        glTexStorage2D(GL_TEXTURE_2D, pyramidLevels, GL_R32F, pyramidWidth, pyramidHeight);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        pyramidValid = false;
+    }
+
+    void IndirectRenderer::BuildDepthPyramid(gps::Shader depthPyramidShader, int width, int height, const glm::mat4& viewProjection,
+                                             GLuint sceneFramebuffer) {
+        if (width <= 0 || height <= 0)
+            return;
+        if (width != depthWidth || height != depthHeight)
+            CreateDepthTargets(width, height);
+
+        //resolves the multisampled depth of the window (or of the scene framebuffer) into a texture
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFramebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFBO);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+
+        depthPyramidShader.useShaderProgram();
+        glUniform1i(glGetUniformLocation(depthPyramidShader.shaderProgram, "source"), 0);
+        GLint sourceLevelLoc = glGetUniformLocation(depthPyramidShader.shaderProgram, "sourceLevel");
+        glActiveTexture(GL_TEXTURE0);
+
+        for (int level = 0; level < pyramidLevels; level++) {
+            if (level == 0) {
+                glBindTexture(GL_TEXTURE_2D, depthTexture);
+                glUniform1i(sourceLevelLoc, 0);
+            } else {
+                glBindTexture(GL_TEXTURE_2D, depthPyramidTexture);
+                glUniform1i(sourceLevelLoc, level - 1);
+            }
+            glBindImageTexture(0, depthPyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+            int levelWidth = std::max((depthWidth / 2) >> level, 1);
+            int levelHeight = std::max((depthHeight / 2) >> level, 1);
+            glDispatchCompute((levelWidth + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, (levelHeight + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, 1);
+
+            //the next level and the next Cull read what was written
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        pyramidViewProjection = viewProjection;
+        pyramidValid = true;
+    }
+
+    int IndirectRenderer::getDrawCount() const {
+        return (int)commands.size();
+    }
+
+    int IndirectRenderer::getBatchCount() const {
+        return (int)batches.size();
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef IndirectRenderer_hpp
+#define IndirectRenderer_hpp
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Model3D.hpp"
+#include "RingBuffer.hpp"
+#include "Shader.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    //layout expected by glMultiDrawElementsIndirect
+    struct DrawElementsIndirectCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    //per draw data read by cull.comp and indirect.vert, matches the std430 DrawInfo struct
+    struct DrawInfo {
+        glm::mat4 model;
+        //inverse transpose of the model matrix, only the upper 3x3 part is used
+        glm::mat4 normalModel;
+        glm::vec4 boundsMin;
+        glm::vec4 boundsMax;
+        //layers of the ambient, diffuse and specular textures when their model was packed into texture arrays
+        glm::ivec4 textureLayers;
+    };
+
+    //gpu driven rendering (OpenGL 4.3): all meshes share one vertex and index buffer, a compute pass culls them
+    //against the frustum and the previous frame's depth pyramid, then the survivors are drawn with multi draw indirect
+    class IndirectRenderer
+    {
+    public:
+        IndirectRenderer();
+
+        //copies the meshes of the model into the shared buffers, returns the id of its first draw (one draw per placed mesh)
+        int AddModel(const gps::Model3D& model3D, const glm::mat4& transform);
+        //uploads the geometry and creates the draw buffers, call once after every model was added
+        void Build();
+        //moves drawCount draws of one model, transform is applied over the placement of each mesh
+        void SetTransform(int firstDraw, int drawCount, const glm::mat4& transform);
+        //same, with the normal matrix of transform already known; the placements are rigid and keep it
+        void SetTransform(int firstDraw, int drawCount, const glm::mat4& transform, const glm::mat3& normalMatrix);
+        //the moved draws are written into the ring when it is mapped and copied by the gpu, NULL uploads them
+        void SetUploadBuffer(RingBuffer* uploads);
+
+        //sets the instance count of every draw command to 1 or 0
+        void Cull(gps::Shader cullShader, const glm::mat4& view, const glm::mat4& projection);
+        //one glMultiDrawElementsIndirect per texture batch, independent of the number of meshes. meshes with different
+        //textures share a batch once their models are packed into texture arrays, the shader then needs
+        //SHADER_TEXTURE_ARRAYS
+        void Draw(gps::Shader shader);
+        //copies the depth of the default framebuffer and reduces it to the max depth pyramid used by the next Cull
+        void BuildDepthPyramid(gps::Shader depthPyramidShader, int width, int height, const glm::mat4& viewProjection,
+                               GLuint sceneFramebuffer = 0);
+
+        int getDrawCount() const;
+        int getBatchCount() const;
+
+    private:
+        //consecutive draws using the same textures, or the same texture arrays
+        struct Batch {
+            std::vector<gps::Texture> textures;
+            int firstDraw;
+            int drawCount;
+        };
+
+        //geometry and draws in the order they were added, only kept until Build
+        std::vector<gps::Vertex> vertices;
+        std::vector<GLuint> indices;
+        std::vector<DrawElementsIndirectCommand> addedCommands;
+        std::vector<DrawInfo> addedDrawInfos;
+        std::vector<std::vector<gps::Texture> > addedTextures;
+
+        //draws sorted by batch, drawSlots maps the ids returned by AddModel to their position
+        std::vector<DrawElementsIndirectCommand> commands;
+        std::vector<DrawInfo> drawInfos;
+        std::vector<int> drawSlots;
+        std::vector<Batch> batches;
+        //placement of the mesh of each draw inside its model, by draw id
+        std::vector<glm::mat4> placements;
+        int dirtyBegin;
+        int dirtyEnd;
+        RingBuffer* uploads;
+
+        GLuint VAO;
+        GLuint VBO;
+        GLuint EBO;
+        GLuint drawIndexBuffer;
+        GLuint commandBuffer;
+        GLuint drawInfoBuffer;
+
+        GLuint depthFBO;
+        GLuint depthTexture;
+        GLuint depthPyramidTexture;
+        int depthWidth;
+        int depthHeight;
+        int pyramidLevels;
+        bool pyramidValid;
+        glm::mat4 pyramidViewProjection;
+
+        void CreateDepthTargets(int width, int height);
+    };
+
+}
+
+#endif /* IndirectRenderer_hpp */
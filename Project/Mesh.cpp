@@ -1,6 +1,14 @@
 #include "Mesh.hpp"
+#include "GLDebug.hpp"
+#include "RenderStats.hpp"
+
+#include <cmath>
+
 namespace gps {
 
+	// Ambient, diffuse and specular, each bound to the unit of its index in textures
+	const GLuint MAX_MESH_TEXTURES = 3;
+
 	/* Mesh Constructor */
 	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures)
 	{
@@ -8,37 +16,208 @@ namespace gps {
 		this->indices = indices;
 		this->textures = textures;
 
+		for (size_t i = 0; i < this->vertices.size(); i++)
+			this->bounds.expand(this->vertices[i].Position);
+
+		// Ratio of the areas the triangles cover in texture space and in object space
+		float texCoordArea = 0.0f;
+		float area = 0.0f;
+		for (size_t i = 0; i + 2 < this->indices.size(); i += 3) {
+			const Vertex& a = this->vertices[this->indices[i]];
+			const Vertex& b = this->vertices[this->indices[i + 1]];
+			const Vertex& c = this->vertices[this->indices[i + 2]];
+			glm::vec2 u = b.TexCoords - a.TexCoords;
+			glm::vec2 v = c.TexCoords - a.TexCoords;
+			texCoordArea += 0.5f * std::abs(u.x * v.y - u.y * v.x);
+			area += 0.5f * glm::length(glm::cross(b.Position - a.Position, c.Position - a.Position));
+		}
+		this->texCoordDensity = area > 0.0f ? std::sqrt(texCoordArea / area) : 0.0f;
+
 		this->setupMesh();
 	}
 
+	bool Mesh::hasTexture(const std::string& type) const {
+		for (size_t i = 0; i < textures.size(); i++) {
+			if (textures[i].type == type)
+				return true;
+		}
+		return false;
+	}
+
+	glm::ivec3 Mesh::getTextureLayers() const {
+		glm::ivec3 layers(0);
+		for (size_t i = 0; i < textures.size(); i++) {
+			GLint layer = textures[i].layer >= 0 ? textures[i].layer : 0;
+			if (textures[i].type == "ambientTexture")
+				layers.x = layer;
+			else if (textures[i].type == "diffuseTexture")
+				layers.y = layer;
+			else if (textures[i].type == "specularTexture")
+				layers.z = layer;
+		}
+		return layers;
+	}
+
+	float Mesh::getTexCoordDensity() const {
+		return texCoordDensity;
+	}
+
+	static GLenum getTextureTarget(const Texture& texture) {
+		return texture.layer >= 0 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+	}
+
 	Buffers Mesh::getBuffers() {
 	    return this->buffers;
 	}
 
+	BoundingBox Mesh::getBounds() const {
+	    return this->bounds;
+	}
+
 	/* Mesh drawing function - also applies associated textures */
 	void Mesh::Draw(gps::Shader shader)
 	{
 		shader.useShaderProgram();
 
+		bindTextures(shader);
+
+		glBindVertexArray(this->buffers.VAO);
+		glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
+		glBindVertexArray(0);
+
+		unbindTextures();
+    }
+
+	void Mesh::SetInstanceBuffer(GLuint instanceBuffer, GLsizei firstInstance)
+	{
+		glBindVertexArray(this->buffers.VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		size_t offset = firstInstance * sizeof(InstanceData);
+
+		// Instance model matrix - one vec4 attribute per column
+		for (GLuint i = 0; i < 4; i++) {
+			glEnableVertexAttribArray(3 + i);
+			glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (GLvoid*)(offset + offsetof(InstanceData, model) + i * sizeof(glm::vec4)));
+			glVertexAttribDivisor(3 + i, 1);
+		}
+		// Instance normal matrix - one vec3 attribute per column
+		for (GLuint i = 0; i < 3; i++) {
+			glEnableVertexAttribArray(7 + i);
+			glVertexAttribPointer(7 + i, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (GLvoid*)(offset + offsetof(InstanceData, normalMatrix) + i * sizeof(glm::vec3)));
+			glVertexAttribDivisor(7 + i, 1);
+		}
+
+		glBindVertexArray(0);
+	}
+
+	void Mesh::DrawInstanced(gps::Shader shader, GLsizei instanceCount)
+	{
+		shader.useShaderProgram();
+
+		bindTextures(shader);
+
+		glBindVertexArray(this->buffers.VAO);
+		glDrawElementsInstanced(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0, instanceCount);
+		glBindVertexArray(0);
+
+		unbindTextures();
+	}
+
+	MeshUniformLocations Mesh::getUniformLocations(gps::Shader shader)
+	{
+		MeshUniformLocations locations;
+		locations.ambientTexture = glGetUniformLocation(shader.shaderProgram, "ambientTexture");
+		locations.diffuseTexture = glGetUniformLocation(shader.shaderProgram, "diffuseTexture");
+		locations.specularTexture = glGetUniformLocation(shader.shaderProgram, "specularTexture");
+		locations.textureLayers = glGetUniformLocation(shader.shaderProgram, "textureLayers");
+		locations.materialDiffuse = glGetUniformLocation(shader.shaderProgram, "materialDiffuse");
+		locations.materialSpecular = glGetUniformLocation(shader.shaderProgram, "materialSpecular");
+		return locations;
+	}
+
+	static GLint getTextureLocation(const MeshUniformLocations& locations, const std::string& type)
+	{
+		if (type == "diffuseTexture")
+			return locations.diffuseTexture;
+		if (type == "specularTexture")
+			return locations.specularTexture;
+		if (type == "ambientTexture")
+			return locations.ambientTexture;
+		return -1;
+	}
+
+	void Mesh::RecordInstanced(CommandBuffer& commands, const MeshUniformLocations& locations, GLsizei instanceCount) const
+	{
+		// Programs sampling no texture (the depth passes) get no texture bindings
+		bool sampled = locations.ambientTexture >= 0 || locations.diffuseTexture >= 0 || locations.specularTexture >= 0;
+		// Untextured meshes are colored by their material
+		bool colored = !hasTexture("diffuseTexture") && (locations.materialDiffuse >= 0 || locations.materialSpecular >= 0);
+
+		if (sampled || colored) {
+			commands.BeginUniforms();
+			for (GLuint i = 0; i < textures.size() && sampled; i++) {
+				GLint location = getTextureLocation(locations, textures[i].type);
+				if (location >= 0)
+					commands.SetUniform(location, (int32_t)i);
+			}
+			if (sampled && locations.textureLayers >= 0)
+				commands.SetUniform(locations.textureLayers, getTextureLayers());
+			if (colored) {
+				commands.SetUniform(locations.materialDiffuse, this->material.diffuse);
+				commands.SetUniform(locations.materialSpecular, this->material.specular);
+			}
+			commands.EndUniforms();
+		}
+
+		// The units of the textures the mesh lacks are cleared, as Draw leaves them, so they sample black.
+		// Meshes of packed models share their arrays, the binds of consecutive meshes are then skipped on replay
+		if (sampled) {
+			CommandBuffer::TextureTarget target =
+				locations.textureLayers >= 0 ? CommandBuffer::TEXTURE_2D_ARRAY : CommandBuffer::TEXTURE_2D;
+			for (GLuint i = 0; i < MAX_MESH_TEXTURES; i++)
+				commands.BindTexture(i, target, i < textures.size() ? textures[i].id : 0);
+		}
+
+		commands.BindVertexArray(this->buffers.VAO);
+		commands.DrawIndexed((uint32_t)this->indices.size(), (uint32_t)instanceCount);
+	}
+
+	void Mesh::bindTextures(gps::Shader shader)
+	{
 		//set textures
 		for (GLuint i = 0; i < textures.size(); i++)
 		{
 			glActiveTexture(GL_TEXTURE0 + i);
 			glUniform1i(glGetUniformLocation(shader.shaderProgram, this->textures[i].type.c_str()), i);
-			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
+			glBindTexture(getTextureTarget(this->textures[i]), this->textures[i].id);
+		}
+		if (!textures.empty() && textures[0].layer >= 0) {
+			glm::ivec3 layers = getTextureLayers();
+			glUniform3iv(glGetUniformLocation(shader.shaderProgram, "textureLayers"), 1, &layers[0]);
 		}
 
-		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+		// Untextured meshes are colored by their material
+		if (!hasTexture("diffuseTexture")) {
+			glUniform3fv(glGetUniformLocation(shader.shaderProgram, "materialDiffuse"), 1, &this->material.diffuse[0]);
+			glUniform3fv(glGetUniformLocation(shader.shaderProgram, "materialSpecular"), 1, &this->material.specular[0]);
+		}
+	}
 
+	void Mesh::unbindTextures()
+	{
         for(GLuint i = 0; i < this->textures.size(); i++)
         {
             glActiveTexture(GL_TEXTURE0 + i);
-            glBindTexture(GL_TEXTURE_2D, 0);
+            glBindTexture(getTextureTarget(this->textures[i]), 0);
         }
+	}
 
-    }
+	void Mesh::SetLabel(const std::string& label)
+	{
+		GLDebug::LabelObject(GL_VERTEX_ARRAY, this->buffers.VAO, label);
+		GLDebug::LabelObject(GL_BUFFER, this->buffers.VBO, label + " vertices");
+		GLDebug::LabelObject(GL_BUFFER, this->buffers.EBO, label + " indices");
+	}
 
 	// Initializes all the buffer objects/arrays
 	void Mesh::setupMesh(){
@@ -5,9 +5,12 @@
 #include "glm/glm.hpp"
 
 #include "Shader.hpp"
+#include "BoundingBox.hpp"
+#include "CommandBuffer.hpp"
 
 #include <string>
 #include <vector>
+#include <cstddef>
 
 
 namespace gps {
@@ -25,15 +28,45 @@ struct Texture
     //ambientTexture, diffuseTexture, specularTexture
     std::string type;
     std::string path;
+    //layer of the texture in the GL_TEXTURE_2D_ARRAY id once packed by Model3D::PackTextureArrays, -1 for a
+    //GL_TEXTURE_2D
+    GLint layer;
 };
 
 struct Material
     {
-        glm::vec3 ambient;
-        glm::vec3 diffuse;
-        glm::vec3 specular;
+        glm::vec3 ambient = glm::vec3(0.2f);
+        glm::vec3 diffuse = glm::vec3(0.8f);
+        glm::vec3 specular = glm::vec3(0.0f);
     };
 
+// Per-instance data, read by basic.vert from attribute locations 3-9
+struct InstanceData
+{
+    glm::mat4 model;
+    // inverse transpose of the model matrix
+    glm::mat3 normalMatrix;
+};
+
+// A placed copy of a mesh: the vertices of the mesh moved by a rigid transform
+struct MeshInstance
+{
+    int mesh;
+    glm::mat4 transform;
+};
+
+// Locations of the uniforms a mesh sets, in the program its draws are recorded for
+struct MeshUniformLocations
+{
+    GLint ambientTexture;
+    GLint diffuseTexture;
+    GLint specularTexture;
+    // Only found in the SHADER_TEXTURE_ARRAYS variants
+    GLint textureLayers;
+    GLint materialDiffuse;
+    GLint materialSpecular;
+};
+
 struct Buffers {
     GLuint VAO;
     GLuint VBO;
@@ -46,20 +79,54 @@ public:
     std::vector<Vertex> vertices;
     std::vector<GLuint> indices;
     std::vector<Texture> textures;
+    // Colors of the .mtl material, drawn by the basic.frag variants without SHADER_TEXTURED
+    Material material;
 
 	Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
 
 	Buffers getBuffers();
 
+	// Object space bounds of the vertices
+	BoundingBox getBounds() const;
+
+	bool hasTexture(const std::string& type) const;
+
+	// Layers of the ambient, diffuse and specular textures in their arrays, 0 for the ones the mesh lacks
+	glm::ivec3 getTextureLayers() const;
+
+	// Texture coordinates per object space unit, averaged over the triangles: how fast the textures are walked across
+	// the surface, 0 without texture coordinates
+	float getTexCoordDensity() const;
+
+	// Names the VAO and buffers of the mesh for GL debuggers
+	void SetLabel(const std::string& label);
+
 	void Draw(gps::Shader shader);
 
+	// Reads the per-instance attributes of the VAO from an InstanceData buffer, starting at firstInstance
+	void SetInstanceBuffer(GLuint instanceBuffer, GLsizei firstInstance);
+
+	// Draws instanceCount copies with a single glDrawElementsInstanced call
+	void DrawInstanced(gps::Shader shader, GLsizei instanceCount);
+
+	// Looked up on the GL thread, the threads recording commands cannot call GL
+	static MeshUniformLocations getUniformLocations(gps::Shader shader);
+
+	// Records the textures, the material and the draw of instanceCount copies, from any thread
+	void RecordInstanced(CommandBuffer& commands, const MeshUniformLocations& locations, GLsizei instanceCount) const;
+
 private:
     /*  Render data  */
     Buffers buffers;
+    BoundingBox bounds;
+    float texCoordDensity;
 
 	// Initializes all the buffer objects/arrays
 	void setupMesh();
 
+	void bindTextures(gps::Shader shader);
+	void unbindTextures();
+
 };
 
 }
@@ -1,16 +1,39 @@
 #include "Model3D.hpp"
+#include "DuplicateMeshFinder.hpp"
+#include "GLDebug.hpp"
+#include "GLCommandBackend.hpp"
+#include "TextureArrayPacker.hpp"
+#include "RenderStats.hpp"
+
+#include <algorithm>
+#include <cstring>
 
 namespace gps {
 
+	Model3D::Model3D()
+	{
+		instanceBuffer = 0;
+		texturesPacked = false;
+		textureStreamer = NULL;
+	}
+
 	void Model3D::LoadModel(std::string fileName)
 	{
         std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
-		ReadOBJ(fileName, basePath);
+		LoadModel(fileName, basePath);
 	}
 
     void Model3D::LoadModel(std::string fileName, std::string basePath)
 	{
 		ReadOBJ(fileName, basePath);
+
+		// Every mesh is placed once, where the file put it
+		std::vector<gps::MeshInstance> placedMeshes(meshes.size());
+		for (size_t i = 0; i < meshes.size(); i++) {
+			placedMeshes[i].mesh = (int)i;
+			placedMeshes[i].transform = glm::mat4(1.0f);
+		}
+		PlaceMeshes(placedMeshes);
 	}
 
 	// Draw each mesh from the model
@@ -20,6 +43,241 @@ namespace gps {
 			meshes[i].Draw(shaderProgram);
 	}
 
+	// Draw the visible meshes from the model
+	void Model3D::Draw(gps::Shader shaderProgram, const std::vector<bool>& visibleMeshes)
+	{
+		for (size_t i = 0; i < meshes.size(); i++) {
+			if (visibleMeshes[i])
+				meshes[i].Draw(shaderProgram);
+		}
+	}
+
+	bool Model3D::isTextured() const
+	{
+		for (size_t i = 0; i < meshes.size(); i++) {
+			if (meshes[i].hasTexture("diffuseTexture"))
+				return true;
+		}
+		return false;
+	}
+
+	const std::vector<gps::Mesh>& Model3D::getMeshes() const
+	{
+		return meshes;
+	}
+
+	int Model3D::MergeDuplicateMeshes()
+	{
+		gps::DuplicateMeshFinder finder;
+		std::vector<gps::MeshInstance> placedMeshes = finder.Find(meshes);
+
+		// Keep the first copy of every geometry, the others only differ by their placement
+		std::vector<int> keptIndex(meshes.size(), -1);
+		std::vector<gps::Mesh> keptMeshes;
+		for (size_t i = 0; i < meshes.size(); i++) {
+			if (placedMeshes[i].mesh == (int)i) {
+				keptIndex[i] = (int)keptMeshes.size();
+				keptMeshes.push_back(meshes[i]);
+			} else {
+				GLuint VBO = meshes[i].getBuffers().VBO;
+				GLuint EBO = meshes[i].getBuffers().EBO;
+				GLuint VAO = meshes[i].getBuffers().VAO;
+				glDeleteBuffers(1, &VBO);
+				glDeleteBuffers(1, &EBO);
+				glDeleteVertexArrays(1, &VAO);
+			}
+		}
+		for (size_t i = 0; i < placedMeshes.size(); i++)
+			placedMeshes[i].mesh = keptIndex[placedMeshes[i].mesh];
+
+		meshes.swap(keptMeshes);
+		PlaceMeshes(placedMeshes);
+
+		std::cout << "# of unique meshes : " << meshes.size() << " (" << finder.getDuplicateCount() << " shapes drawn as instances)" << std::endl;
+		return finder.getDuplicateCount();
+	}
+
+	bool Model3D::FindRigidCopy(const Model3D& copy, glm::mat4& transform) const
+	{
+		if (meshes.empty() || copy.meshes.size() != meshes.size())
+			return false;
+
+		// Every mesh has to be a copy, and the transform found for the first one has to place all of them
+		gps::DuplicateMeshFinder finder;
+		const float tolerance = 0.001f;
+		for (size_t i = 0; i < meshes.size(); i++) {
+			glm::mat4 meshTransform;
+			if (!finder.FindTransform(meshes[i], copy.meshes[i], meshTransform))
+				return false;
+			if (i == 0) {
+				transform = meshTransform;
+				continue;
+			}
+
+			float positionTolerance = tolerance * glm::max(glm::length(copy.meshes[i].getBounds().getExtent()), 1e-3f);
+			for (size_t v = 0; v < meshes[i].vertices.size(); v++) {
+				glm::vec3 placed = glm::vec3(transform * glm::vec4(meshes[i].vertices[v].Position, 1.0f));
+				if (glm::length(placed - copy.meshes[i].vertices[v].Position) > positionTolerance)
+					return false;
+			}
+		}
+		return true;
+	}
+
+	int Model3D::PackTextureArrays()
+	{
+		gps::TextureArrayPacker packer;
+		std::vector<GLuint> arrays = packer.Pack(loadedTextures);
+		textureArrays.insert(textureArrays.end(), arrays.begin(), arrays.end());
+		texturesPacked = true;
+
+		// Meshes hold copies of the loaded textures, matched by path
+		for (size_t i = 0; i < meshes.size(); i++) {
+			for (size_t t = 0; t < meshes[i].textures.size(); t++) {
+				for (size_t l = 0; l < loadedTextures.size(); l++) {
+					if (loadedTextures[l].path == meshes[i].textures[t].path) {
+						meshes[i].textures[t].id = loadedTextures[l].id;
+						meshes[i].textures[t].layer = loadedTextures[l].layer;
+						break;
+					}
+				}
+			}
+		}
+
+		std::cout << "# of texture arrays : " << arrays.size() << " (" << packer.getPackedCount() << " textures)" << std::endl;
+		return (int)arrays.size();
+	}
+
+	bool Model3D::hasTextureArrays() const
+	{
+		return texturesPacked;
+	}
+
+	void Model3D::SetTextureStreamer(gps::TextureStreamer* textureStreamer)
+	{
+		this->textureStreamer = textureStreamer;
+	}
+
+	const std::vector<gps::MeshInstance>& Model3D::getMeshInstances() const
+	{
+		return meshInstances;
+	}
+
+	void Model3D::PlaceMeshes(const std::vector<gps::MeshInstance>& placedMeshes)
+	{
+		meshInstances = placedMeshes;
+		meshPlacements.assign(meshes.size(), std::vector<int>());
+		for (size_t i = 0; i < meshInstances.size(); i++)
+			meshPlacements[meshInstances[i].mesh].push_back((int)i);
+	}
+
+	void Model3D::SetInstances(const std::vector<glm::mat4>& transforms)
+	{
+		instanceTransforms = transforms;
+		instanceData.resize(transforms.size() * meshInstances.size());
+		for (size_t i = 0; i < transforms.size(); i++)
+			SetInstanceTransform((int)i, transforms[i]);
+
+		// Every mesh gets a range large enough for all its placements in every instance
+		meshFirstInstance.resize(meshes.size());
+		GLsizei instanceCount = 0;
+		for (size_t i = 0; i < meshes.size(); i++) {
+			meshFirstInstance[i] = instanceCount;
+			instanceCount += (GLsizei)(transforms.size() * meshPlacements[i].size());
+		}
+
+		// (Re)create the buffer for the new instance count, every mesh VAO reads its own range of it
+		if (instanceBuffer != 0)
+			glDeleteBuffers(1, &instanceBuffer);
+		glGenBuffers(1, &instanceBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		glBufferData(GL_ARRAY_BUFFER, instanceCount * sizeof(gps::InstanceData), NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		GLDebug::LabelObject(GL_BUFFER, instanceBuffer, "instances");
+
+		for (size_t i = 0; i < meshes.size(); i++)
+			meshes[i].SetInstanceBuffer(instanceBuffer, meshFirstInstance[i]);
+	}
+
+	void Model3D::SetInstanceTransform(int instance, const glm::mat4& transform)
+	{
+		SetInstanceTransform(instance, transform, glm::transpose(glm::inverse(glm::mat3(transform))));
+	}
+
+	void Model3D::SetInstanceTransform(int instance, const glm::mat4& transform, const glm::mat3& normalMatrix)
+	{
+		instanceTransforms[instance] = transform;
+		for (size_t i = 0; i < meshInstances.size(); i++) {
+			gps::InstanceData& data = instanceData[instance * meshInstances.size() + i];
+			data.model = transform * meshInstances[i].transform;
+			data.normalMatrix = normalMatrix * glm::mat3(meshInstances[i].transform);
+		}
+	}
+
+	int Model3D::getInstanceCount() const
+	{
+		return (int)instanceTransforms.size();
+	}
+
+	// Draw each placed mesh once per instance
+	void Model3D::DrawInstanced(gps::Shader shaderProgram)
+	{
+		DrawInstanced(shaderProgram, std::vector<bool>(instanceData.size(), true));
+	}
+
+	// Draw the visible placed meshes once per instance
+	void Model3D::DrawInstanced(gps::Shader shaderProgram, const std::vector<bool>& visibleInstances)
+	{
+		commands.Reset();
+		RecordInstanced(commands, shaderProgram, Mesh::getUniformLocations(shaderProgram), visibleInstances, 0, meshes.size());
+		GLCommandBackend::Replay(&commands, 1);
+	}
+
+	void Model3D::RecordInstanced(CommandBuffer& commands, gps::Shader shaderProgram, const MeshUniformLocations& locations,
+		const std::vector<bool>& visibleInstances, size_t firstMesh, size_t lastMesh) const
+	{
+		lastMesh = std::min(lastMesh, meshes.size());
+		if (firstMesh >= lastMesh)
+			return;
+
+		// Count the visible instances of every mesh first, they are then packed straight into the upload
+		std::vector<GLsizei> drawnCounts(lastMesh - firstMesh, 0);
+		GLsizei lastDrawn = 0;
+		for (size_t i = firstMesh; i < lastMesh; i++) {
+			for (size_t instance = 0; instance < instanceTransforms.size(); instance++) {
+				for (size_t p = 0; p < meshPlacements[i].size(); p++) {
+					if (visibleInstances[instance * meshInstances.size() + meshPlacements[i][p]])
+						drawnCounts[i - firstMesh]++;
+				}
+			}
+			if (drawnCounts[i - firstMesh] > 0)
+				lastDrawn = meshFirstInstance[i] + drawnCounts[i - firstMesh];
+		}
+		if (lastDrawn == 0)
+			return;
+
+		// The visible instances of every mesh go to the start of its range, the whole span is uploaded at once
+		GLsizei firstInstance = meshFirstInstance[firstMesh];
+		unsigned char* upload = (unsigned char*)commands.UpdateBuffer(instanceBuffer,
+			(uint32_t)(firstInstance * sizeof(gps::InstanceData)), (lastDrawn - firstInstance) * sizeof(gps::InstanceData));
+		for (size_t i = firstMesh; i < lastMesh; i++) {
+			size_t slot = meshFirstInstance[i] - firstInstance;
+			for (size_t instance = 0; instance < instanceTransforms.size(); instance++) {
+				for (size_t p = 0; p < meshPlacements[i].size(); p++) {
+					size_t index = instance * meshInstances.size() + meshPlacements[i][p];
+					if (visibleInstances[index])
+						std::memcpy(upload + slot++ * sizeof(gps::InstanceData), &instanceData[index], sizeof(gps::InstanceData));
+				}
+			}
+		}
+
+		commands.BindProgram(shaderProgram.shaderProgram);
+		for (size_t i = firstMesh; i < lastMesh; i++) {
+			if (drawnCounts[i - firstMesh] > 0)
+				meshes[i].RecordInstanced(commands, locations, drawnCounts[i - firstMesh]);
+		}
+	}
+
 	// Does the parsing of the .obj file and fills in the data structure
 	void Model3D::ReadOBJ(std::string fileName, std::string basePath){
 
@@ -48,6 +306,7 @@ namespace gps {
 			std::vector<gps::Vertex> vertices;
 			std::vector<GLuint> indices;
 			std::vector<gps::Texture> textures;
+			gps::Material currentMaterial;
 
 			// Loop over faces(polygon)
 			size_t index_offset = 0;
@@ -98,7 +357,6 @@ namespace gps {
 			if (a > 0 && materials.size()>0) {
 				materialId = shapes[s].mesh.material_ids[0];
 				if (materialId != -1) {
-					gps::Material currentMaterial;
 					currentMaterial.ambient = glm::vec3(materials[materialId].ambient[0], materials[materialId].ambient[1], materials[materialId].ambient[2]);
 					currentMaterial.diffuse = glm::vec3(materials[materialId].diffuse[0], materials[materialId].diffuse[1], materials[materialId].diffuse[2]);
 					currentMaterial.specular = glm::vec3(materials[materialId].specular[0], materials[materialId].specular[1], materials[materialId].specular[2]);
@@ -133,6 +391,8 @@ namespace gps {
 			}
 
 			meshes.push_back(gps::Mesh(vertices, indices, textures));
+			meshes.back().material = currentMaterial;
+			meshes.back().SetLabel(shapes[s].name);
 		}
 	}
 
@@ -148,9 +408,14 @@ namespace gps {
 			}
 
 			gps::Texture currentTexture;
-			currentTexture.id = ReadTextureFromFile(path.c_str());
+			if (textureStreamer != NULL)
+				currentTexture.id = textureStreamer->Load(path);
+			else
+				currentTexture.id = ReadTextureFromFile(path.c_str());
+			GLDebug::LabelObject(GL_TEXTURE, currentTexture.id, path);
 			currentTexture.type = std::string(type);
 			currentTexture.path = path;
+			currentTexture.layer = -1;
 
 			loadedTextures.push_back(currentTexture);
 
@@ -217,9 +482,16 @@ namespace gps {
 	}
 
 	Model3D::~Model3D() {
-        for (size_t i = 0; i < loadedTextures.size(); i++) {
-            glDeleteTextures(1, &loadedTextures.at(i).id);
+        if (instanceBuffer != 0)
+            glDeleteBuffers(1, &instanceBuffer);
+
+        // Streamed textures are deleted by their streamer
+        for (size_t i = 0; i < loadedTextures.size() && textureStreamer == NULL; i++) {
+            if (loadedTextures.at(i).layer < 0)
+                glDeleteTextures(1, &loadedTextures.at(i).id);
         }
+        for (size_t i = 0; i < textureArrays.size(); i++)
+            glDeleteTextures(1, &textureArrays.at(i));
 
         for (size_t i = 0; i < meshes.size(); i++) {
             GLuint VBO = meshes.at(i).getBuffers().VBO;
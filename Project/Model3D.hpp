@@ -2,6 +2,7 @@
 #define Model3D_hpp
 
 #include "Mesh.hpp"
+#include "TextureStreamer.hpp"
 
 #include "tiny_obj_loader.h"
 #include "stb_image.h"
@@ -16,6 +17,7 @@ namespace gps {
     {
 
     public:
+        Model3D();
         ~Model3D();
 
 		void LoadModel(std::string fileName);
@@ -24,11 +26,75 @@ namespace gps {
 
 		void Draw(gps::Shader shaderProgram);
 
+		// Draws only the meshes flagged in visibleMeshes (one flag per mesh)
+		void Draw(gps::Shader shaderProgram, const std::vector<bool>& visibleMeshes);
+
+		const std::vector<gps::Mesh>& getMeshes() const;
+
+		// True when a mesh has a diffuse texture, the model is then drawn with the SHADER_TEXTURED variant
+		bool isTextured() const;
+
+		// Replaces the meshes whose geometry repeats up to a rigid transform by placed copies of the first one and
+		// returns the number of meshes removed. Copies are only drawn by DrawInstanced
+		int MergeDuplicateMeshes();
+
+		// True when every mesh of copy is the mesh of this model with the same index moved by one rigid transform,
+		// returned in transform; for two files of the same prop placed at different spots, loaded as they are
+		bool FindRigidCopy(const Model3D& copy, glm::mat4& transform) const;
+
+		// Packs the textures of the same size and format into GL_TEXTURE_2D_ARRAY objects and gives every mesh the
+		// layers of its textures, returns the number of arrays. The model is then drawn with the SHADER_TEXTURE_ARRAYS
+		// variant, and consecutive meshes with different textures no longer rebind them
+		int PackTextureArrays();
+
+		// True once PackTextureArrays has run
+		bool hasTextureArrays() const;
+
+		// Textures are then loaded by the streamer, which owns them, with their small mip levels only. Set before LoadModel
+		void SetTextureStreamer(gps::TextureStreamer* textureStreamer);
+
+		// One placed mesh per shape of the .obj file, in file order
+		const std::vector<gps::MeshInstance>& getMeshInstances() const;
+
+		// Instancing - every placed mesh is drawn once per transform, with one glDrawElementsInstanced per mesh
+		void SetInstances(const std::vector<glm::mat4>& transforms);
+		void SetInstanceTransform(int instance, const glm::mat4& transform);
+		// Same, with the normal matrix of transform already known; the placed meshes are rigid and keep it
+		void SetInstanceTransform(int instance, const glm::mat4& transform, const glm::mat3& normalMatrix);
+		int getInstanceCount() const;
+
+		// basic.vert reads the model and normal matrices of every instance from the instance attributes
+		void DrawInstanced(gps::Shader shaderProgram);
+		// One flag per placed mesh of every instance, at instance * getMeshInstances().size() + placed mesh
+		void DrawInstanced(gps::Shader shaderProgram, const std::vector<bool>& visibleInstances);
+
+		// Records what DrawInstanced draws of the meshes [firstMesh, lastMesh), the visible instances included.
+		// Different ranges can be recorded on different threads at the same time, the lists are then replayed in
+		// order on the GL thread; locations are those of shaderProgram
+		void RecordInstanced(CommandBuffer& commands, gps::Shader shaderProgram, const MeshUniformLocations& locations,
+			const std::vector<bool>& visibleInstances, size_t firstMesh, size_t lastMesh) const;
+
     private:
 		// Component meshes - group of objects
         std::vector<gps::Mesh> meshes;
 		// Associated textures
         std::vector<gps::Texture> loadedTextures;
+		// Arrays made by PackTextureArrays, the ids of the packed textures
+		std::vector<GLuint> textureArrays;
+		bool texturesPacked;
+		// Loads the textures when set
+		gps::TextureStreamer* textureStreamer;
+		// Placed meshes and, for each mesh, the placed meshes drawing it
+		std::vector<gps::MeshInstance> meshInstances;
+		std::vector<std::vector<int> > meshPlacements;
+		// Per-instance transforms and their combination with every placed mesh
+		std::vector<glm::mat4> instanceTransforms;
+		std::vector<gps::InstanceData> instanceData;
+		// Range of every mesh in the instance buffer, its visible instances are packed at the start before each draw
+		std::vector<GLsizei> meshFirstInstance;
+		GLuint instanceBuffer;
+		// Commands of DrawInstanced, the arena is reused by every call
+		CommandBuffer commands;
 
 		// Does the parsing of the .obj file and fills in the data structure
 		void ReadOBJ(std::string fileName, std::string basePath);
@@ -38,6 +104,8 @@ namespace gps {
 
 		// Reads the pixel data from an image file and loads it into the video memory
 		GLuint ReadTextureFromFile(const char* file_name);
+
+		void PlaceMeshes(const std::vector<gps::MeshInstance>& placedMeshes);
     };
 }
 
@@ -0,0 +1,346 @@
+#include "OcclusionCuller.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_CULLER_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace gps {
+
+    //tile widths are multiples of 4 so that every 4 pixel block written by the rasterizer belongs to a single tile
+    const int TILE_WIDTH = 32;
+    const int TILE_HEIGHT = 16;
+
+    OcclusionCuller::OcclusionCuller(int width, int height) {
+        this->width = std::max((width + 3) & ~3, 4);
+        this->height = std::max(height, 1);
+        this->tilesX = (this->width + TILE_WIDTH - 1) / TILE_WIDTH;
+        this->tilesY = (this->height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+        this->occluderTriangleCount = 0;
+        this->rasterizedTriangleCount = 0;
+        this->viewProjection = glm::mat4(1.0f);
+        this->tileBins.resize(tilesX * tilesY);
+
+        //the pyramid goes down to a single texel, an empty depth buffer hides nothing
+        int levelWidth = this->width;
+        int levelHeight = this->height;
+        while (true) {
+            levelWidths.push_back(levelWidth);
+            levelHeights.push_back(levelHeight);
+            depthPyramid.push_back(std::vector<float>(levelWidth * levelHeight, 1.0f));
+            if (levelWidth == 1 && levelHeight == 1)
+                break;
+            levelWidth = std::max((levelWidth + 1) / 2, 1);
+            levelHeight = std::max((levelHeight + 1) / 2, 1);
+        }
+    }
+
+    int OcclusionCuller::AddOccluder(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices) {
+        Occluder occluder;
+        occluder.positions = positions;
+        occluder.indices = indices;
+        occluder.transform = glm::mat4(1.0f);
+        occluder.firstTriangle = occluderTriangleCount;
+        occluderTriangleCount += (int)(indices.size() / 3);
+        occluders.push_back(occluder);
+
+        return (int)occluders.size() - 1;
+    }
+
+    void OcclusionCuller::SetOccluderTransform(int occluderId, const glm::mat4& transform) {
+        occluders[occluderId].transform = transform;
+    }
+
+    void OcclusionCuller::ClearOccluders() {
+        occluders.clear();
+        screenTriangles.clear();
+        occluderTriangleCount = 0;
+    }
+
+    void OcclusionCuller::Render(const glm::mat4& viewProjection, ThreadPool* pool) {
+        this->viewProjection = viewProjection;
+        screenTriangles.resize(occluderTriangleCount);
+
+        //transform and set up the triangles of every occluder
+        auto setupOccluders = [this](size_t begin, size_t end) {
+            std::vector<glm::vec4> clipPositions;
+            for (size_t i = begin; i < end; i++) {
+                const Occluder& occluder = occluders[i];
+                glm::mat4 mvp = this->viewProjection * occluder.transform;
+
+                clipPositions.resize(occluder.positions.size());
+                for (size_t v = 0; v < occluder.positions.size(); v++) {
+                    clipPositions[v] = mvp * glm::vec4(occluder.positions[v], 1.0f);
+                }
+
+                int triangleCount = (int)(occluder.indices.size() / 3);
+                for (int t = 0; t < triangleCount; t++) {
+                    SetupTriangle(clipPositions[occluder.indices[3 * t]],
+                                  clipPositions[occluder.indices[3 * t + 1]],
+                                  clipPositions[occluder.indices[3 * t + 2]],
+                                  screenTriangles[occluder.firstTriangle + t]);
+                }
+            }
+        };
+
+        if (pool != NULL) {
+            pool->ParallelFor(occluders.size(), 1, setupOccluders);
+        } else {
+            setupOccluders(0, occluders.size());
+        }
+
+        //bin the triangles into the tiles they overlap
+        for (size_t i = 0; i < tileBins.size(); i++) {
+            tileBins[i].clear();
+        }
+        rasterizedTriangleCount = 0;
+        for (int t = 0; t < occluderTriangleCount; t++) {
+            const ScreenTriangle& triangle = screenTriangles[t];
+            if (!triangle.valid)
+                continue;
+
+            rasterizedTriangleCount++;
+            for (int ty = triangle.minY / TILE_HEIGHT; ty <= triangle.maxY / TILE_HEIGHT; ty++) {
+                for (int tx = triangle.minX / TILE_WIDTH; tx <= triangle.maxX / TILE_WIDTH; tx++) {
+                    tileBins[ty * tilesX + tx].push_back(t);
+                }
+            }
+        }
+
+        //tiles do not share pixels, so they are rasterized in parallel without locking
+        auto rasterizeTiles = [this](size_t begin, size_t end) {
+            for (size_t tile = begin; tile < end; tile++) {
+                RasterizeTile((int)tile);
+            }
+        };
+
+        if (pool != NULL) {
+            pool->ParallelFor(tileBins.size(), 1, rasterizeTiles);
+        } else {
+            rasterizeTiles(0, tileBins.size());
+        }
+
+        BuildDepthPyramid();
+    }
+
+    void OcclusionCuller::SetupTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2, ScreenTriangle& triangle) const {
+        triangle.valid = false;
+
+        //triangles crossing the near plane are skipped, dropping an occluder only makes the culling less aggressive
+        if (c0.z < -c0.w || c1.z < -c1.w || c2.z < -c2.w || c0.w <= 0.0f || c1.w <= 0.0f || c2.w <= 0.0f)
+            return;
+
+        const glm::vec4* clip[3] = { &c0, &c1, &c2 };
+        glm::vec3 p[3];
+        for (int i = 0; i < 3; i++) {
+            glm::vec3 ndc = glm::vec3(*clip[i]) / clip[i]->w;
+            p[i] = glm::vec3((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z * 0.5f + 0.5f);
+        }
+
+        //counter clockwise triangles are front facing, back faces are culled by the gpu as well so they cannot occlude
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+        if (area <= 0.0f)
+            return;
+
+        //pixels whose centers are inside the triangle bounds
+        float minX = std::min(p[0].x, std::min(p[1].x, p[2].x));
+        float maxX = std::max(p[0].x, std::max(p[1].x, p[2].x));
+        float minY = std::min(p[0].y, std::min(p[1].y, p[2].y));
+        float maxY = std::max(p[0].y, std::max(p[1].y, p[2].y));
+        //clamped before the conversion, vertices close to the camera plane project very far away
+        triangle.minX = (int)std::ceil(std::max(minX - 0.5f, 0.0f));
+        triangle.maxX = (int)std::floor(std::min(maxX - 0.5f, (float)(width - 1)));
+        triangle.minY = (int)std::ceil(std::max(minY - 0.5f, 0.0f));
+        triangle.maxY = (int)std::floor(std::min(maxY - 0.5f, (float)(height - 1)));
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+            return;
+
+        //edge functions a * x + b * y + c, positive inside the triangle
+        for (int i = 0; i < 3; i++) {
+            const glm::vec3& a = p[i];
+            const glm::vec3& b = p[(i + 1) % 3];
+            triangle.edges[i] = glm::vec3(a.y - b.y, b.x - a.x, a.x * b.y - a.y * b.x);
+        }
+
+        //depth after the perspective divide is linear in screen space
+        glm::vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+        float depthX = -normal.x / normal.z;
+        float depthY = -normal.y / normal.z;
+        triangle.depthPlane = glm::vec3(depthX, depthY, p[0].z - depthX * p[0].x - depthY * p[0].y);
+        triangle.valid = true;
+    }
+
+    void OcclusionCuller::RasterizeTile(int tile) {
+        int tileMinX = (tile % tilesX) * TILE_WIDTH;
+        int tileMinY = (tile / tilesX) * TILE_HEIGHT;
+        int tileMaxX = std::min(tileMinX + TILE_WIDTH, width) - 1;
+        int tileMaxY = std::min(tileMinY + TILE_HEIGHT, height) - 1;
+
+        std::vector<float>& depth = depthPyramid[0];
+        for (int y = tileMinY; y <= tileMaxY; y++) {
+            std::fill(depth.begin() + y * width + tileMinX, depth.begin() + y * width + tileMaxX + 1, 1.0f);
+        }
+
+        const std::vector<int>& bin = tileBins[tile];
+        for (size_t i = 0; i < bin.size(); i++) {
+            const ScreenTriangle& triangle = screenTriangles[bin[i]];
+            RasterizeTriangle(triangle,
+                              std::max(triangle.minX, tileMinX), std::max(triangle.minY, tileMinY),
+                              std::min(triangle.maxX, tileMaxX), std::min(triangle.maxY, tileMaxY));
+        }
+    }
+
+    void OcclusionCuller::RasterizeTriangle(const ScreenTriangle& triangle, int minX, int minY, int maxX, int maxY) {
+        const glm::vec3& e0 = triangle.edges[0];
+        const glm::vec3& e1 = triangle.edges[1];
+        const glm::vec3& e2 = triangle.edges[2];
+        const glm::vec3& plane = triangle.depthPlane;
+        float* depth = &depthPyramid[0][0];
+
+#ifdef OCCLUSION_CULLER_SSE
+        //4 pixels per iteration, blocks start at a multiple of 4 so they never leave the tile
+        const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 e0X = _mm_set1_ps(e0.x), e1X = _mm_set1_ps(e1.x), e2X = _mm_set1_ps(e2.x);
+        const __m128 depthX = _mm_set1_ps(plane.x);
+        int startX = minX & ~3;
+
+        for (int y = minY; y <= maxY; y++) {
+            float py = y + 0.5f;
+            __m128 e0Row = _mm_set1_ps(e0.y * py + e0.z);
+            __m128 e1Row = _mm_set1_ps(e1.y * py + e1.z);
+            __m128 e2Row = _mm_set1_ps(e2.y * py + e2.z);
+            __m128 depthRow = _mm_set1_ps(plane.y * py + plane.z);
+            float* row = depth + y * width;
+
+            for (int x = startX; x <= maxX; x += 4) {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+                __m128 w0 = _mm_add_ps(_mm_mul_ps(e0X, px), e0Row);
+                __m128 w1 = _mm_add_ps(_mm_mul_ps(e1X, px), e1Row);
+                __m128 w2 = _mm_add_ps(_mm_mul_ps(e2X, px), e2Row);
+                __m128 inside = _mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_and_ps(_mm_cmpge_ps(w1, zero), _mm_cmpge_ps(w2, zero)));
+                if (_mm_movemask_ps(inside) == 0)
+                    continue;
+
+                __m128 z = _mm_add_ps(_mm_mul_ps(depthX, px), depthRow);
+                __m128 previous = _mm_loadu_ps(row + x);
+                __m128 nearest = _mm_min_ps(previous, z);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, previous)));
+            }
+        }
+#else
+        for (int y = minY; y <= maxY; y++) {
+            float py = y + 0.5f;
+            float* row = depth + y * width;
+
+            for (int x = minX; x <= maxX; x++) {
+                float px = x + 0.5f;
+                if (e0.x * px + e0.y * py + e0.z < 0.0f || e1.x * px + e1.y * py + e1.z < 0.0f || e2.x * px + e2.y * py + e2.z < 0.0f)
+                    continue;
+
+                float z = plane.x * px + plane.y * py + plane.z;
+                if (z < row[x])
+                    row[x] = z;
+            }
+        }
+#endif
+    }
+
+    void OcclusionCuller::BuildDepthPyramid() {
+        for (size_t level = 1; level < depthPyramid.size(); level++) {
+            const std::vector<float>& source = depthPyramid[level - 1];
+            std::vector<float>& destination = depthPyramid[level];
+            int sourceWidth = levelWidths[level - 1];
+            int sourceHeight = levelHeights[level - 1];
+
+            for (int y = 0; y < levelHeights[level]; y++) {
+                int y0 = 2 * y;
+                int y1 = std::min(y0 + 1, sourceHeight - 1);
+                for (int x = 0; x < levelWidths[level]; x++) {
+                    int x0 = 2 * x;
+                    int x1 = std::min(x0 + 1, sourceWidth - 1);
+                    destination[y * levelWidths[level] + x] = std::max(
+                        std::max(source[y0 * sourceWidth + x0], source[y0 * sourceWidth + x1]),
+                        std::max(source[y1 * sourceWidth + x0], source[y1 * sourceWidth + x1]));
+                }
+            }
+        }
+    }
+
+    bool OcclusionCuller::IsVisible(const BoundingBox& worldBounds) const {
+        if (worldBounds.isEmpty())
+            return false;
+
+        //screen rectangle and nearest depth of the box
+        glm::vec2 screenMin(FLT_MAX);
+        glm::vec2 screenMax(-FLT_MAX);
+        float nearestDepth = FLT_MAX;
+        for (int i = 0; i < 8; i++) {
+            glm::vec3 corner((i & 1) ? worldBounds.max.x : worldBounds.min.x,
+                             (i & 2) ? worldBounds.max.y : worldBounds.min.y,
+                             (i & 4) ? worldBounds.max.z : worldBounds.min.z);
+            glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+
+            //boxes reaching the near plane are always drawn
+            if (clip.z < -clip.w || clip.w <= 0.0f)
+                return true;
+
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            screenMin = glm::min(screenMin, glm::vec2(ndc.x, ndc.y));
+            screenMax = glm::max(screenMax, glm::vec2(ndc.x, ndc.y));
+            nearestDepth = std::min(nearestDepth, ndc.z * 0.5f + 0.5f);
+        }
+
+        //off screen boxes are left to the frustum culling
+        screenMin = glm::max(screenMin, glm::vec2(-1.0f));
+        screenMax = glm::min(screenMax, glm::vec2(1.0f));
+        if (screenMin.x > screenMax.x || screenMin.y > screenMax.y)
+            return true;
+
+        int minX = std::min((int)((screenMin.x * 0.5f + 0.5f) * width), width - 1);
+        int maxX = std::min((int)((screenMax.x * 0.5f + 0.5f) * width), width - 1);
+        int minY = std::min((int)((screenMin.y * 0.5f + 0.5f) * height), height - 1);
+        int maxY = std::min((int)((screenMax.y * 0.5f + 0.5f) * height), height - 1);
+
+        //pick the level where the rectangle covers about 2x2 texels
+        int size = std::max(maxX - minX, maxY - minY);
+        size_t level = 0;
+        while ((size >> level) > 1 && level + 1 < depthPyramid.size()) {
+            level++;
+        }
+
+        const std::vector<float>& depth = depthPyramid[level];
+        int levelWidth = levelWidths[level];
+        for (int y = minY >> level; y <= (maxY >> level); y++) {
+            for (int x = minX >> level; x <= (maxX >> level); x++) {
+                if (nearestDepth <= depth[y * levelWidth + x])
+                    return true;
+            }
+        }
+
+        return false;
+    }
+
+    int OcclusionCuller::getWidth() const {
+        return width;
+    }
+
+    int OcclusionCuller::getHeight() const {
+        return height;
+    }
+
+    int OcclusionCuller::getOccluderCount() const {
+        return (int)occluders.size();
+    }
+
+    int OcclusionCuller::getRasterizedTriangleCount() const {
+        return rasterizedTriangleCount;
+    }
+
+    const std::vector<float>& OcclusionCuller::getDepthBuffer() const {
+        return depthPyramid[0];
+    }
+}
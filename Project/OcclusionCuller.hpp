@@ -0,0 +1,80 @@
+#ifndef OcclusionCuller_hpp
+#define OcclusionCuller_hpp
+
+#include "BoundingBox.hpp"
+#include "ThreadPool.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace gps {
+
+    //software occlusion culling: a few large occluder meshes are rasterized on the CPU into a low resolution
+    //depth buffer, then bounding boxes are tested against a max-depth pyramid built from it
+    class OcclusionCuller
+    {
+    public:
+        //the width is rounded up to a multiple of 4, the rasterizer writes 4 pixels at a time
+        OcclusionCuller(int width = 320, int height = 192);
+
+        //adds an occluder in object space and returns its id
+        int AddOccluder(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices);
+        void SetOccluderTransform(int occluderId, const glm::mat4& transform);
+        void ClearOccluders();
+
+        //rasterizes every occluder from the given camera and builds the depth pyramid, tiles are rasterized on the pool
+        void Render(const glm::mat4& viewProjection, ThreadPool* pool = NULL);
+        //false only if the box is certainly hidden behind the occluders rendered last
+        bool IsVisible(const BoundingBox& worldBounds) const;
+
+        int getWidth() const;
+        int getHeight() const;
+        int getOccluderCount() const;
+        //front facing triangles in front of the camera drawn by the last Render
+        int getRasterizedTriangleCount() const;
+        //depth in [0, 1], row 0 is the bottom of the screen
+        const std::vector<float>& getDepthBuffer() const;
+
+    private:
+        struct Occluder {
+            std::vector<glm::vec3> positions;
+            std::vector<unsigned int> indices;
+            glm::mat4 transform;
+            int firstTriangle;
+        };
+
+        //triangle in pixel coordinates, with the depth plane and edge functions ready for rasterization
+        struct ScreenTriangle {
+            glm::vec3 edges[3];
+            glm::vec3 depthPlane;
+            int minX, minY, maxX, maxY;
+            bool valid;
+        };
+
+        int width;
+        int height;
+        int tilesX;
+        int tilesY;
+        glm::mat4 viewProjection;
+
+        std::vector<Occluder> occluders;
+        int occluderTriangleCount;
+        std::vector<ScreenTriangle> screenTriangles;
+        std::vector<std::vector<int> > tileBins;
+        int rasterizedTriangleCount;
+
+        //level 0 is the depth buffer, every next level keeps the farthest depth of 2x2 texels
+        std::vector<std::vector<float> > depthPyramid;
+        std::vector<int> levelWidths;
+        std::vector<int> levelHeights;
+
+        void SetupTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2, ScreenTriangle& triangle) const;
+        void RasterizeTile(int tile);
+        void RasterizeTriangle(const ScreenTriangle& triangle, int minX, int minY, int maxX, int maxY);
+        void BuildDepthPyramid();
+    };
+
+}
+
+#endif /* OcclusionCuller_hpp */
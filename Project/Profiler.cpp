@@ -0,0 +1,191 @@
+#include "Profiler.hpp"
+#include "GLDebug.hpp"
+
+#include <cstdio>
+#include <iomanip>
+
+namespace gps {
+
+    Profiler::Profiler() {
+        this->frameIndex = 0;
+        this->gpuEpoch = 0;
+        for (int i = 0; i < FRAME_LATENCY; i++) {
+            this->frames[i].queryCount = 0;
+            this->frames[i].pending = false;
+        }
+    }
+
+    void Profiler::Create() {
+        //GL_TIMESTAMP is the time all earlier commands have reached the gpu, close enough to the cpu time of the call
+        glGetInteger64v(GL_TIMESTAMP, &gpuEpoch);
+        cpuEpoch = std::chrono::steady_clock::now();
+    }
+
+    double Profiler::getCpuTime() const {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - cpuEpoch).count();
+    }
+
+    void Profiler::BeginFrame() {
+        FrameRecord& frame = frames[frameIndex % FRAME_LATENCY];
+        frame.passes.clear();
+        frame.queryCount = 0;
+        frame.pending = true;
+        openPasses.clear();
+        BeginPass("frame");
+    }
+
+    void Profiler::EndFrame() {
+        while (!openPasses.empty())
+            EndPass();
+        frameIndex++;
+
+        //the slot the next frame reuses holds the oldest frame
+        FrameRecord& oldest = frames[frameIndex % FRAME_LATENCY];
+        if (oldest.pending)
+            CollectFrame(oldest);
+    }
+
+    void Profiler::BeginPass(const char* name) {
+        FrameRecord& frame = frames[frameIndex % FRAME_LATENCY];
+        if (frame.queryCount + 2 > (int)frame.queries.size()) {
+            size_t first = frame.queries.size();
+            frame.queries.resize(first + 16);
+            glGenQueries(16, &frame.queries[first]);
+        }
+
+        PassRecord pass;
+        pass.name = name;
+        pass.depth = (int)openPasses.size();
+        pass.firstQuery = frame.queryCount;
+        frame.queryCount += 2;
+        glQueryCounter(frame.queries[pass.firstQuery], GL_TIMESTAMP);
+        pass.cpuBegin = getCpuTime();
+        pass.cpuEnd = pass.cpuBegin;
+
+        openPasses.push_back((int)frame.passes.size());
+        frame.passes.push_back(pass);
+        GLDebug::PushGroup(name);
+    }
+
+    void Profiler::EndPass() {
+        if (openPasses.empty())
+            return;
+        FrameRecord& frame = frames[frameIndex % FRAME_LATENCY];
+        PassRecord& pass = frame.passes[openPasses.back()];
+        openPasses.pop_back();
+        GLDebug::PopGroup();
+
+        pass.cpuEnd = getCpuTime();
+        glQueryCounter(frame.queries[pass.firstQuery + 1], GL_TIMESTAMP);
+    }
+
+    void Profiler::CollectFrame(FrameRecord& frame) {
+        frame.pending = false;
+
+        //timestamps complete in order, when the last one is there all of them are; a gpu more than FRAME_LATENCY
+        //frames behind loses the gpu times of the frame rather than stalling the cpu
+        GLint available = GL_FALSE;
+        if (frame.queryCount > 0)
+            glGetQueryObjectiv(frame.queries[frame.queryCount - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+        //the same pass can run several times in a frame, the averages are of its total
+        std::map<std::string, double> cpuTotals;
+        std::map<std::string, double> gpuTotals;
+        for (size_t i = 0; i < frame.passes.size(); i++) {
+            const PassRecord& pass = frame.passes[i];
+            double cpuDuration = pass.cpuEnd - pass.cpuBegin;
+            cpuTotals[pass.name] += cpuDuration / 1000.0;
+            AddTraceEvent(pass.name, pass.cpuBegin, cpuDuration, 1);
+
+            if (available) {
+                GLuint64 begin = 0;
+                GLuint64 end = 0;
+                glGetQueryObjectui64v(frame.queries[pass.firstQuery], GL_QUERY_RESULT, &begin);
+                glGetQueryObjectui64v(frame.queries[pass.firstQuery + 1], GL_QUERY_RESULT, &end);
+                double gpuDuration = end > begin ? (end - begin) / 1000.0 : 0.0;
+                gpuTotals[pass.name] += gpuDuration / 1000.0;
+                AddTraceEvent(pass.name, ((GLint64)begin - gpuEpoch) / 1000.0, gpuDuration, 2);
+            }
+        }
+
+        for (std::map<std::string, double>::iterator it = cpuTotals.begin(); it != cpuTotals.end(); ++it) {
+            PassTimes& times = passTimes[it->first];
+            times.cpu.push_back(it->second);
+            if ((int)times.cpu.size() > AVERAGE_FRAMES)
+                times.cpu.pop_front();
+        }
+        for (std::map<std::string, double>::iterator it = gpuTotals.begin(); it != gpuTotals.end(); ++it) {
+            PassTimes& times = passTimes[it->first];
+            times.gpu.push_back(it->second);
+            if ((int)times.gpu.size() > AVERAGE_FRAMES)
+                times.gpu.pop_front();
+        }
+    }
+
+    void Profiler::AddTraceEvent(const char* name, double begin, double duration, int thread) {
+        TraceEvent event;
+        event.name = name;
+        event.begin = begin;
+        event.duration = duration;
+        event.thread = thread;
+        traceEvents.push_back(event);
+        if ((int)traceEvents.size() > MAX_TRACE_EVENTS)
+            traceEvents.pop_front();
+    }
+
+    static double average(const std::deque<double>& values) {
+        if (values.empty())
+            return 0.0;
+        double sum = 0.0;
+        for (size_t i = 0; i < values.size(); i++)
+            sum += values[i];
+        return sum / values.size();
+    }
+
+    double Profiler::getAverageCpuTime(const std::string& name) const {
+        std::map<std::string, PassTimes>::const_iterator found = passTimes.find(name);
+        return found == passTimes.end() ? 0.0 : average(found->second.cpu);
+    }
+
+    double Profiler::getAverageGpuTime(const std::string& name) const {
+        std::map<std::string, PassTimes>::const_iterator found = passTimes.find(name);
+        return found == passTimes.end() ? 0.0 : average(found->second.gpu);
+    }
+
+    void Profiler::PrintAverages(std::ostream& out) const {
+        out << "pass                  cpu ms    gpu ms   (last " << AVERAGE_FRAMES << " frames)" << std::endl;
+        for (std::map<std::string, PassTimes>::const_iterator it = passTimes.begin(); it != passTimes.end(); ++it) {
+            out << std::left << std::setw(18) << it->first << std::right << std::fixed << std::setprecision(3)
+                << std::setw(10) << average(it->second.cpu) << std::setw(10) << average(it->second.gpu) << std::endl;
+        }
+        out.unsetf(std::ios::floatfield);
+        out << std::setprecision(6);
+    }
+
+    bool Profiler::WriteTrace(const std::string& fileName) const {
+        FILE* file = std::fopen(fileName.c_str(), "w");
+        if (!file)
+            return false;
+
+        std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        std::fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+        std::fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+        //pass names are string literals of the code, they need no escaping
+        for (size_t i = 0; i < traceEvents.size(); i++) {
+            const TraceEvent& event = traceEvents[i];
+            std::fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                         event.name.c_str(), event.thread, event.begin, event.duration);
+        }
+        std::fprintf(file, "\n]}\n");
+        return std::fclose(file) == 0;
+    }
+
+    ProfilerScope::ProfilerScope(Profiler& profiler, const char* name) : profiler(profiler) {
+        profiler.BeginPass(name);
+    }
+
+    ProfilerScope::~ProfilerScope() {
+        profiler.EndPass();
+    }
+
+}
@@ -0,0 +1,111 @@
+#ifndef Profiler_hpp
+#define Profiler_hpp
+
+#include <GL/glew.h>
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    //cpu and gpu time of named, nestable passes of a frame. the gpu side writes a GL_TIMESTAMP query at both ends of a
+    //pass, the queries of a frame are read FRAME_LATENCY frames later so the profiler never waits for the gpu. every
+    //frame is a pass named "frame" around the others. every pass is also a debug group, see GLDebug
+    class Profiler
+    {
+    public:
+        static const int FRAME_LATENCY = 4;
+        //the averages are over this many frames
+        static const int AVERAGE_FRAMES = 60;
+        //trace events kept for WriteTrace, the oldest are dropped first
+        static const int MAX_TRACE_EVENTS = 50000;
+
+        Profiler();
+
+        //needs the GL context, matches the gpu clock to the cpu one
+        void Create();
+
+        void BeginFrame();
+        void EndFrame();
+
+        //passes end in the reverse order they began
+        void BeginPass(const char* name);
+        void EndPass();
+
+        //milliseconds per frame over the last AVERAGE_FRAMES frames the pass ran in, 0 for a pass never timed
+        double getAverageCpuTime(const std::string& name) const;
+        double getAverageGpuTime(const std::string& name) const;
+        void PrintAverages(std::ostream& out) const;
+
+        //writes the kept events in the trace event format (chrome://tracing, Perfetto), cpu and gpu as two threads
+        bool WriteTrace(const std::string& fileName) const;
+
+    private:
+        struct PassRecord {
+            const char* name;
+            int depth;
+            //microseconds since Create
+            double cpuBegin;
+            double cpuEnd;
+            //the timestamps at the start and the end are queries firstQuery and firstQuery + 1
+            int firstQuery;
+        };
+
+        struct FrameRecord {
+            std::vector<PassRecord> passes;
+            std::vector<GLuint> queries;
+            int queryCount;
+            bool pending;
+        };
+
+        struct PassTimes {
+            std::deque<double> cpu;
+            std::deque<double> gpu;
+        };
+
+        struct TraceEvent {
+            std::string name;
+            double begin;
+            double duration;
+            //1 cpu, 2 gpu
+            int thread;
+        };
+
+        FrameRecord frames[FRAME_LATENCY];
+        int frameIndex;
+        std::vector<int> openPasses;
+
+        std::chrono::steady_clock::time_point cpuEpoch;
+        //gpu timestamp in nanoseconds at cpuEpoch
+        GLint64 gpuEpoch;
+
+        std::map<std::string, PassTimes> passTimes;
+        std::deque<TraceEvent> traceEvents;
+
+        double getCpuTime() const;
+        //reads back the queries of a frame and adds its passes to the averages and to the trace
+        void CollectFrame(FrameRecord& frame);
+        void AddTraceEvent(const char* name, double begin, double duration, int thread);
+    };
+
+    //times the enclosing scope as a pass
+    class ProfilerScope
+    {
+    public:
+        ProfilerScope(Profiler& profiler, const char* name);
+        ~ProfilerScope();
+
+    private:
+        Profiler& profiler;
+
+        ProfilerScope(const ProfilerScope&);
+        ProfilerScope& operator=(const ProfilerScope&);
+    };
+
+}
+
+#endif /* Profiler_hpp */
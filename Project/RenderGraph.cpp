@@ -0,0 +1,330 @@
+#include "RenderGraph.hpp"
+#include "GLDebug.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+namespace gps {
+
+    //pixel transfer format of an internal format, for allocating with glTexImage, and its size in bytes per texel
+    static void getTextureFormat(GLenum internalFormat, GLenum& format, GLenum& type, int& texelSize) {
+        switch (internalFormat) {
+            case GL_DEPTH_COMPONENT16:
+                format = GL_DEPTH_COMPONENT;
+                type = GL_UNSIGNED_SHORT;
+                texelSize = 2;
+                break;
+            case GL_DEPTH_COMPONENT24:
+            case GL_DEPTH_COMPONENT32F:
+                format = GL_DEPTH_COMPONENT;
+                type = GL_FLOAT;
+                texelSize = 4;
+                break;
+            case GL_DEPTH24_STENCIL8:
+                format = GL_DEPTH_STENCIL;
+                type = GL_UNSIGNED_INT_24_8;
+                texelSize = 4;
+                break;
+            case GL_R32F:
+                format = GL_RED;
+                type = GL_FLOAT;
+                texelSize = 4;
+                break;
+            case GL_RGBA16F:
+                format = GL_RGBA;
+                type = GL_FLOAT;
+                texelSize = 8;
+                break;
+            case GL_RGBA32F:
+                format = GL_RGBA;
+                type = GL_FLOAT;
+                texelSize = 16;
+                break;
+            default:
+                //GL_RGBA8, GL_SRGB8_ALPHA8
+                format = GL_RGBA;
+                type = GL_UNSIGNED_BYTE;
+                texelSize = 4;
+                break;
+        }
+    }
+
+    static bool operator==(const TransientTextureDesc& a, const TransientTextureDesc& b) {
+        return a.target == b.target && a.internalFormat == b.internalFormat && a.width == b.width &&
+            a.height == b.height && a.layers == b.layers;
+    }
+
+    RenderGraph::RenderGraph() {
+        this->frameIndex = 0;
+        this->cycleReported = false;
+    }
+
+    void RenderGraph::Reset() {
+        resources.clear();
+        passes.clear();
+        order.clear();
+    }
+
+    int RenderGraph::ImportResource(const char* name, GLuint object) {
+        Resource resource;
+        resource.name = name;
+        resource.transient = false;
+        resource.output = false;
+        resource.desc = TransientTextureDesc();
+        resource.object = object;
+        resources.push_back(resource);
+        return (int)resources.size() - 1;
+    }
+
+    int RenderGraph::CreateTexture(const char* name, const TransientTextureDesc& desc) {
+        int resource = ImportResource(name);
+        resources[resource].transient = true;
+        resources[resource].desc = desc;
+        return resource;
+    }
+
+    void RenderGraph::MarkOutput(int resource) {
+        resources[resource].output = true;
+    }
+
+    int RenderGraph::AddPass(const char* name, const PassFunction& execute) {
+        Pass pass;
+        pass.name = name;
+        pass.execute = execute;
+        pass.culled = false;
+        passes.push_back(pass);
+        return (int)passes.size() - 1;
+    }
+
+    void RenderGraph::Read(int pass, int resource) {
+        if (!isReadBy(resource, passes[pass]))
+            passes[pass].reads.push_back(resource);
+    }
+
+    void RenderGraph::Write(int pass, int resource) {
+        if (!isWrittenBy(resource, passes[pass]))
+            passes[pass].writes.push_back(resource);
+    }
+
+    bool RenderGraph::isReadBy(int resource, const Pass& pass) const {
+        return std::find(pass.reads.begin(), pass.reads.end(), resource) != pass.reads.end();
+    }
+
+    bool RenderGraph::isWrittenBy(int resource, const Pass& pass) const {
+        return std::find(pass.writes.begin(), pass.writes.end(), resource) != pass.writes.end();
+    }
+
+    void RenderGraph::Compile() {
+        SortPasses();
+        CullPasses();
+        AssignTextures();
+        frameIndex++;
+    }
+
+    //the writers of a resource run in the order they were declared and its readers after all of them; among the
+    //passes that are free to run, the one declared first goes first
+    void RenderGraph::SortPasses() {
+        int passCount = (int)passes.size();
+        std::vector<std::vector<bool> > dependsOn(passCount, std::vector<bool>(passCount, false));
+        for (int r = 0; r < (int)resources.size(); r++) {
+            int previousWriter = -1;
+            for (int p = 0; p < passCount; p++) {
+                if (!isWrittenBy(r, passes[p]))
+                    continue;
+                if (previousWriter >= 0)
+                    dependsOn[p][previousWriter] = true;
+                previousWriter = p;
+            }
+            for (int p = 0; p < passCount; p++) {
+                if (!isReadBy(r, passes[p]) || isWrittenBy(r, passes[p]))
+                    continue;
+                for (int w = 0; w < passCount; w++) {
+                    if (w != p && isWrittenBy(r, passes[w]))
+                        dependsOn[p][w] = true;
+                }
+            }
+        }
+
+        order.clear();
+        std::vector<bool> scheduled(passCount, false);
+        while ((int)order.size() < passCount) {
+            int next = -1;
+            for (int p = 0; p < passCount && next < 0; p++) {
+                if (scheduled[p])
+                    continue;
+                bool ready = true;
+                for (int d = 0; d < passCount && ready; d++)
+                    ready = !dependsOn[p][d] || scheduled[d];
+                if (ready)
+                    next = p;
+            }
+            if (next < 0) {
+                //a pass reading what a later one writes while that one reads its output, declaration order wins
+                if (!cycleReported) {
+                    std::cerr << "Render graph: the passes depend on each other in a cycle, running them as declared" << std::endl;
+                    cycleReported = true;
+                }
+                order.clear();
+                for (int p = 0; p < passCount; p++)
+                    order.push_back(p);
+                return;
+            }
+            scheduled[next] = true;
+            order.push_back(next);
+        }
+    }
+
+    //walks the passes backwards, a pass is kept if it writes an output or something a kept pass reads
+    void RenderGraph::CullPasses() {
+        std::vector<bool> needed(resources.size(), false);
+        for (size_t r = 0; r < resources.size(); r++)
+            needed[r] = resources[r].output;
+
+        for (int i = (int)order.size() - 1; i >= 0; i--) {
+            Pass& pass = passes[order[i]];
+            pass.culled = true;
+            for (size_t w = 0; w < pass.writes.size() && pass.culled; w++)
+                pass.culled = !needed[pass.writes[w]];
+            if (pass.culled)
+                continue;
+            for (size_t r = 0; r < pass.reads.size(); r++)
+                needed[pass.reads[r]] = true;
+        }
+
+        std::vector<int> kept;
+        for (size_t i = 0; i < order.size(); i++) {
+            if (!passes[order[i]].culled)
+                kept.push_back(order[i]);
+        }
+        order.swap(kept);
+    }
+
+    //every transient texture lives from the first to the last kept pass using it; taken by first use, each gets a
+    //pooled texture of the same description that is free by then, so textures of disjoint lifetimes alias
+    void RenderGraph::AssignTextures() {
+        std::vector<int> firstUse(resources.size(), -1);
+        std::vector<int> lastUse(resources.size(), -1);
+        for (int i = 0; i < (int)order.size(); i++) {
+            const Pass& pass = passes[order[i]];
+            for (int r = 0; r < (int)resources.size(); r++) {
+                if (!isReadBy(r, pass) && !isWrittenBy(r, pass))
+                    continue;
+                if (firstUse[r] < 0)
+                    firstUse[r] = i;
+                lastUse[r] = i;
+            }
+        }
+
+        for (size_t i = 0; i < pool.size(); i++)
+            pool[i].busyUntil = -1;
+        for (int i = 0; i < (int)order.size(); i++) {
+            for (size_t r = 0; r < resources.size(); r++) {
+                if (resources[r].transient && firstUse[r] == i)
+                    resources[r].object = AcquireTexture(resources[r], firstUse[r], lastUse[r]);
+            }
+        }
+
+        for (size_t i = 0; i < pool.size();) {
+            if (frameIndex - pool[i].lastUsedFrame > MAX_IDLE_FRAMES) {
+                glDeleteTextures(1, &pool[i].texture);
+                pool.erase(pool.begin() + i);
+            } else {
+                i++;
+            }
+        }
+    }
+
+    GLuint RenderGraph::AcquireTexture(const Resource& resource, int firstPass, int lastPass) {
+        for (size_t i = 0; i < pool.size(); i++) {
+            if (pool[i].desc == resource.desc && pool[i].busyUntil < firstPass) {
+                pool[i].busyUntil = lastPass;
+                pool[i].lastUsedFrame = frameIndex;
+                return pool[i].texture;
+            }
+        }
+
+        const TransientTextureDesc& desc = resource.desc;
+        GLenum format, type;
+        int texelSize;
+        getTextureFormat(desc.internalFormat, format, type, texelSize);
+
+        PooledTexture pooled;
+        pooled.desc = desc;
+        pooled.busyUntil = lastPass;
+        pooled.lastUsedFrame = frameIndex;
+        glGenTextures(1, &pooled.texture);
+        glBindTexture(desc.target, pooled.texture);
+        if (desc.target == GL_TEXTURE_2D_ARRAY)
+            glTexImage3D(desc.target, 0, desc.internalFormat, desc.width, desc.height, desc.layers, 0, format, type, NULL);
+        else
+            glTexImage2D(desc.target, 0, desc.internalFormat, desc.width, desc.height, 0, format, type, NULL);
+        //a single level, the sampling state of the passes comes from sampler objects where it matters
+        glTexParameteri(desc.target, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexParameteri(desc.target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(desc.target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(desc.target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(desc.target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(desc.target, 0);
+        GLDebug::LabelObject(GL_TEXTURE, pooled.texture, resource.name);
+
+        pool.push_back(pooled);
+        return pooled.texture;
+    }
+
+    void RenderGraph::Execute(Profiler& profiler) {
+        for (size_t i = 0; i < order.size(); i++) {
+            ProfilerScope scope(profiler, passes[order[i]].name);
+            passes[order[i]].execute();
+        }
+    }
+
+    GLuint RenderGraph::getTexture(int resource) const {
+        return resources[resource].object;
+    }
+
+    bool RenderGraph::isPassCulled(int pass) const {
+        return passes[pass].culled;
+    }
+
+    size_t RenderGraph::getTransientMemory() const {
+        size_t bytes = 0;
+        for (size_t i = 0; i < pool.size(); i++) {
+            GLenum format, type;
+            int texelSize;
+            getTextureFormat(pool[i].desc.internalFormat, format, type, texelSize);
+            bytes += (size_t)pool[i].desc.width * pool[i].desc.height * std::max(pool[i].desc.layers, 1) * texelSize;
+        }
+        return bytes;
+    }
+
+    static void printResources(std::ostream& out, const char* label, const std::vector<int>& list,
+                               const std::vector<const char*>& names) {
+        out << "  " << label;
+        for (size_t i = 0; i < list.size(); i++)
+            out << (i == 0 ? " " : ", ") << names[list[i]];
+        if (list.empty())
+            out << " -";
+    }
+
+    void RenderGraph::Print(std::ostream& out) const {
+        std::vector<const char*> names(resources.size());
+        for (size_t r = 0; r < resources.size(); r++)
+            names[r] = resources[r].name;
+
+        std::vector<int> listed = order;
+        for (int p = 0; p < (int)passes.size(); p++) {
+            if (passes[p].culled)
+                listed.push_back(p);
+        }
+        for (size_t i = 0; i < listed.size(); i++) {
+            const Pass& pass = passes[listed[i]];
+            out << std::left << std::setw(18) << pass.name << std::right << (pass.culled ? " culled  " : "         ");
+            printResources(out, "reads", pass.reads, names);
+            printResources(out, "writes", pass.writes, names);
+            out << std::endl;
+        }
+        out << pool.size() << " transient textures, " << getTransientMemory() / (1024 * 1024) << " MiB" << std::endl;
+    }
+
+}
@@ -0,0 +1,112 @@
+#ifndef RenderGraph_hpp
+#define RenderGraph_hpp
+
+#include <GL/glew.h>
+
+#include "Profiler.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <vector>
+
+namespace gps {
+
+    //texture the graph allocates for the frame it is declared in
+    struct TransientTextureDesc {
+        //GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY
+        GLenum target;
+        GLenum internalFormat;
+        int width;
+        int height;
+        int layers;
+    };
+
+    //the passes of a frame, declared again every frame with the resources they read and write. Compile runs them
+    //writers before readers, drops the passes nothing reads the results of and lets transient textures whose
+    //lifetimes do not overlap share one GL texture
+    class RenderGraph
+    {
+    public:
+        typedef std::function<void()> PassFunction;
+
+        //pooled textures no frame used for this many frames are deleted
+        static const int MAX_IDLE_FRAMES = 120;
+
+        RenderGraph();
+
+        //forgets the passes and the resources of the last frame, the pooled textures are kept
+        void Reset();
+
+        //resource living outside the graph (the window framebuffer, a buffer kept across frames...), object is
+        //what getTexture returns for it
+        int ImportResource(const char* name, GLuint object = 0);
+        //the texture is only valid inside the passes of this frame, its contents are undefined when the first
+        //pass writing it starts
+        int CreateTexture(const char* name, const TransientTextureDesc& desc);
+        //the passes writing an output are never culled
+        void MarkOutput(int resource);
+
+        int AddPass(const char* name, const PassFunction& execute);
+        void Read(int pass, int resource);
+        //a pass reading what it writes is ordered after the passes declared before it writing the same resource
+        void Write(int pass, int resource);
+
+        //orders and culls the passes and assigns the transient textures
+        void Compile();
+        //runs the passes left by Compile, each one timed as a profiler pass of its name
+        void Execute(Profiler& profiler);
+
+        //valid from Compile on
+        GLuint getTexture(int resource) const;
+        bool isPassCulled(int pass) const;
+        //bytes held by the texture pool
+        size_t getTransientMemory() const;
+        //the passes in the order they ran and the culled ones, with what they read and write
+        void Print(std::ostream& out) const;
+
+    private:
+        struct Resource {
+            const char* name;
+            bool transient;
+            bool output;
+            TransientTextureDesc desc;
+            //imported object or pooled texture
+            GLuint object;
+        };
+
+        struct Pass {
+            const char* name;
+            PassFunction execute;
+            std::vector<int> reads;
+            std::vector<int> writes;
+            bool culled;
+        };
+
+        struct PooledTexture {
+            TransientTextureDesc desc;
+            GLuint texture;
+            //the last pass (in execution order) of the resource using the texture this frame, -1 while free
+            int busyUntil;
+            int lastUsedFrame;
+        };
+
+        std::vector<Resource> resources;
+        std::vector<Pass> passes;
+        //indices of the passes left by Compile, in execution order
+        std::vector<int> order;
+        std::vector<PooledTexture> pool;
+        int frameIndex;
+        bool cycleReported;
+
+        void SortPasses();
+        void CullPasses();
+        void AssignTextures();
+        GLuint AcquireTexture(const Resource& resource, int firstPass, int lastPass);
+        bool isReadBy(int resource, const Pass& pass) const;
+        bool isWrittenBy(int resource, const Pass& pass) const;
+    };
+
+}
+
+#endif /* RenderGraph_hpp */
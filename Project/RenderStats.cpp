@@ -0,0 +1,33 @@
+#include "RenderStats.hpp"
+
+namespace gps {
+
+    FrameStats RenderStats::current = FrameStats();
+    FrameStats RenderStats::last = FrameStats();
+
+    void RenderStats::EndFrame() {
+        last = current;
+        current = FrameStats();
+    }
+
+    const FrameStats& RenderStats::getLastFrame() {
+        return last;
+    }
+
+    bool RenderStats::isEnabled() {
+        return GPS_GL_STATS != 0;
+    }
+
+    void RenderStats::Print(std::ostream& out, const FrameStats& stats) {
+        if (!isEnabled()) {
+            out << "GL call counters are compiled out (GPS_GL_STATS=0)" << std::endl;
+            return;
+        }
+        out << stats.drawCalls << " draw calls, " << stats.triangles << " triangles, "
+            << stats.programBinds << " program binds, " << stats.textureBinds << " texture binds, "
+            << stats.uniformUploads << " uniform uploads, " << stats.bufferUploads << " buffer uploads ("
+            << stats.bufferUploadBytes / 1024 << " KiB), " << stats.bufferCopies << " buffer copies ("
+            << stats.bufferCopyBytes / 1024 << " KiB)" << std::endl;
+    }
+
+}
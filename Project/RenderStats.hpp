@@ -0,0 +1,233 @@
+#ifndef RenderStats_hpp
+#define RenderStats_hpp
+
+#include <GL/glew.h>
+
+#include <ostream>
+
+//the counting wrappers are compiled in unless GPS_GL_STATS is defined to 0
+#ifndef GPS_GL_STATS
+#define GPS_GL_STATS 1
+#endif
+
+namespace gps {
+
+    //what the renderer asked of GL in one frame
+    struct FrameStats {
+        int drawCalls;
+        //of the draws with a vertex count known on the cpu, a multi draw indirect adds none
+        long long triangles;
+        int programBinds;
+        int textureBinds;
+        int uniformUploads;
+        int bufferUploads;
+        long long bufferUploadBytes;
+        //gpu side copies between buffers, what is written through a mapped buffer only shows here
+        int bufferCopies;
+        long long bufferCopyBytes;
+    };
+
+    //interception layer: a file including this header after the other GL headers has the GL calls below replaced by
+    //wrappers that count them in RenderStats::current. every file of the renderer that draws or sets state per frame
+    //includes it
+    class RenderStats
+    {
+    public:
+        //the frame being drawn
+        static FrameStats current;
+
+        //moves current to the last frame and starts counting a new one
+        static void EndFrame();
+        static const FrameStats& getLastFrame();
+        //false when the wrappers are compiled out, the counters then stay 0
+        static bool isEnabled();
+        static void Print(std::ostream& out, const FrameStats& stats);
+
+    private:
+        static FrameStats last;
+    };
+
+#if GPS_GL_STATS
+    namespace gl {
+
+        inline long long countTriangles(GLenum mode, GLsizei count) {
+            if (mode == GL_TRIANGLES)
+                return count / 3;
+            if ((mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN) && count > 2)
+                return count - 2;
+            return 0;
+        }
+
+        inline void DrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices) {
+            RenderStats::current.drawCalls++;
+            RenderStats::current.triangles += countTriangles(mode, count);
+            glDrawElements(mode, count, type, indices);
+        }
+
+        inline void DrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instanceCount) {
+            RenderStats::current.drawCalls++;
+            RenderStats::current.triangles += countTriangles(mode, count) * instanceCount;
+            glDrawElementsInstanced(mode, count, type, indices, instanceCount);
+        }
+
+        inline void DrawArrays(GLenum mode, GLint first, GLsizei count) {
+            RenderStats::current.drawCalls++;
+            RenderStats::current.triangles += countTriangles(mode, count);
+            glDrawArrays(mode, first, count);
+        }
+
+        inline void DrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instanceCount) {
+            RenderStats::current.drawCalls++;
+            RenderStats::current.triangles += countTriangles(mode, count) * instanceCount;
+            glDrawArraysInstanced(mode, first, count, instanceCount);
+        }
+
+        inline void MultiDrawElementsIndirect(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride) {
+            RenderStats::current.drawCalls++;
+            glMultiDrawElementsIndirect(mode, type, indirect, drawCount, stride);
+        }
+
+        inline void UseProgram(GLuint program) {
+            RenderStats::current.programBinds++;
+            glUseProgram(program);
+        }
+
+        inline void BindTexture(GLenum target, GLuint texture) {
+            RenderStats::current.textureBinds++;
+            glBindTexture(target, texture);
+        }
+
+        inline void BufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage) {
+            RenderStats::current.bufferUploads++;
+            RenderStats::current.bufferUploadBytes += size;
+            glBufferData(target, size, data, usage);
+        }
+
+        inline void BufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data) {
+            RenderStats::current.bufferUploads++;
+            RenderStats::current.bufferUploadBytes += size;
+            glBufferSubData(target, offset, size, data);
+        }
+
+        inline void CopyBufferSubData(GLenum readTarget, GLenum writeTarget, GLintptr readOffset, GLintptr writeOffset,
+                                      GLsizeiptr size) {
+            RenderStats::current.bufferCopies++;
+            RenderStats::current.bufferCopyBytes += size;
+            glCopyBufferSubData(readTarget, writeTarget, readOffset, writeOffset, size);
+        }
+
+        inline void Uniform1i(GLint location, GLint v0) {
+            RenderStats::current.uniformUploads++;
+            glUniform1i(location, v0);
+        }
+
+        inline void Uniform1ui(GLint location, GLuint v0) {
+            RenderStats::current.uniformUploads++;
+            glUniform1ui(location, v0);
+        }
+
+        inline void Uniform1f(GLint location, GLfloat v0) {
+            RenderStats::current.uniformUploads++;
+            glUniform1f(location, v0);
+        }
+
+        inline void Uniform1fv(GLint location, GLsizei count, const GLfloat* value) {
+            RenderStats::current.uniformUploads++;
+            glUniform1fv(location, count, value);
+        }
+
+        inline void Uniform2f(GLint location, GLfloat v0, GLfloat v1) {
+            RenderStats::current.uniformUploads++;
+            glUniform2f(location, v0, v1);
+        }
+
+        inline void Uniform3i(GLint location, GLint v0, GLint v1, GLint v2) {
+            RenderStats::current.uniformUploads++;
+            glUniform3i(location, v0, v1, v2);
+        }
+
+        inline void Uniform3iv(GLint location, GLsizei count, const GLint* value) {
+            RenderStats::current.uniformUploads++;
+            glUniform3iv(location, count, value);
+        }
+
+        inline void Uniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2) {
+            RenderStats::current.uniformUploads++;
+            glUniform3f(location, v0, v1, v2);
+        }
+
+        inline void Uniform3fv(GLint location, GLsizei count, const GLfloat* value) {
+            RenderStats::current.uniformUploads++;
+            glUniform3fv(location, count, value);
+        }
+
+        inline void Uniform4fv(GLint location, GLsizei count, const GLfloat* value) {
+            RenderStats::current.uniformUploads++;
+            glUniform4fv(location, count, value);
+        }
+
+        inline void UniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) {
+            RenderStats::current.uniformUploads++;
+            glUniformMatrix3fv(location, count, transpose, value);
+        }
+
+        inline void UniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) {
+            RenderStats::current.uniformUploads++;
+            glUniformMatrix4fv(location, count, transpose, value);
+        }
+
+    }
+#endif
+
+}
+
+#if GPS_GL_STATS
+//GLEW defines most entry points as macros of its function pointers, they are replaced after the wrappers above have
+//been compiled with the real ones
+#undef glDrawElements
+#undef glDrawElementsInstanced
+#undef glDrawArrays
+#undef glDrawArraysInstanced
+#undef glMultiDrawElementsIndirect
+#undef glUseProgram
+#undef glBindTexture
+#undef glBufferData
+#undef glBufferSubData
+#undef glCopyBufferSubData
+#undef glUniform1i
+#undef glUniform1ui
+#undef glUniform1f
+#undef glUniform1fv
+#undef glUniform2f
+#undef glUniform3i
+#undef glUniform3iv
+#undef glUniform3f
+#undef glUniform3fv
+#undef glUniform4fv
+#undef glUniformMatrix3fv
+#undef glUniformMatrix4fv
+#define glDrawElements gps::gl::DrawElements
+#define glDrawElementsInstanced gps::gl::DrawElementsInstanced
+#define glDrawArrays gps::gl::DrawArrays
+#define glDrawArraysInstanced gps::gl::DrawArraysInstanced
+#define glMultiDrawElementsIndirect gps::gl::MultiDrawElementsIndirect
+#define glUseProgram gps::gl::UseProgram
+#define glBindTexture gps::gl::BindTexture
+#define glBufferData gps::gl::BufferData
+#define glBufferSubData gps::gl::BufferSubData
+#define glCopyBufferSubData gps::gl::CopyBufferSubData
+#define glUniform1i gps::gl::Uniform1i
+#define glUniform1ui gps::gl::Uniform1ui
+#define glUniform1f gps::gl::Uniform1f
+#define glUniform1fv gps::gl::Uniform1fv
+#define glUniform2f gps::gl::Uniform2f
+#define glUniform3i gps::gl::Uniform3i
+#define glUniform3iv gps::gl::Uniform3iv
+#define glUniform3f gps::gl::Uniform3f
+#define glUniform3fv gps::gl::Uniform3fv
+#define glUniform4fv gps::gl::Uniform4fv
+#define glUniformMatrix3fv gps::gl::UniformMatrix3fv
+#define glUniformMatrix4fv gps::gl::UniformMatrix4fv
+#endif
+
+#endif /* RenderStats_hpp */
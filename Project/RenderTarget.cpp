@@ -0,0 +1,70 @@
+#include "RenderTarget.hpp"
+
+#include <cstddef>
+
+namespace gps {
+
+    RenderTarget::RenderTarget() {
+        this->framebuffer = 0;
+        this->colorTexture = 0;
+        this->depthRenderbuffer = 0;
+        this->width = 0;
+        this->height = 0;
+    }
+
+    bool RenderTarget::Create(int width, int height) {
+        this->width = width;
+        this->height = height;
+
+        glGenTextures(1, &colorTexture);
+        glBindTexture(GL_TEXTURE_2D, colorTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenRenderbuffers(1, &depthRenderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return status == GL_FRAMEBUFFER_COMPLETE;
+    }
+
+    void RenderTarget::Delete() {
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(1, &depthRenderbuffer);
+        glDeleteTextures(1, &colorTexture);
+        framebuffer = 0;
+        depthRenderbuffer = 0;
+        colorTexture = 0;
+    }
+
+    void RenderTarget::Bind() const {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, width, height);
+    }
+
+    GLuint RenderTarget::getFramebuffer() const {
+        return framebuffer;
+    }
+
+    GLuint RenderTarget::getColorTexture() const {
+        return colorTexture;
+    }
+
+    int RenderTarget::getWidth() const {
+        return width;
+    }
+
+    int RenderTarget::getHeight() const {
+        return height;
+    }
+
+}
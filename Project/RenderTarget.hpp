@@ -0,0 +1,37 @@
+#ifndef RenderTarget_hpp
+#define RenderTarget_hpp
+
+#include <GL/glew.h>
+
+namespace gps {
+
+    //framebuffer object with an sRGB color texture and a 24 bit depth, 8 bit stencil renderbuffer, the same formats as
+    //the window so that the passes blitting from the window depth work on it unchanged
+    class RenderTarget
+    {
+    public:
+        RenderTarget();
+
+        //returns false if the driver reports the framebuffer incomplete
+        bool Create(int width, int height);
+        void Delete();
+
+        //binds the framebuffer and sets the viewport to all of it
+        void Bind() const;
+
+        GLuint getFramebuffer() const;
+        GLuint getColorTexture() const;
+        int getWidth() const;
+        int getHeight() const;
+
+    private:
+        GLuint framebuffer;
+        GLuint colorTexture;
+        GLuint depthRenderbuffer;
+        int width;
+        int height;
+    };
+
+}
+
+#endif /* RenderTarget_hpp */
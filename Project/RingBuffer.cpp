@@ -0,0 +1,149 @@
+#include "RingBuffer.hpp"
+#include "GLDebug.hpp"
+#include "RenderStats.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+    //the parts start on this boundary, a multiple of every texel size and of the buffer offset alignments
+    const size_t PART_ALIGNMENT = 256;
+    //a fence is waited for in steps of this many nanoseconds until it signals
+    const GLuint64 FENCE_WAIT_TIMEOUT = 1000000000;
+
+    RingBuffer::RingBuffer() : used(0), requested(0) {
+        this->buffer = 0;
+        this->persistent = false;
+        this->label = "ring buffer";
+        this->frameSize = 0;
+        this->frame = 0;
+        this->mapped = NULL;
+        this->flushed = 0;
+        for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+            this->fences[i] = NULL;
+    }
+
+    void RingBuffer::Create(size_t frameSize, bool persistent, const char* label) {
+        this->persistent = persistent && GLEW_ARB_buffer_storage;
+        this->label = label;
+        this->frameSize = (std::max(frameSize, (size_t)1) + PART_ALIGNMENT - 1) / PART_ALIGNMENT * PART_ALIGNMENT;
+        this->frame = 0;
+        CreateBuffer();
+    }
+
+    void RingBuffer::CreateBuffer() {
+        GLsizeiptr size = (GLsizeiptr)(frameSize * FRAMES_IN_FLIGHT);
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        if (persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+            mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+            if (mapped == NULL) {
+                //immutable storage cannot be specified again, the fallback gets a buffer of its own
+                glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+                glDeleteBuffers(1, &buffer);
+                persistent = false;
+                CreateBuffer();
+                return;
+            }
+        } else {
+            glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW);
+            staging.resize(frameSize);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        GLDebug::LabelObject(GL_BUFFER, buffer, label);
+    }
+
+    //GL keeps the buffer alive until the commands reading it are done
+    void RingBuffer::DeleteBuffer() {
+        if (mapped != NULL) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            mapped = NULL;
+        }
+        if (buffer != 0)
+            glDeleteBuffers(1, &buffer);
+        buffer = 0;
+        for (int i = 0; i < FRAMES_IN_FLIGHT; i++) {
+            if (fences[i] != NULL)
+                glDeleteSync(fences[i]);
+            fences[i] = NULL;
+        }
+    }
+
+    void RingBuffer::Delete() {
+        DeleteBuffer();
+        std::vector<unsigned char>().swap(staging);
+    }
+
+    void RingBuffer::BeginFrame(size_t minimumFrameSize) {
+        //signals once the gpu has run every command issued so far, the ones reading the part of the last frame
+        if (persistent)
+            fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        size_t needed = std::max(minimumFrameSize, requested.load());
+        if (needed > frameSize) {
+            while (frameSize < needed)
+                frameSize *= 2;
+            DeleteBuffer();
+            CreateBuffer();
+        }
+
+        frame = (frame + 1) % FRAMES_IN_FLIGHT;
+        if (fences[frame] != NULL) {
+            GLenum result;
+            do {
+                result = glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_WAIT_TIMEOUT);
+            } while (result == GL_TIMEOUT_EXPIRED);
+            glDeleteSync(fences[frame]);
+            fences[frame] = NULL;
+        }
+        used = 0;
+        requested = 0;
+        flushed = 0;
+    }
+
+    void* RingBuffer::Allocate(size_t size, size_t alignment, size_t& offset) {
+        requested.fetch_add(size + alignment - 1);
+        size_t current = used.load();
+        size_t start;
+        do {
+            start = (current + alignment - 1) / alignment * alignment;
+            if (start + size > frameSize)
+                return NULL;
+        } while (!used.compare_exchange_weak(current, start + size));
+
+        offset = frame * frameSize + start;
+        if (persistent)
+            return mapped + offset;
+        return &staging[start];
+    }
+
+    void RingBuffer::Flush() {
+        //the mapping is coherent, the writes are seen by every command issued after them
+        if (persistent)
+            return;
+        size_t end = used.load();
+        if (end > flushed) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, frame * frameSize + flushed, end - flushed, &staging[flushed]);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            flushed = end;
+        }
+    }
+
+    GLuint RingBuffer::getBuffer() const {
+        return buffer;
+    }
+
+    bool RingBuffer::isPersistent() const {
+        return persistent;
+    }
+
+    size_t RingBuffer::getFrameSize() const {
+        return frameSize;
+    }
+
+}
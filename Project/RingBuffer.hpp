@@ -0,0 +1,63 @@
+#ifndef RingBuffer_hpp
+#define RingBuffer_hpp
+
+#include <GL/glew.h>
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    //one buffer object split in a part per frame in flight, the data changing every frame is written into the part of
+    //the frame with memcpy. with ARB_buffer_storage (OpenGL 4.4) the buffer stays mapped and a fence per part tells
+    //when the gpu is done with it; on 4.1 the writes go to memory of the cpu and Flush uploads them with
+    //glBufferSubData
+    class RingBuffer
+    {
+    public:
+        static const int FRAMES_IN_FLIGHT = 3;
+
+        RingBuffer();
+
+        //frameSize bytes for every frame in flight, persistent selects the mapped buffer when the driver has it
+        void Create(size_t frameSize, bool persistent, const char* label);
+        void Delete();
+
+        //moves to the part of the next frame, waiting for the gpu to be done with what was written there
+        //FRAMES_IN_FLIGHT frames ago. the parts grow to minimumFrameSize and to what the last frame asked for, a new
+        //buffer object is made then
+        void BeginFrame(size_t minimumFrameSize = 0);
+        //room for size bytes starting at a multiple of alignment, offset is where in the buffer they will be read;
+        //NULL when the part of the frame is full. safe to call from any thread
+        void* Allocate(size_t size, size_t alignment, size_t& offset);
+        //the writes since the last Flush are read by the commands issued after it, nothing to do when mapped
+        void Flush();
+
+        GLuint getBuffer() const;
+        bool isPersistent() const;
+        size_t getFrameSize() const;
+
+    private:
+        GLuint buffer;
+        bool persistent;
+        const char* label;
+        size_t frameSize;
+        //part of the frame being written
+        int frame;
+        //the persistent mapping of the whole buffer, or the writes of the frame before Flush uploads them
+        unsigned char* mapped;
+        std::vector<unsigned char> staging;
+        GLsync fences[FRAMES_IN_FLIGHT];
+        std::atomic<size_t> used;
+        //bytes asked for this frame, the allocations that did not fit included
+        std::atomic<size_t> requested;
+        size_t flushed;
+
+        void CreateBuffer();
+        void DeleteBuffer();
+    };
+
+}
+
+#endif /* RingBuffer_hpp */
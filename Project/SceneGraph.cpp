@@ -0,0 +1,82 @@
+#include "SceneGraph.hpp"
+
+#include <glm/gtc/matrix_inverse.hpp>
+
+namespace gps {
+
+    SceneGraph::SceneGraph() {
+        this->updatedCount = 0;
+    }
+
+    int SceneGraph::AddNode(int parent, const glm::mat4& localTransform) {
+        int node = (int)parents.size();
+        parents.push_back(parent);
+        localTransforms.push_back(localTransform);
+        worldTransforms.push_back(localTransform);
+        normalMatrices.push_back(glm::mat3(1.0f));
+        dirty.push_back(true);
+        updated.push_back(false);
+        return node;
+    }
+
+    void SceneGraph::Clear() {
+        parents.clear();
+        localTransforms.clear();
+        worldTransforms.clear();
+        normalMatrices.clear();
+        dirty.clear();
+        updated.clear();
+        updatedCount = 0;
+    }
+
+    void SceneGraph::SetLocalTransform(int node, const glm::mat4& localTransform) {
+        if (localTransforms[node] == localTransform)
+            return;
+        localTransforms[node] = localTransform;
+        dirty[node] = true;
+    }
+
+    void SceneGraph::Update() {
+        updatedCount = 0;
+        //the parent of a node comes first, it is already up to date when its children are reached
+        for (size_t i = 0; i < parents.size(); i++) {
+            int parent = parents[i];
+            updated[i] = dirty[i] || (parent >= 0 && updated[parent]);
+            if (!updated[i])
+                continue;
+            worldTransforms[i] = parent >= 0 ? worldTransforms[parent] * localTransforms[i] : localTransforms[i];
+            normalMatrices[i] = glm::inverseTranspose(glm::mat3(worldTransforms[i]));
+            dirty[i] = false;
+            updatedCount++;
+        }
+    }
+
+    const glm::mat4& SceneGraph::getLocalTransform(int node) const {
+        return localTransforms[node];
+    }
+
+    const glm::mat4& SceneGraph::getWorldTransform(int node) const {
+        return worldTransforms[node];
+    }
+
+    const glm::mat3& SceneGraph::getNormalMatrix(int node) const {
+        return normalMatrices[node];
+    }
+
+    bool SceneGraph::isUpdated(int node) const {
+        return updated[node];
+    }
+
+    int SceneGraph::getParent(int node) const {
+        return parents[node];
+    }
+
+    int SceneGraph::getNodeCount() const {
+        return (int)parents.size();
+    }
+
+    int SceneGraph::getUpdatedCount() const {
+        return updatedCount;
+    }
+
+}
@@ -0,0 +1,52 @@
+#ifndef SceneGraph_hpp
+#define SceneGraph_hpp
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace gps {
+
+    //tree of transforms: every node is placed by its local transform in the space of its parent. the world and normal
+    //matrices are cached and only recomputed by Update for the nodes whose local transform, or the one of an ancestor,
+    //changed since the last Update
+    class SceneGraph
+    {
+    public:
+        SceneGraph();
+
+        //adds a node under parent, -1 for a root, and returns its id; ids are consecutive starting from 0 and a parent
+        //is always added before its children
+        int AddNode(int parent, const glm::mat4& localTransform);
+        void Clear();
+
+        //the node and its subtree are recomputed by the next Update, unless transform is the one it already has
+        void SetLocalTransform(int node, const glm::mat4& localTransform);
+        //recomputes the world and normal matrices of the dirty nodes and their descendants, in one pass over the nodes
+        void Update();
+
+        const glm::mat4& getLocalTransform(int node) const;
+        const glm::mat4& getWorldTransform(int node) const;
+        //inverse transpose of the upper 3x3 part of the world transform, moves the normals to world space
+        const glm::mat3& getNormalMatrix(int node) const;
+        //true when the last Update recomputed the node
+        bool isUpdated(int node) const;
+        int getParent(int node) const;
+        int getNodeCount() const;
+        //nodes recomputed by the last Update
+        int getUpdatedCount() const;
+
+    private:
+        //one entry per node, parents before their children
+        std::vector<int> parents;
+        std::vector<glm::mat4> localTransforms;
+        std::vector<glm::mat4> worldTransforms;
+        std::vector<glm::mat3> normalMatrices;
+        std::vector<bool> dirty;
+        std::vector<bool> updated;
+        int updatedCount;
+    };
+
+}
+
+#endif /* SceneGraph_hpp */
@@ -1,6 +1,27 @@
 #include "Shader.hpp"
+#include "RenderStats.hpp"
+
+#include <cstdio>
+#include <vector>
 
 namespace gps {
+
+    //program binaries are kept next to the shader sources
+    const char* PROGRAM_BINARY_PREFIX = "shaders/binary_";
+    const char PROGRAM_BINARY_MAGIC[4] = { 'G', 'P', 'S', 'B' };
+
+    //FNV-1a
+    static void hashString(unsigned long long& hash, const std::string& value)
+    {
+        for (size_t i = 0; i < value.size(); i++) {
+            hash ^= (unsigned char)value[i];
+            hash *= 1099511628211ULL;
+        }
+        //separator, so that moving text from one string to the next changes the hash
+        hash ^= 0xff;
+        hash *= 1099511628211ULL;
+    }
+
     std::string Shader::readShaderFile(std::string fileName)
     {
         std::ifstream shaderFile;
@@ -36,7 +57,7 @@ namespace gps {
         }
     }
 
-    void Shader::shaderLinkLog(GLuint shaderProgramId)
+    GLint Shader::shaderLinkLog(GLuint shaderProgramId)
     {
         GLint success;
         GLchar infoLog[512];
@@ -44,40 +65,265 @@ namespace gps {
         //check linking info
         glGetProgramiv(shaderProgramId, GL_LINK_STATUS, &success);
         if(!success) {
-            glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
+            glGetProgramInfoLog(shaderProgramId, 512, NULL, infoLog);
             std::cout << "Shader linking error\n" << infoLog << std::endl;
         }
+        return success;
     }
 
-    void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName)
+    std::string Shader::getProgramBinaryFileName(const std::string& vertexSource, const std::string& fragmentSource)
     {
-        //read, parse and compile the vertex shader
-        std::string v = readShaderFile(vertexShaderFileName);
-        const GLchar* vertexShaderString = v.c_str();
+        //a binary is only valid for the driver that made it, an update of the driver changes its version string
+        unsigned long long hash = 14695981039346656037ULL;
+        hashString(hash, (const char*)glGetString(GL_VENDOR));
+        hashString(hash, (const char*)glGetString(GL_RENDERER));
+        hashString(hash, (const char*)glGetString(GL_VERSION));
+        hashString(hash, vertexSource);
+        hashString(hash, fragmentSource);
+
+        char name[17];
+        snprintf(name, sizeof(name), "%016llx", hash);
+        return std::string(PROGRAM_BINARY_PREFIX) + name + ".bin";
+    }
+
+    GLuint Shader::loadProgramBinary(const std::string& fileName)
+    {
+        std::ifstream file(fileName.c_str(), std::ios::binary);
+        if (!file)
+            return 0;
+
+        char magic[4];
+        GLenum format;
+        GLint length;
+        file.read(magic, sizeof(magic));
+        file.read((char*)&format, sizeof(format));
+        file.read((char*)&length, sizeof(length));
+        if (!file || std::string(magic, 4) != std::string(PROGRAM_BINARY_MAGIC, 4) || length <= 0)
+            return 0;
+        std::vector<char> binary(length);
+        file.read(&binary[0], length);
+        if (!file)
+            return 0;
+
+        //the driver may still refuse it, then the program is compiled from source again
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, format, &binary[0], length);
+        GLint success;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    void Shader::saveProgramBinary(GLuint program, const std::string& fileName)
+    {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(length);
+        GLenum format;
+        glGetProgramBinary(program, length, &length, &format, &binary[0]);
+
+        std::ofstream file(fileName.c_str(), std::ios::binary);
+        file.write(PROGRAM_BINARY_MAGIC, sizeof(PROGRAM_BINARY_MAGIC));
+        file.write((const char*)&format, sizeof(format));
+        file.write((const char*)&length, sizeof(length));
+        file.write(&binary[0], length);
+    }
+
+    Shader::Shader()
+    {
+        this->shaderProgram = 0;
+        this->features = 0;
+    }
+
+    //programs whose compile and link have been submitted but whose status has not been read yet; reading it waits for
+    //the driver, so it is left until the program is asked for with isReady or waitUntilReady
+    struct PendingProgram {
+        GLuint vertexShader;
+        GLuint fragmentShader;
+        std::string binaryFileName;
+    };
+    static std::map<GLuint, PendingProgram> pendingPrograms;
+
+    //with KHR_parallel_shader_compile the driver compiles on its own threads and the completion of a program can be
+    //polled without waiting for it
+    static bool isParallelCompileSupported()
+    {
+#ifdef GL_KHR_parallel_shader_compile
+        return GLEW_KHR_parallel_shader_compile != 0;
+#else
+        return false;
+#endif
+    }
+
+    GLuint Shader::createProgram(const std::string& vertexSource, const std::string& fragmentSource)
+    {
+        std::string binaryFileName = getProgramBinaryFileName(vertexSource, fragmentSource);
+        GLuint binaryProgram = loadProgramBinary(binaryFileName);
+        if (binaryProgram != 0)
+            return binaryProgram;
+
+#ifdef GL_KHR_parallel_shader_compile
+        static bool compilerThreadsSet = false;
+        if (!compilerThreadsSet && isParallelCompileSupported()) {
+            //as many threads as the driver wants
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+            compilerThreadsSet = true;
+        }
+#endif
+
+        //parse and compile the vertex shader
+        const GLchar* vertexShaderString = vertexSource.c_str();
         GLuint vertexShader;
         vertexShader = glCreateShader(GL_VERTEX_SHADER);
         glShaderSource(vertexShader, 1, &vertexShaderString, NULL);
         glCompileShader(vertexShader);
-        //check compilation status
-        shaderCompileLog(vertexShader);
 
-        //read, parse and compile the vertex shader
-        std::string f = readShaderFile(fragmentShaderFileName);
-        const GLchar* fragmentShaderString = f.c_str();
+        //parse and compile the fragment shader
+        const GLchar* fragmentShaderString = fragmentSource.c_str();
         GLuint fragmentShader;
         fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
         glShaderSource(fragmentShader, 1, &fragmentShaderString, NULL);
         glCompileShader(fragmentShader);
+
+        //attach and link the shader programs, the status is checked by finishProgram
+        GLuint program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(program);
+
+        PendingProgram pending;
+        pending.vertexShader = vertexShader;
+        pending.fragmentShader = fragmentShader;
+        pending.binaryFileName = binaryFileName;
+        pendingPrograms[program] = pending;
+        return program;
+    }
+
+    void Shader::finishProgram(GLuint program)
+    {
+        std::map<GLuint, PendingProgram>::iterator found = pendingPrograms.find(program);
+        if (found == pendingPrograms.end())
+            return;
+        PendingProgram pending = found->second;
+        pendingPrograms.erase(found);
+
+        //check compilation status
+        shaderCompileLog(pending.vertexShader);
+        shaderCompileLog(pending.fragmentShader);
+        //check linking info
+        if (shaderLinkLog(program))
+            saveProgramBinary(program, pending.binaryFileName);
+        glDetachShader(program, pending.vertexShader);
+        glDetachShader(program, pending.fragmentShader);
+        glDeleteShader(pending.vertexShader);
+        glDeleteShader(pending.fragmentShader);
+    }
+
+    bool Shader::isReady()
+    {
+        if (pendingPrograms.find(this->shaderProgram) == pendingPrograms.end())
+            return true;
+        if (isParallelCompileSupported()) {
+#ifdef GL_KHR_parallel_shader_compile
+            GLint completed = GL_FALSE;
+            glGetProgramiv(this->shaderProgram, GL_COMPLETION_STATUS_KHR, &completed);
+            if (!completed)
+                return false;
+#endif
+        }
+        //without the extension there is no way to ask, reading the status waits for the program
+        finishProgram(this->shaderProgram);
+        return true;
+    }
+
+    void Shader::waitUntilReady()
+    {
+        finishProgram(this->shaderProgram);
+    }
+
+    void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName)
+    {
+        //read the vertex and fragment shaders
+        std::string v = readShaderFile(vertexShaderFileName);
+        std::string f = readShaderFile(fragmentShaderFileName);
+        this->shaderProgram = createProgram(v, f);
+    }
+
+    std::string Shader::addFeatureDefines(const std::string& source, unsigned int features)
+    {
+        static const char* featureNames[SHADER_FEATURE_COUNT] = { "POINT_LIGHTS", "FOG", "SHADOWS", "TEXTURED", "TEXTURE_ARRAYS" };
+
+        std::string defines;
+        for (int i = 0; i < SHADER_FEATURE_COUNT; i++) {
+            if ((features & (1u << i)) != 0)
+                defines += std::string("#define ") + featureNames[i] + "\n";
+        }
+
+        //the defines go right after #version, #line keeps the line numbers of the compile errors
+        size_t versionLine = source.find("#version");
+        size_t lineEnd = versionLine == std::string::npos ? std::string::npos : source.find('\n', versionLine);
+        if (lineEnd == std::string::npos)
+            return defines + source;
+        return source.substr(0, lineEnd + 1) + defines + "#line 2\n" + source.substr(lineEnd + 1);
+    }
+
+    void Shader::loadShaderVariants(std::string vertexShaderFileName, std::string fragmentShaderFileName)
+    {
+        this->variants = std::make_shared<Variants>();
+        this->variants->vertexSource = readShaderFile(vertexShaderFileName);
+        this->variants->fragmentSource = readShaderFile(fragmentShaderFileName);
+        *this = getVariant(0);
+    }
+
+    Shader Shader::getVariant(unsigned int features)
+    {
+        Shader variant = *this;
+        variant.features = features;
+
+        std::map<unsigned int, GLuint>::iterator found = variants->programs.find(features);
+        if (found != variants->programs.end()) {
+            variant.shaderProgram = found->second;
+        } else {
+            variant.shaderProgram = createProgram(addFeatureDefines(variants->vertexSource, features),
+                                                  addFeatureDefines(variants->fragmentSource, features));
+            variants->programs[features] = variant.shaderProgram;
+        }
+        return variant;
+    }
+
+    unsigned int Shader::getFeatures() const
+    {
+        return this->features;
+    }
+
+    int Shader::getVariantCount() const
+    {
+        return variants ? (int)variants->programs.size() : 0;
+    }
+
+    void Shader::loadComputeShader(std::string computeShaderFileName)
+    {
+        //read, parse and compile the compute shader
+        std::string c = readShaderFile(computeShaderFileName);
+        const GLchar* computeShaderString = c.c_str();
+        GLuint computeShader;
+        computeShader = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(computeShader, 1, &computeShaderString, NULL);
+        glCompileShader(computeShader);
         //check compilation status
-        shaderCompileLog(fragmentShader);
+        shaderCompileLog(computeShader);
 
-        //attach and link the shader programs
+        //attach and link the shader program
         this->shaderProgram = glCreateProgram();
-        glAttachShader(this->shaderProgram, vertexShader);
-        glAttachShader(this->shaderProgram, fragmentShader);
+        glAttachShader(this->shaderProgram, computeShader);
         glLinkProgram(this->shaderProgram);
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
+        glDeleteShader(computeShader);
         //check linking info
         shaderLinkLog(this->shaderProgram);
     }
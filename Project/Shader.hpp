@@ -8,20 +8,73 @@
 #include <sstream>
 #include <iostream>
 #include <string>
+#include <map>
+#include <memory>
 
 namespace gps {
 
+//feature bits of a shader variant, each one is compiled in as a #define of its name (POINT_LIGHTS, FOG, SHADOWS, TEXTURED,
+//TEXTURE_ARRAYS)
+enum ShaderFeature
+{
+    SHADER_POINT_LIGHTS = 1 << 0,
+    SHADER_FOG = 1 << 1,
+    SHADER_SHADOWS = 1 << 2,
+    //sampled diffuse and specular textures, material colors otherwise
+    SHADER_TEXTURED = 1 << 3,
+    //the textures are layers of GL_TEXTURE_2D_ARRAY objects (Model3D::PackTextureArrays), only used with SHADER_TEXTURED
+    SHADER_TEXTURE_ARRAYS = 1 << 4,
+    SHADER_FEATURE_COUNT = 5
+};
+
 class Shader
 {
 public:
     GLuint shaderProgram;
+    Shader();
     void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
+    //keeps the sources so that variants can be compiled on demand, shaderProgram is the variant without features
+    void loadShaderVariants(std::string vertexShaderFileName, std::string fragmentShaderFileName);
+    //a copy of this shader using the variant with the given ShaderFeature bits, submitted for compiling the first time it
+    //is asked for and cached by its bits; every copy shares the same variants
+    Shader getVariant(unsigned int features);
+    unsigned int getFeatures() const;
+    int getVariantCount() const;
+    //programs are only submitted to the driver when they are loaded, so that several of them compile at once; isReady
+    //polls whether this one has finished without waiting (when the driver has KHR_parallel_shader_compile) and
+    //waitUntilReady waits for it. both report compile and link errors. a program that is used before it is ready works,
+    //the driver waits for it
+    bool isReady();
+    void waitUntilReady();
+    //compute programs need an OpenGL 4.3 context
+    void loadComputeShader(std::string computeShaderFileName);
     void useShaderProgram();
 
 private:
+    struct Variants {
+        std::string vertexSource;
+        std::string fragmentSource;
+        std::map<unsigned int, GLuint> programs;
+    };
+    std::shared_ptr<Variants> variants;
+    unsigned int features;
+
     std::string readShaderFile(std::string fileName);
+    //compiles and links without reading the status, see isReady
+    GLuint createProgram(const std::string& vertexSource, const std::string& fragmentSource);
+    //reads the status of a program from createProgram, saves its binary and deletes its shaders
+    void finishProgram(GLuint program);
+    //adds the #define of every feature after the #version line
+    std::string addFeatureDefines(const std::string& source, unsigned int features);
     void shaderCompileLog(GLuint shaderId);
-    void shaderLinkLog(GLuint shaderProgramId);
+    //returns the link status
+    GLint shaderLinkLog(GLuint shaderProgramId);
+
+    //linked programs are saved with glGetProgramBinary, in a file named after a hash of the sources and of the
+    //driver, and reloaded by later runs; loadProgramBinary returns 0 when there is no file or the driver rejects it
+    std::string getProgramBinaryFileName(const std::string& vertexSource, const std::string& fragmentSource);
+    GLuint loadProgramBinary(const std::string& fileName);
+    void saveProgramBinary(GLuint program, const std::string& fileName);
 };
 
 }
@@ -7,6 +7,8 @@
 //
 
 #include "SkyBox.hpp"
+#include "GLDebug.hpp"
+#include "RenderStats.hpp"
 
 namespace gps {
     
@@ -71,6 +73,7 @@ namespace gps {
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
         glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        GLDebug::LabelObject(GL_TEXTURE, textureID, "skybox");
         
         return textureID;
     }
@@ -132,6 +135,7 @@ namespace gps {
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
         
         glBindVertexArray(0);
+        GLDebug::LabelObject(GL_VERTEX_ARRAY, skyboxVAO, "skybox");
     }
     
     GLuint SkyBox::GetTextureId()
@@ -0,0 +1,142 @@
+#include "TextureArrayPacker.hpp"
+#include "GLDebug.hpp"
+#include "RenderStats.hpp"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <tuple>
+
+namespace gps {
+
+    //the textures are read back as 8 bit RGBA when glCopyImageSubData is missing, as Model3D loads them
+    const size_t BYTES_PER_TEXEL = 4;
+
+    bool TextureArrayPacker::TextureFormat::operator<(const TextureFormat& other) const {
+        return std::tie(width, height, internalFormat, levels, minFilter, magFilter, wrapS, wrapT) <
+               std::tie(other.width, other.height, other.internalFormat, other.levels, other.minFilter, other.magFilter,
+                        other.wrapS, other.wrapT);
+    }
+
+    TextureArrayPacker::TextureArrayPacker() {
+        this->packedCount = 0;
+    }
+
+    TextureArrayPacker::TextureFormat TextureArrayPacker::ReadFormat(GLuint texture) const {
+        TextureFormat format;
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &format.width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &format.height);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format.internalFormat);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, &format.minFilter);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, &format.magFilter);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, &format.wrapS);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, &format.wrapT);
+
+        //either the full chain down to 1x1 from glGenerateMipmap, or the base level only
+        GLint fullLevels = 1;
+        while ((std::max(format.width, format.height) >> fullLevels) > 0)
+            fullLevels++;
+        GLint lastWidth = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, fullLevels - 1, GL_TEXTURE_WIDTH, &lastWidth);
+        format.levels = lastWidth > 0 ? fullLevels : 1;
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return format;
+    }
+
+    GLuint TextureArrayPacker::CreateArray(const TextureFormat& format, GLsizei layers) const {
+        GLuint array;
+        glGenTextures(1, &array);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+        for (GLint level = 0; level < format.levels; level++) {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, format.internalFormat, std::max(format.width >> level, 1),
+                         std::max(format.height >> level, 1), layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, format.levels - 1);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, format.minFilter);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, format.magFilter);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, format.wrapS);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, format.wrapT);
+
+        std::ostringstream label;
+        label << "texture array " << format.width << "x" << format.height;
+        GLDebug::LabelObject(GL_TEXTURE, array, label.str());
+        return array;
+    }
+
+    void TextureArrayPacker::CopyLayer(GLuint texture, GLuint array, GLint layer, const TextureFormat& format,
+                                       std::vector<unsigned char>& pixels) const {
+        for (GLint level = 0; level < format.levels; level++) {
+            GLsizei width = std::max(format.width >> level, 1);
+            GLsizei height = std::max(format.height >> level, 1);
+            //OpenGL 4.3 copies on the gpu, 4.1 goes through memory of the cpu; only done while loading
+            if (GLEW_ARB_copy_image) {
+                glCopyImageSubData(texture, GL_TEXTURE_2D, level, 0, 0, 0,
+                                   array, GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1);
+            } else {
+                pixels.resize(width * height * BYTES_PER_TEXEL);
+                glBindTexture(GL_TEXTURE_2D, texture);
+                glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+                glBindTexture(GL_TEXTURE_2D, 0);
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+                                &pixels[0]);
+            }
+        }
+    }
+
+    std::vector<GLuint> TextureArrayPacker::Pack(std::vector<Texture>& textures) {
+        std::vector<GLuint> arrays;
+        packedCount = 0;
+
+        GLint maxLayers = 0;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+        //the textures of every format, each id once
+        std::map<TextureFormat, std::vector<GLuint> > groups;
+        std::set<GLuint> seen;
+        for (size_t i = 0; i < textures.size(); i++) {
+            if (textures[i].layer >= 0 || textures[i].id == 0 || !seen.insert(textures[i].id).second)
+                continue;
+            groups[ReadFormat(textures[i].id)].push_back(textures[i].id);
+        }
+
+        //where every 2D texture went
+        std::map<GLuint, std::pair<GLuint, GLint> > packed;
+        std::vector<unsigned char> pixels;
+        for (std::map<TextureFormat, std::vector<GLuint> >::iterator group = groups.begin(); group != groups.end(); ++group) {
+            const std::vector<GLuint>& ids = group->second;
+            //a group larger than the driver allows is split over several arrays
+            for (size_t first = 0; first < ids.size(); first += maxLayers) {
+                GLsizei layers = (GLsizei)std::min(ids.size() - first, (size_t)maxLayers);
+                GLuint array = CreateArray(group->first, layers);
+                for (GLsizei layer = 0; layer < layers; layer++) {
+                    CopyLayer(ids[first + layer], array, layer, group->first, pixels);
+                    packed[ids[first + layer]] = std::make_pair(array, (GLint)layer);
+                }
+                glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+                arrays.push_back(array);
+            }
+        }
+
+        for (std::map<GLuint, std::pair<GLuint, GLint> >::iterator texture = packed.begin(); texture != packed.end(); ++texture) {
+            GLuint id = texture->first;
+            glDeleteTextures(1, &id);
+        }
+        for (size_t i = 0; i < textures.size(); i++) {
+            std::map<GLuint, std::pair<GLuint, GLint> >::iterator found = packed.find(textures[i].id);
+            if (found != packed.end()) {
+                textures[i].id = found->second.first;
+                textures[i].layer = found->second.second;
+            }
+        }
+
+        packedCount = (int)packed.size();
+        return arrays;
+    }
+
+    int TextureArrayPacker::getPackedCount() const {
+        return packedCount;
+    }
+
+}
@@ -0,0 +1,53 @@
+#ifndef TextureArrayPacker_hpp
+#define TextureArrayPacker_hpp
+
+#include <GL/glew.h>
+
+#include "Mesh.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    //packs 2D textures into GL_TEXTURE_2D_ARRAY objects: the textures of the same size, format, mip levels and sampling
+    //become the layers of one array, so meshes with different textures bind the same objects and their draws can be
+    //merged. the texels and mip levels are copied as they are, the arrays sample like the textures they replace
+    class TextureArrayPacker
+    {
+    public:
+        TextureArrayPacker();
+
+        //gives every texture the id of its array and its layer there, and deletes the 2D textures. textures sharing an
+        //id are packed once. returns the arrays made, owned by the caller
+        std::vector<GLuint> Pack(std::vector<Texture>& textures);
+
+        //textures packed by the last Pack
+        int getPackedCount() const;
+
+    private:
+        //textures with equal formats go to the same array
+        struct TextureFormat {
+            GLint width;
+            GLint height;
+            GLint internalFormat;
+            GLint levels;
+            GLint minFilter;
+            GLint magFilter;
+            GLint wrapS;
+            GLint wrapT;
+
+            bool operator<(const TextureFormat& other) const;
+        };
+
+        int packedCount;
+
+        TextureFormat ReadFormat(GLuint texture) const;
+        GLuint CreateArray(const TextureFormat& format, GLsizei layers) const;
+        //copies every mip level of a 2D texture into a layer of the bound array
+        void CopyLayer(GLuint texture, GLuint array, GLint layer, const TextureFormat& format,
+                       std::vector<unsigned char>& pixels) const;
+    };
+
+}
+
+#endif /* TextureArrayPacker_hpp */
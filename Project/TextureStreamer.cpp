@@ -0,0 +1,489 @@
+#include "TextureStreamer.hpp"
+#include "stb_image.h"
+#include "RenderStats.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+
+namespace gps {
+
+    //the levels are kept as 8 bit sRGB RGBA, as Model3D loads the textures
+    const size_t BYTES_PER_TEXEL = 4;
+    //reads queued at once, the ones asked for later are picked with the requests of a newer frame
+    const int MAX_READS_IN_FLIGHT = 4;
+    //the resident levels of an image are cached beside it, in a file named after it with this suffix
+    const char* LEVEL_CACHE_SUFFIX = ".levels";
+    const char LEVEL_CACHE_MAGIC[4] = { 'G', 'P', 'S', 'L' };
+    const uint32_t LEVEL_CACHE_VERSION = 1;
+
+    //starts a level cache file, the levels follow from the finest, tightly packed
+    struct LevelCacheHeader {
+        char magic[4];
+        uint32_t version;
+        //of the image file the levels were made from
+        int64_t sourceSize;
+        int64_t sourceTime;
+        int32_t width;
+        int32_t height;
+        int32_t firstLevel;
+        int32_t levelCount;
+    };
+
+    //sRGB encoded bytes to linear intensity
+    struct SrgbTable {
+        float linear[256];
+
+        SrgbTable() {
+            for (int i = 0; i < 256; i++) {
+                float c = i / 255.0f;
+                linear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+        }
+    };
+
+    static unsigned char encodeSrgb(float linear) {
+        float c = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+        return (unsigned char)std::min(std::max(c * 255.0f + 0.5f, 0.0f), 255.0f);
+    }
+
+    //the image as RGBA with its first row at the bottom, as glTexImage2D reads it
+    static bool readImage(const std::string& path, int& width, int& height, std::vector<unsigned char>& pixels) {
+        int channels;
+        unsigned char* data = stbi_load(path.c_str(), &width, &height, &channels, 4);
+        if (data == NULL) {
+            fprintf(stderr, "ERROR: could not load %s\n", path.c_str());
+            return false;
+        }
+        size_t rowBytes = width * BYTES_PER_TEXEL;
+        pixels.resize(rowBytes * height);
+        for (int row = 0; row < height; row++)
+            std::memcpy(&pixels[row * rowBytes], data + (height - row - 1) * rowBytes, rowBytes);
+        stbi_image_free(data);
+        return true;
+    }
+
+    //the size and modification time of the image file in the header, false when it cannot be read
+    static bool statImage(const std::string& path, LevelCacheHeader& header) {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+            return false;
+        header.sourceSize = (int64_t)info.st_size;
+        header.sourceTime = (int64_t)info.st_mtime;
+        return true;
+    }
+
+    //the levels [header.firstLevel, header.levelCount) cached for the image file of the size and time in the header,
+    //false when there is no cache or it was made from another version of the file
+    static bool readLevelCache(const std::string& path, LevelCacheHeader& header, std::vector<std::vector<unsigned char> >& levels) {
+        std::ifstream file((path + LEVEL_CACHE_SUFFIX).c_str(), std::ios::binary);
+        LevelCacheHeader cached;
+        if (!file.read(reinterpret_cast<char*>(&cached), sizeof(cached)))
+            return false;
+        if (std::memcmp(cached.magic, LEVEL_CACHE_MAGIC, sizeof(cached.magic)) != 0 || cached.version != LEVEL_CACHE_VERSION ||
+            cached.sourceSize != header.sourceSize || cached.sourceTime != header.sourceTime || cached.width <= 0 || cached.height <= 0 ||
+            cached.firstLevel < 0 || cached.firstLevel >= cached.levelCount || cached.levelCount > 32)
+            return false;
+
+        levels.resize(cached.levelCount - cached.firstLevel);
+        for (int level = cached.firstLevel; level < cached.levelCount; level++) {
+            std::vector<unsigned char>& pixels = levels[level - cached.firstLevel];
+            pixels.resize((size_t)std::max(cached.width >> level, 1) * std::max(cached.height >> level, 1) * BYTES_PER_TEXEL);
+            if (!file.read(reinterpret_cast<char*>(&pixels[0]), pixels.size()))
+                return false;
+        }
+        header = cached;
+        return true;
+    }
+
+    static void writeLevelCache(const std::string& path, const LevelCacheHeader& header,
+                                const std::vector<std::vector<unsigned char> >& levels) {
+        std::ofstream file((path + LEVEL_CACHE_SUFFIX).c_str(), std::ios::binary);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (size_t i = 0; i < levels.size(); i++)
+            file.write(reinterpret_cast<const char*>(&levels[i][0]), levels[i].size());
+    }
+
+    //level of the image in one pass: every texel averages the block of 2^level x 2^level texels under it in linear
+    //space, the texels past an odd size going to the last row or column. the levels in between are never made
+    static void reduce(std::vector<unsigned char>& pixels, int& width, int& height, int level) {
+        static const SrgbTable srgb;
+        if (level == 0)
+            return;
+        int levelWidth = std::max(width >> level, 1);
+        int levelHeight = std::max(height >> level, 1);
+        std::vector<float> sums(levelWidth * levelHeight * 4, 0.0f);
+        std::vector<int> counts(levelWidth * levelHeight, 0);
+        for (int y = 0; y < height; y++) {
+            int row = std::min(y >> level, levelHeight - 1) * levelWidth;
+            const unsigned char* texel = &pixels[y * width * BYTES_PER_TEXEL];
+            for (int x = 0; x < width; x++, texel += BYTES_PER_TEXEL) {
+                int out = row + std::min(x >> level, levelWidth - 1);
+                float* sum = &sums[out * 4];
+                for (int channel = 0; channel < 3; channel++)
+                    sum[channel] += srgb.linear[texel[channel]];
+                sum[3] += texel[3];
+                counts[out]++;
+            }
+        }
+
+        std::vector<unsigned char> reduced(levelWidth * levelHeight * BYTES_PER_TEXEL);
+        for (int i = 0; i < levelWidth * levelHeight; i++) {
+            for (int channel = 0; channel < 3; channel++)
+                reduced[i * BYTES_PER_TEXEL + channel] = encodeSrgb(sums[i * 4 + channel] / counts[i]);
+            reduced[i * BYTES_PER_TEXEL + 3] = (unsigned char)(sums[i * 4 + 3] / counts[i] + 0.5f);
+        }
+        pixels.swap(reduced);
+        width = levelWidth;
+        height = levelHeight;
+    }
+
+    //the next level: every texel averages the 2x2 texels under it in linear space, the last row or column of an odd
+    //size is reused
+    static void downsample(std::vector<unsigned char>& pixels, int& width, int& height) {
+        static const SrgbTable srgb;
+        int levelWidth = std::max(width / 2, 1);
+        int levelHeight = std::max(height / 2, 1);
+        std::vector<unsigned char> level(levelWidth * levelHeight * BYTES_PER_TEXEL);
+        for (int y = 0; y < levelHeight; y++) {
+            int rows[2] = { std::min(2 * y, height - 1), std::min(2 * y + 1, height - 1) };
+            for (int x = 0; x < levelWidth; x++) {
+                int columns[2] = { std::min(2 * x, width - 1), std::min(2 * x + 1, width - 1) };
+                float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                for (int r = 0; r < 2; r++) {
+                    for (int c = 0; c < 2; c++) {
+                        const unsigned char* texel = &pixels[(rows[r] * width + columns[c]) * BYTES_PER_TEXEL];
+                        for (int channel = 0; channel < 3; channel++)
+                            sum[channel] += srgb.linear[texel[channel]];
+                        sum[3] += texel[3];
+                    }
+                }
+                unsigned char* out = &level[(y * levelWidth + x) * BYTES_PER_TEXEL];
+                for (int channel = 0; channel < 3; channel++)
+                    out[channel] = encodeSrgb(sum[channel] / 4.0f);
+                out[3] = (unsigned char)(sum[3] / 4.0f + 0.5f);
+            }
+        }
+        pixels.swap(level);
+        width = levelWidth;
+        height = levelHeight;
+    }
+
+    TextureStreamer::TextureStreamer() {
+        this->budget = 0;
+        this->residentBytes = 0;
+        this->reservedBytes = 0;
+        this->frame = 0;
+        this->streamedLevels = 0;
+        this->droppedLevels = 0;
+        this->readsInFlight = 0;
+        this->started = false;
+        this->stopping = false;
+    }
+
+    TextureStreamer::~TextureStreamer() {
+        StopLoader();
+    }
+
+    void TextureStreamer::Start(size_t budget) {
+        this->budget = budget;
+        stopping = false;
+        started = true;
+        loader = std::thread(&TextureStreamer::LoaderLoop, this);
+    }
+
+    void TextureStreamer::StopLoader() {
+        if (!loader.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(readsMutex);
+            stopping = true;
+        }
+        readsAvailable.notify_all();
+        loader.join();
+    }
+
+    void TextureStreamer::Delete() {
+        StopLoader();
+        for (size_t i = 0; i < textures.size(); i++)
+            glDeleteTextures(1, &textures[i].id);
+        textures.clear();
+        textureIndices.clear();
+        queuedReads.clear();
+        finishedReads.clear();
+        residentBytes = 0;
+        reservedBytes = 0;
+        readsInFlight = 0;
+        started = false;
+    }
+
+    GLuint TextureStreamer::Load(const std::string& path) {
+        StreamedTexture texture;
+        //the cached levels when they were made from this version of the file, otherwise the image is decoded and
+        //reduced straight to its first resident level
+        LevelCacheHeader header;
+        std::vector<std::vector<unsigned char> > levels;
+        bool stated = statImage(path, header);
+        if (stated && readLevelCache(path, header, levels)) {
+            texture.width = header.width;
+            texture.height = header.height;
+            texture.levelCount = header.levelCount;
+            texture.loadedLevel = header.firstLevel;
+        } else {
+            std::vector<unsigned char> pixels;
+            if (!readImage(path, texture.width, texture.height, pixels))
+                return 0;
+            texture.levelCount = 1;
+            while ((std::max(texture.width, texture.height) >> texture.levelCount) > 0)
+                texture.levelCount++;
+            texture.loadedLevel = 0;
+            while (std::max(texture.width, texture.height) >> texture.loadedLevel > RESIDENT_SIZE)
+                texture.loadedLevel++;
+
+            int width = texture.width;
+            int height = texture.height;
+            reduce(pixels, width, height, texture.loadedLevel);
+            for (int level = texture.loadedLevel; level < texture.levelCount; level++) {
+                levels.push_back(pixels);
+                if (level + 1 < texture.levelCount)
+                    downsample(pixels, width, height);
+            }
+
+            std::memcpy(header.magic, LEVEL_CACHE_MAGIC, sizeof(header.magic));
+            header.version = LEVEL_CACHE_VERSION;
+            header.width = texture.width;
+            header.height = texture.height;
+            header.firstLevel = texture.loadedLevel;
+            header.levelCount = texture.levelCount;
+            if (stated)
+                writeLevelCache(path, header, levels);
+        }
+
+        texture.path = path;
+        texture.residentLevel = texture.loadedLevel;
+        texture.requestedLevel = texture.levelCount;
+        texture.usedLevel = texture.loadedLevel;
+        texture.lastUsedFrame = 0;
+        texture.reading = false;
+        texture.unreadable = false;
+
+        glGenTextures(1, &texture.id);
+        glBindTexture(GL_TEXTURE_2D, texture.id);
+        for (int level = texture.loadedLevel; level < texture.levelCount; level++) {
+            glTexImage2D(GL_TEXTURE_2D, level, GL_SRGB, std::max(texture.width >> level, 1), std::max(texture.height >> level, 1),
+                         0, GL_RGBA, GL_UNSIGNED_BYTE, &levels[level - texture.loadedLevel][0]);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.loadedLevel);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.levelCount - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        residentBytes += getLevelBytes(texture, texture.loadedLevel, texture.levelCount);
+        textureIndices[texture.id] = (int)textures.size();
+        textures.push_back(texture);
+        return texture.id;
+    }
+
+    void TextureStreamer::Request(GLuint texture, float texCoordsPerPixel) {
+        std::map<GLuint, int>::iterator found = textureIndices.find(texture);
+        if (found == textureIndices.end())
+            return;
+        StreamedTexture& streamed = textures[found->second];
+        //the level where one texel covers about one pixel, the gpu blends it with the next coarser one
+        float texelsPerPixel = texCoordsPerPixel * std::max(streamed.width, streamed.height);
+        int level = texelsPerPixel <= 1.0f ? 0 : (int)std::floor(std::log2(texelsPerPixel));
+        streamed.requestedLevel = std::min(streamed.requestedLevel, std::min(level, streamed.levelCount - 1));
+        streamed.lastUsedFrame = frame;
+    }
+
+    void TextureStreamer::Update() {
+        std::deque<LevelRead> reads;
+        {
+            std::lock_guard<std::mutex> lock(readsMutex);
+            reads.swap(finishedReads);
+        }
+        for (size_t i = 0; i < reads.size(); i++)
+            Upload(reads[i]);
+        readsInFlight -= (int)reads.size();
+
+        for (size_t i = 0; i < textures.size(); i++) {
+            if (textures[i].lastUsedFrame == frame && textures[i].requestedLevel < textures[i].levelCount)
+                textures[i].usedLevel = textures[i].requestedLevel;
+            textures[i].requestedLevel = textures[i].levelCount;
+        }
+        QueueReads();
+        frame++;
+    }
+
+    int TextureStreamer::getNeededLevel(const StreamedTexture& texture) const {
+        return texture.lastUsedFrame == frame ? std::min(texture.usedLevel, texture.loadedLevel) : texture.loadedLevel;
+    }
+
+    size_t TextureStreamer::getLevelBytes(const StreamedTexture& texture, int firstLevel, int endLevel) const {
+        size_t bytes = 0;
+        for (int level = firstLevel; level < endLevel; level++)
+            bytes += std::max(texture.width >> level, 1) * std::max(texture.height >> level, 1) * BYTES_PER_TEXEL;
+        return bytes;
+    }
+
+    void TextureStreamer::Upload(const LevelRead& read) {
+        StreamedTexture& texture = textures[read.texture];
+        texture.reading = false;
+        reservedBytes -= getLevelBytes(texture, read.firstLevel, read.endLevel);
+        if (read.levels.empty()) {
+            texture.unreadable = true;
+            return;
+        }
+
+        glBindTexture(GL_TEXTURE_2D, texture.id);
+        for (int level = read.firstLevel; level < read.endLevel; level++) {
+            glTexImage2D(GL_TEXTURE_2D, level, GL_SRGB, std::max(texture.width >> level, 1),
+                         std::max(texture.height >> level, 1), 0, GL_RGBA, GL_UNSIGNED_BYTE, &read.levels[level - read.firstLevel][0]);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, read.firstLevel);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        residentBytes += getLevelBytes(texture, read.firstLevel, read.endLevel);
+        streamedLevels += read.endLevel - read.firstLevel;
+        texture.residentLevel = read.firstLevel;
+    }
+
+    void TextureStreamer::Drop(StreamedTexture& texture, int level) {
+        glBindTexture(GL_TEXTURE_2D, texture.id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+        //a level of no texels frees its storage, the texture stays complete from its base level on
+        for (int dropped = texture.residentLevel; dropped < level; dropped++)
+            glTexImage2D(GL_TEXTURE_2D, dropped, GL_SRGB, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        residentBytes -= getLevelBytes(texture, texture.residentLevel, level);
+        droppedLevels += level - texture.residentLevel;
+        texture.residentLevel = level;
+    }
+
+    bool TextureStreamer::MakeRoom(size_t bytes) {
+        if (residentBytes + reservedBytes + bytes <= budget)
+            return true;
+
+        //the levels finer than the frame needs, of the textures least recently used first
+        std::vector<int> candidates;
+        for (size_t i = 0; i < textures.size(); i++) {
+            if (!textures[i].reading && textures[i].residentLevel < getNeededLevel(textures[i]))
+                candidates.push_back((int)i);
+        }
+        std::stable_sort(candidates.begin(), candidates.end(), [this](int a, int b) {
+            return textures[a].lastUsedFrame < textures[b].lastUsedFrame;
+        });
+
+        for (size_t i = 0; i < candidates.size(); i++) {
+            StreamedTexture& texture = textures[candidates[i]];
+            Drop(texture, getNeededLevel(texture));
+            if (residentBytes + reservedBytes + bytes <= budget)
+                return true;
+        }
+        return false;
+    }
+
+    void TextureStreamer::QueueReads() {
+        //the textures missing the most levels first
+        std::vector<int> missing;
+        for (size_t i = 0; i < textures.size(); i++) {
+            const StreamedTexture& texture = textures[i];
+            if (texture.lastUsedFrame == frame && !texture.reading && !texture.unreadable && texture.usedLevel < texture.residentLevel)
+                missing.push_back((int)i);
+        }
+        std::stable_sort(missing.begin(), missing.end(), [this](int a, int b) {
+            return textures[a].residentLevel - textures[a].usedLevel > textures[b].residentLevel - textures[b].usedLevel;
+        });
+
+        for (size_t i = 0; i < missing.size() && readsInFlight < MAX_READS_IN_FLIGHT; i++) {
+            StreamedTexture& texture = textures[missing[i]];
+            //coarser levels than asked for when the budget is short
+            int level = texture.usedLevel;
+            while (level < texture.residentLevel && !MakeRoom(getLevelBytes(texture, level, texture.residentLevel)))
+                level++;
+            if (level >= texture.residentLevel)
+                continue;
+
+            LevelRead read;
+            read.texture = missing[i];
+            read.path = texture.path;
+            read.width = texture.width;
+            read.height = texture.height;
+            read.firstLevel = level;
+            read.endLevel = texture.residentLevel;
+            reservedBytes += getLevelBytes(texture, read.firstLevel, read.endLevel);
+            texture.reading = true;
+            readsInFlight++;
+            {
+                std::lock_guard<std::mutex> lock(readsMutex);
+                queuedReads.push_back(read);
+            }
+            readsAvailable.notify_one();
+        }
+    }
+
+    void TextureStreamer::LoaderLoop() {
+        while (true) {
+            LevelRead read;
+            {
+                std::unique_lock<std::mutex> lock(readsMutex);
+                readsAvailable.wait(lock, [this] { return stopping || !queuedReads.empty(); });
+                if (stopping)
+                    return;
+                read = queuedReads.front();
+                queuedReads.pop_front();
+            }
+
+            //the whole file is decoded, reduced straight to the finest level asked for, then down to the coarsest
+            int width, height;
+            std::vector<unsigned char> pixels;
+            if (readImage(read.path, width, height, pixels) && width == read.width && height == read.height) {
+                reduce(pixels, width, height, read.firstLevel);
+                for (int level = read.firstLevel; level < read.endLevel; level++) {
+                    read.levels.push_back(pixels);
+                    if (level + 1 < read.endLevel)
+                        downsample(pixels, width, height);
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(readsMutex);
+            finishedReads.push_back(read);
+        }
+    }
+
+    bool TextureStreamer::isStarted() const {
+        return started;
+    }
+
+    size_t TextureStreamer::getBudget() const {
+        return budget;
+    }
+
+    size_t TextureStreamer::getResidentBytes() const {
+        return residentBytes;
+    }
+
+    size_t TextureStreamer::getFullBytes() const {
+        size_t bytes = 0;
+        for (size_t i = 0; i < textures.size(); i++)
+            bytes += getLevelBytes(textures[i], 0, textures[i].levelCount);
+        return bytes;
+    }
+
+    int TextureStreamer::getStreamedLevelCount() const {
+        return streamedLevels;
+    }
+
+    int TextureStreamer::getDroppedLevelCount() const {
+        return droppedLevels;
+    }
+
+}
@@ -0,0 +1,128 @@
+#ifndef TextureStreamer_hpp
+#define TextureStreamer_hpp
+
+#include <GL/glew.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace gps {
+
+    //2D textures whose mip levels come and go with what the frame needs. Load uploads the small levels only, the
+    //frame then asks for the level every visible mesh needs with Request, and a loader thread reads the finer levels
+    //from the image files for Update to upload on the GL thread. the levels fit in a memory budget, the finest levels
+    //of the textures least recently asked for are dropped to make room. a texture samples from its
+    //GL_TEXTURE_BASE_LEVEL, the levels finer than it have no storage
+    class TextureStreamer
+    {
+    public:
+        //levels at most this many texels wide and high are uploaded by Load and never dropped
+        static const int RESIDENT_SIZE = 64;
+
+        TextureStreamer();
+        ~TextureStreamer();
+
+        //budget in bytes for every level uploaded, the resident ones included; starts the loader thread
+        void Start(size_t budget);
+        //stops the loader and deletes the textures
+        void Delete();
+
+        //reads the image file and uploads its levels of at most RESIDENT_SIZE texels, returns the texture or 0 when
+        //the file cannot be read. the levels are filtered on the cpu, in linear space, and cached in a file beside the
+        //image that later runs read instead of decoding it while the image file is unchanged
+        GLuint Load(const std::string& path);
+
+        //a visible mesh samples the texture with texCoordsPerPixel texture coordinates across one pixel of the
+        //screen; the finest level asked for during the frame is streamed in. textures not made by Load are ignored
+        void Request(GLuint texture, float texCoordsPerPixel);
+        //once per frame on the GL thread: uploads the levels the loader has read, drops levels over the budget and
+        //queues the reads of the levels asked for
+        void Update();
+
+        bool isStarted() const;
+        size_t getBudget() const;
+        //bytes of the levels uploaded
+        size_t getResidentBytes() const;
+        //bytes of the levels with every texture fully loaded
+        size_t getFullBytes() const;
+        //levels uploaded by Update and dropped to stay in the budget, since Start
+        int getStreamedLevelCount() const;
+        int getDroppedLevelCount() const;
+
+    private:
+        struct StreamedTexture {
+            GLuint id;
+            std::string path;
+            int width;
+            int height;
+            int levelCount;
+            //finest level uploaded, every coarser one is there too
+            int residentLevel;
+            //finest level uploaded by Load
+            int loadedLevel;
+            //finest level asked for this frame, levelCount when none
+            int requestedLevel;
+            //level the frame last asked for
+            int usedLevel;
+            unsigned int lastUsedFrame;
+            bool reading;
+            //the file could not be read again, its finer levels are not asked for anymore
+            bool unreadable;
+        };
+
+        //levels [firstLevel, endLevel) of a texture, read by the loader thread
+        struct LevelRead {
+            int texture;
+            std::string path;
+            //size of level 0, the file must still have it
+            int width;
+            int height;
+            int firstLevel;
+            int endLevel;
+            std::vector<std::vector<unsigned char> > levels;
+        };
+
+        std::vector<StreamedTexture> textures;
+        std::map<GLuint, int> textureIndices;
+        size_t budget;
+        size_t residentBytes;
+        //bytes of the reads queued and not uploaded yet
+        size_t reservedBytes;
+        unsigned int frame;
+        int streamedLevels;
+        int droppedLevels;
+        int readsInFlight;
+
+        std::thread loader;
+        //guards the two queues and stopping, shared with the loader
+        std::mutex readsMutex;
+        std::condition_variable readsAvailable;
+        std::deque<LevelRead> queuedReads;
+        std::deque<LevelRead> finishedReads;
+        bool started;
+        bool stopping;
+
+        void LoaderLoop();
+        void StopLoader();
+        //the level the frame needs of a texture, the one Load uploaded when it was not asked for this frame
+        int getNeededLevel(const StreamedTexture& texture) const;
+        //bytes of the levels [firstLevel, endLevel) of a texture
+        size_t getLevelBytes(const StreamedTexture& texture, int firstLevel, int endLevel) const;
+        void Upload(const LevelRead& read);
+        //drops the levels finer than level
+        void Drop(StreamedTexture& texture, int level);
+        //drops the levels the frame does not need of the textures least recently used until bytes more fit in the
+        //budget, returns false when they still do not
+        bool MakeRoom(size_t bytes);
+        void QueueReads();
+    };
+
+}
+
+#endif /* TextureStreamer_hpp */
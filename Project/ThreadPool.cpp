@@ -0,0 +1,118 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace gps {
+
+    ThreadPool::ThreadPool(unsigned int threadCount) {
+        this->activeTasks = 0;
+        this->stopping = false;
+
+        if (threadCount == 0) {
+            unsigned int hardwareThreads = std::thread::hardware_concurrency();
+            threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+        }
+
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(tasksMutex);
+            stopping = true;
+        }
+        tasksAvailable.notify_all();
+
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    void ThreadPool::Submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(tasksMutex);
+            tasks.push_back(task);
+        }
+        tasksAvailable.notify_one();
+    }
+
+    void ThreadPool::Wait() {
+        std::unique_lock<std::mutex> lock(tasksMutex);
+        tasksFinished.wait(lock, [this] { return tasks.empty() && activeTasks == 0; });
+    }
+
+    void ThreadPool::ParallelFor(size_t count, size_t grainSize, const std::function<void(size_t begin, size_t end)>& body) {
+        if (count == 0)
+            return;
+
+        grainSize = std::max<size_t>(grainSize, 1);
+        size_t chunkCount = (count + grainSize - 1) / grainSize;
+        if (chunkCount == 1) {
+            body(0, count);
+            return;
+        }
+
+        //chunks are claimed through a shared counter by the workers and by the calling thread
+        struct ParallelForState {
+            std::atomic<size_t> nextChunk;
+            std::atomic<size_t> finishedChunks;
+            std::mutex mutex;
+            std::condition_variable done;
+        };
+        std::shared_ptr<ParallelForState> state(new ParallelForState());
+        state->nextChunk = 0;
+        state->finishedChunks = 0;
+
+        std::function<void()> runChunks = [state, chunkCount, grainSize, count, &body]() {
+            size_t chunk;
+            while ((chunk = state->nextChunk.fetch_add(1)) < chunkCount) {
+                size_t begin = chunk * grainSize;
+                body(begin, std::min(begin + grainSize, count));
+                if (state->finishedChunks.fetch_add(1) + 1 == chunkCount) {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->done.notify_all();
+                }
+            }
+        };
+
+        size_t helpers = std::min<size_t>(workers.size(), chunkCount - 1);
+        for (size_t i = 0; i < helpers; i++)
+            Submit(runChunks);
+
+        runChunks();
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->done.wait(lock, [&state, chunkCount] { return state->finishedChunks.load() == chunkCount; });
+    }
+
+    unsigned int ThreadPool::getThreadCount() const {
+        return (unsigned int)workers.size();
+    }
+
+    void ThreadPool::WorkerLoop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(tasksMutex);
+                tasksAvailable.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty())
+                    return;
+
+                task = tasks.front();
+                tasks.pop_front();
+                activeTasks++;
+            }
+
+            task();
+
+            {
+                std::lock_guard<std::mutex> lock(tasksMutex);
+                activeTasks--;
+                if (tasks.empty() && activeTasks == 0)
+                    tasksFinished.notify_all();
+            }
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gps {
+
+    //fixed set of worker threads consuming a shared task queue
+    class ThreadPool
+    {
+    public:
+        //threadCount 0 creates one worker per hardware thread, minus the calling thread
+        ThreadPool(unsigned int threadCount = 0);
+        ~ThreadPool();
+
+        //queues a task for the workers
+        void Submit(std::function<void()> task);
+        //blocks until every submitted task has finished
+        void Wait();
+        //splits [0, count) in chunks of at most grainSize elements and runs them on the workers
+        //the calling thread processes chunks as well, so it is safe to call from inside a task
+        void ParallelFor(size_t count, size_t grainSize, const std::function<void(size_t begin, size_t end)>& body);
+
+        unsigned int getThreadCount() const;
+
+    private:
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()> > tasks;
+        std::mutex tasksMutex;
+        std::condition_variable tasksAvailable;
+        std::condition_variable tasksFinished;
+        size_t activeTasks;
+        bool stopping;
+
+        void WorkerLoop();
+    };
+
+}
+
+#endif /* ThreadPool_hpp */
@@ -0,0 +1,58 @@
+#ifndef TripleBuffer_hpp
+#define TripleBuffer_hpp
+
+#include <atomic>
+
+namespace gps {
+
+    //hands values from one producer thread to one consumer thread without locks. the producer fills its slot and
+    //publishes it, the consumer takes the newest published slot; each side owns one of the three slots and they
+    //trade the third, so neither ever waits for the other. a value published while the consumer was busy replaces
+    //the one it had not taken yet
+    template <typename T>
+    class TripleBuffer
+    {
+    public:
+        TripleBuffer() : shared(1) {
+            this->writeIndex = 0;
+            this->readIndex = 2;
+        }
+
+        //producer: the slot to fill, its contents are whatever it held three publishes ago
+        T& getWriteSlot() {
+            return slots[writeIndex];
+        }
+
+        //producer: makes the write slot the newest value and takes the slot traded back
+        void Publish() {
+            writeIndex = shared.exchange(writeIndex | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+        }
+
+        //consumer: takes the newest value if one was published since the last call, returns false otherwise
+        bool Acquire() {
+            if ((shared.load(std::memory_order_relaxed) & FRESH) == 0)
+                return false;
+            readIndex = shared.exchange(readIndex, std::memory_order_acq_rel) & INDEX_MASK;
+            return true;
+        }
+
+        //consumer: the value taken by the last Acquire, it stays unchanged until the next one
+        const T& getReadSlot() const {
+            return slots[readIndex];
+        }
+
+    private:
+        //set in shared while the slot it holds was published and not taken yet
+        static const unsigned int FRESH = 4;
+        static const unsigned int INDEX_MASK = 3;
+
+        T slots[3];
+        //index of the slot traded between the two sides, and FRESH
+        std::atomic<unsigned int> shared;
+        int writeIndex;
+        int readIndex;
+    };
+
+}
+
+#endif /* TripleBuffer_hpp */
@@ -2,31 +2,25 @@
 
 namespace gps {
 
-    void Window::Create(int width, int height, const char *title) {
+    void Window::Create(int width, int height, const char *title, int glMajor, int glMinor, bool visible,
+                        bool debugContext) {
         if (!glfwInit()) {
             throw std::runtime_error("Could not start GLFW3!");
         }
 
-        //window hints
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
-        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-        // for sRGB framebuffer
-        glfwWindowHint(GLFW_SRGB_CAPABLE, GLFW_TRUE);
-
-        // for multisampling/antialising
-        glfwWindowHint(GLFW_SAMPLES, 4);
-
-        this->window = glfwCreateWindow(width, height, title, NULL, NULL);
+        this->window = OpenWindow(width, height, title, glMajor, glMinor, visible, debugContext);
+        //macOS and older drivers stop at 4.1
+        if (!this->window && (glMajor > 4 || (glMajor == 4 && glMinor > 1))) {
+            std::cout << "OpenGL " << glMajor << "." << glMinor << " is not available, using 4.1" << std::endl;
+            this->window = OpenWindow(width, height, title, 4, 1, visible, debugContext);
+        }
         if (!this->window) {
             throw std::runtime_error("Could not create GLFW3 window!");
         }
 
         glfwMakeContextCurrent(window);
 
-        glfwSwapInterval(1);
+        setSwapInterval(1);
 
         // start GLEW extension handler
         glewExperimental = GL_TRUE;
@@ -37,11 +31,38 @@ namespace gps {
         const GLubyte* version = glGetString(GL_VERSION); // version as a string
         std::cout << "Renderer: " << renderer << std::endl;
         std::cout << "OpenGL version: " << version << std::endl;
+        glGetIntegerv(GL_MAJOR_VERSION, &this->glMajorVersion);
+        glGetIntegerv(GL_MINOR_VERSION, &this->glMinorVersion);
+
+        this->debugOutputEnabled = debugContext && GLDebug::EnableDebugOutput();
+        if (debugContext)
+            std::cout << "OpenGL debug output: " << (this->debugOutputEnabled ? "on" : "not available") << std::endl;
 
         //for RETINA display
         glfwGetFramebufferSize(window, &this->dimensions.width, &this->dimensions.height);
     }
 
+    GLFWwindow* Window::OpenWindow(int width, int height, const char *title, int glMajor, int glMinor, bool visible,
+                                   bool debugContext) {
+        //window hints
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, glMajor);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, glMinor);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        // for sRGB framebuffer
+        glfwWindowHint(GLFW_SRGB_CAPABLE, GLFW_TRUE);
+
+        // for multisampling/antialising
+        glfwWindowHint(GLFW_SAMPLES, 4);
+
+        glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
+
+        glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, debugContext ? GLFW_TRUE : GLFW_FALSE);
+
+        return glfwCreateWindow(width, height, title, NULL, NULL);
+    }
+
     void Window::Delete() {
         if (window)
             glfwDestroyWindow(window);
@@ -60,4 +81,21 @@ namespace gps {
     void Window::setWindowDimensions(WindowDimensions dimensions) {
         this->dimensions = dimensions;
     }
+
+    bool Window::isGLVersionSupported(int major, int minor) {
+        return this->glMajorVersion > major || (this->glMajorVersion == major && this->glMinorVersion >= minor);
+    }
+
+    void Window::setSwapInterval(int interval) {
+        glfwSwapInterval(interval);
+        this->swapInterval = interval;
+    }
+
+    int Window::getSwapInterval() {
+        return this->swapInterval;
+    }
+
+    bool Window::isDebugOutputEnabled() {
+        return this->debugOutputEnabled;
+    }
 }
\ No newline at end of file
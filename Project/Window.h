@@ -3,6 +3,8 @@
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include "GLDebug.hpp"
+
 #include <stdexcept>
 #include <iostream>
 
@@ -16,16 +18,34 @@ namespace gps {
     class Window {
 
     public:
-        void Create(int width=800, int height=600, const char *title="OpenGL Project");
+        //asks for an OpenGL core context of the given version, falls back to 4.1 when a newer one is not available
+        //a window that is not visible still has a context, for rendering offscreen
+        //a debug context reports errors through GLDebug, drivers are slower with one
+        void Create(int width=800, int height=600, const char *title="OpenGL Project", int glMajor=4, int glMinor=1,
+                    bool visible=true, bool debugContext=false);
         void Delete();
 
         GLFWwindow* getWindow();
         WindowDimensions getWindowDimensions();
         void setWindowDimensions(WindowDimensions dimensions);
+        //true if the context that was actually created is at least the given version
+        bool isGLVersionSupported(int major, int minor);
+        //1 waits for the vertical blank before every swap, 0 swaps right away and leaves the frame rate uncapped
+        void setSwapInterval(int interval);
+        int getSwapInterval();
+        //true if the driver reports its errors through the debug callback, glGetError then needs no polling
+        bool isDebugOutputEnabled();
 
     private:
         WindowDimensions dimensions;
         GLFWwindow *window;
+        int glMajorVersion;
+        int glMinorVersion;
+        int swapInterval;
+        bool debugOutputEnabled;
+
+        GLFWwindow* OpenWindow(int width, int height, const char *title, int glMajor, int glMinor, bool visible,
+                               bool debugContext);
     };
 }
 
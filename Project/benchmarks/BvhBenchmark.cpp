@@ -0,0 +1,149 @@
+//
+//  BvhBenchmark.cpp
+//  Standalone build and query benchmark for gps::Bvh, no window or GL context needed.
+//
+//  Build from the Project folder:
+//      g++ -O2 -std=c++11 -I. benchmarks/BvhBenchmark.cpp Bvh.cpp BoundingBox.cpp Frustum.cpp ThreadPool.cpp tiny_obj_loader.cpp -lpthread -o bvh_benchmark
+//  Run from the Project folder:
+//      ./bvh_benchmark [models/scene/scene.obj] [iterations]
+//
+
+#include "Bvh.hpp"
+#include "tiny_obj_loader.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+static double elapsedMs(std::chrono::high_resolution_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+//one object per shape, exactly like Model3D creates one mesh per shape
+static bool loadObjects(const std::string& fileName, gps::Bvh& bvh) {
+    std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), true)) {
+        fprintf(stderr, "ERROR: could not load %s\n%s\n", fileName.c_str(), err.c_str());
+        return false;
+    }
+
+    for (size_t s = 0; s < shapes.size(); s++) {
+        std::vector<glm::vec3> positions;
+        std::vector<unsigned int> indices;
+        for (size_t i = 0; i < shapes[s].mesh.indices.size(); i++) {
+            int v = shapes[s].mesh.indices[i].vertex_index;
+            positions.push_back(glm::vec3(attrib.vertices[3 * v + 0], attrib.vertices[3 * v + 1], attrib.vertices[3 * v + 2]));
+            indices.push_back((unsigned int)i);
+        }
+        bvh.AddObject(positions, indices, glm::mat4(1.0f));
+    }
+
+    return true;
+}
+
+static void benchmarkBuild(gps::Bvh& bvh, gps::ThreadPool* pool, int iterations, const char* label) {
+    double best = 1e30, total = 0.0;
+    for (int i = 0; i < iterations; i++) {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        bvh.Build(pool);
+        double ms = elapsedMs(start);
+        best = std::min(best, ms);
+        total += ms;
+    }
+    printf("build %-10s : best %8.2f ms, average %8.2f ms, %d nodes\n", label, best, total / iterations, bvh.getNodeCount());
+}
+
+int main(int argc, const char* argv[]) {
+    std::string fileName = argc > 1 ? argv[1] : "models/scene/scene.obj";
+    int iterations = argc > 2 ? atoi(argv[2]) : 5;
+
+    gps::Bvh bvh;
+    if (!loadObjects(fileName, bvh))
+        return EXIT_FAILURE;
+    printf("%s: %d objects, %d triangles\n", fileName.c_str(), bvh.getObjectCount(), bvh.getTriangleCount());
+
+    gps::ThreadPool pool;
+    benchmarkBuild(bvh, NULL, iterations, "serial");
+    benchmarkBuild(bvh, &pool, iterations, "parallel");
+    printf("worker threads   : %u\n", pool.getThreadCount());
+
+    gps::BoundingBox bounds = bvh.getBounds();
+    std::mt19937 generator(1234);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    //rays start anywhere inside the scene and go in random directions
+    const int rayCount = 1000000;
+    std::vector<gps::Ray> rays(rayCount);
+    for (int i = 0; i < rayCount; i++) {
+        rays[i].origin = bounds.min + bounds.getExtent() * glm::vec3(unit(generator), unit(generator), unit(generator));
+        float z = 2.0f * unit(generator) - 1.0f;
+        float phi = 6.2831853f * unit(generator);
+        float r = std::sqrt(1.0f - z * z);
+        rays[i].direction = glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+    }
+    float maxDistance = glm::length(bounds.getExtent());
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    int hits = 0;
+    gps::RayHit hit;
+    for (int i = 0; i < rayCount; i++)
+        hits += bvh.Intersect(rays[i], maxDistance, hit) ? 1 : 0;
+    double ms = elapsedMs(start);
+    printf("nearest hit      : %8.2f Mrays/s (%d hits)\n", rayCount / ms / 1000.0, hits);
+
+    start = std::chrono::high_resolution_clock::now();
+    hits = 0;
+    for (int i = 0; i < rayCount; i++)
+        hits += bvh.IntersectAny(rays[i], maxDistance) ? 1 : 0;
+    ms = elapsedMs(start);
+    printf("any hit          : %8.2f Mrays/s (%d hits)\n", rayCount / ms / 1000.0, hits);
+
+    //frustum queries from random points looking in random horizontal directions
+    const int frustumCount = 10000;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1324.0f / 768.0f, 0.1f, 100.0f);
+    std::vector<bool> visibleObjects;
+    size_t visibleTotal = 0;
+    start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < frustumCount; i++) {
+        glm::vec3 eye = rays[i].origin;
+        glm::vec3 target = eye + glm::vec3(rays[i].direction.x, 0.0f, rays[i].direction.z);
+        gps::Frustum frustum(projection * glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f)));
+        bvh.QueryFrustum(frustum, visibleObjects);
+        visibleTotal += std::count(visibleObjects.begin(), visibleObjects.end(), true);
+    }
+    ms = elapsedMs(start);
+    printf("frustum query    : %8.2f kqueries/s (%.1f visible objects on average)\n", frustumCount / ms, (double)visibleTotal / frustumCount);
+
+    //refit after spinning a tenth of the objects in place, like the lances
+    int movingObjects = std::max(1, bvh.getObjectCount() / 10);
+    const int refitCount = 100;
+    std::vector<glm::vec3> pivots(movingObjects);
+    for (int o = 0; o < movingObjects; o++)
+        pivots[o] = bvh.getObjectBounds(o).getCenter();
+    start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < refitCount; i++) {
+        for (int o = 0; o < movingObjects; o++) {
+            glm::mat4 transform = glm::translate(glm::mat4(1.0f), pivots[o]);
+            transform = glm::rotate(transform, glm::radians(0.4f * i), glm::vec3(0.0f, 0.0f, 1.0f));
+            transform = glm::translate(transform, -pivots[o]);
+            bvh.SetTransform(o, transform);
+        }
+        bvh.Refit();
+    }
+    ms = elapsedMs(start);
+    printf("refit            : %8.3f ms for %d moving objects\n", ms / refitCount, movingObjects);
+
+    return EXIT_SUCCESS;
+}
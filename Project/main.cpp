@@ -11,20 +11,41 @@
 #include "Shader.hpp"
 #include "Camera.hpp"
 #include "Model3D.hpp"
+#include "TextureStreamer.hpp"
 #include "SkyBox.hpp"
+#include "Bvh.hpp"
+#include "ThreadPool.hpp"
+#include "OcclusionCuller.hpp"
+#include "IndirectRenderer.hpp"
+#include "CascadedShadowMap.hpp"
+#include "ClusteredLights.hpp"
+#include "Profiler.hpp"
+#include "RenderTarget.hpp"
+#include "RenderGraph.hpp"
+#include "EntityRegistry.hpp"
+#include "GLCommandBackend.hpp"
+#include "RingBuffer.hpp"
+#include "RenderStats.hpp"
+#include "TripleBuffer.hpp"
 
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
 
 // window
 gps::Window myWindow;
 
 // matrices
-glm::mat4 model;
-glm::mat4 modelLance1;
-glm::mat4 modelLance2;
 glm::mat4 view;
 glm::mat4 projection;
-glm::mat3 normalMatrix;
+//the objects of the scene, see initEntities: the village turned by Q/E, under it the hub of every lance turning
+//around its pivot with lance1.obj moved from its pivot to the hub, and the lamps and lanterns of the village
+gps::EntityRegistry entities;
+int villageEntity;
 // light parameters
 glm::vec3 lightDir;
 glm::vec3 lightColor;
@@ -33,21 +54,13 @@ glm::vec3 lightColor;
 glm::mat4 lightRotation;
 
 // shader uniform locations
-GLint modelLoc;
 GLint viewLoc;
 GLint projectionLoc;
-GLint normalMatrixLoc;
 GLint lightDirLoc;
 GLint lightColorLoc;
-
-GLint pointLightPositionLoc1;
-GLint pointLightColorLoc1;
-GLint pointLightPositionLoc2;
-GLint pointLightColorLoc2;
 //GLuint lightDirMatrixLoc;
 //fog
 GLint fogDensityLoc;
-GLint is_lightLoc;
 
 // camera
 //pos -1.00754 m  -2.29122 m  0.707724 m
@@ -65,30 +78,86 @@ float yaw = -90, pitch = 0;
 float sensitivity = 0.1f;
 
 float fov = 45.0f;
-bool first_render = true;
-float startTime;
-float currentTime;
 
 GLboolean pressedKeys[1024];
 
-// models
-gps::Model3D scene;
-gps::Model3D lance1;
-gps::Model3D lance2;
-gps::Model3D lightCube;
+// models of entities, every entity drawing one is one of its instances
+int villageModel;
+//lance1 and lance2 are the same prop: when lance2.obj is a rigid copy of lance1.obj, lance1.obj is drawn at both
+//places with instancing, lance2Placement putting it over lance2.obj; otherwise lance2.obj is drawn as its own model
+int lanceModel;
+int lance2Model = -1;
+glm::mat4 lance2Placement;
 
 GLfloat angle;
 GLfloat light_angle = 0.0f;
-GLfloat lance_angle = 0.0f;
+
+//rotation pivots of the lances, measured on the same point of lance1.obj and lance2.obj
+//  18.9 m      16.7575 m   6.41205 m
+//  14.1481 m   16.6224 m   6.25291 m
+const glm::vec3 lancePivots[] = {
+    glm::vec3(18.9f, 6.41205f, -16.7575f),
+    glm::vec3(14.1481f, 6.25291f, -16.6224f)
+};
+const int LANCE_COUNT = 2;
+//degrees the lances turn every simulation step
+const float LANCE_SPEED = 0.4f;
+//the two lamps of the village
+//-5.77464 m  0.85487 m  2.01812 m
+//-5.77464 m  5.8723 m   2.01812 m
+const glm::vec3 lampPositions[] = {
+    glm::vec3(-5.77464f, 2.01812f, -0.85487f),
+    glm::vec3(-5.77464f, 2.01812f, -5.8723f)
+};
+const int LAMP_COUNT = 2;
 GLfloat fogDensity = 0.0f;
 GLfloat is_light = 0.0f;
 
-
-//point light
-glm::vec3 pointLightPosition1;
-glm::vec3 pointLightColor1;
-glm::vec3 pointLightPosition2;
-glm::vec3 pointLightColor2;
+//the simulation (movement, the lances, the intro camera) advances in fixed steps whatever the frame rate, a frame draws
+//the state between the last two steps; the speeds per step were tuned when a step was one frame at 60 Hz
+const double SIMULATION_STEP = 1.0 / 60.0;
+//after a stall the simulation skips time instead of running hundreds of steps to catch up
+const double MAX_FRAME_TIME = 0.25;
+double simulationTime = 0.0;
+
+//what is blended between two steps
+struct SimulationState {
+    glm::vec3 cameraPosition;
+    float angle;
+    float lightAngle;
+    //angle of every animator of entities
+    std::vector<float> animatorAngles;
+};
+SimulationState previousState;
+
+//J/K/L, applied by the render thread
+GLenum polygonMode = GL_FILL;
+//V
+int swapInterval = 1;
+
+//what the keys ask the render thread to print, a key adds one to its count and the render thread prints when the
+//count of the snapshot it draws differs from the last it printed, so a request is not lost with a skipped snapshot
+enum RenderReport {
+    REPORT_PROFILE,
+    REPORT_RENDER_GRAPH,
+    REPORT_GL_STATS,
+    REPORT_DEPTH_PREPASS,
+    REPORT_SHADOW_CACHE,
+    REPORT_TEXTURE_STREAMING,
+    RENDER_REPORT_COUNT
+};
+unsigned int reportRequests[RENDER_REPORT_COUNT];
+unsigned int reportsPrinted[RENDER_REPORT_COUNT];
+
+
+//point lights, the light entities lit with O/P
+gps::ClusteredLights clusteredLights;
+//T adds a lantern over every cell of a grid laid on the village, to check the cost of many lights
+bool lanterns = false;
+const int LANTERN_GRID = 16;
+std::vector<int> lanternEntities;
+//after the shadow cascades
+const int CLUSTER_TEXTURE_UNIT = 9;
 
 // shaders
 gps::Shader myBasicShader;
@@ -96,16 +165,137 @@ gps::Shader lightShader;
 gps::Shader depthMapShader;
 
 //shadow
-GLuint shadowMapFBO;
-GLuint depthMapTexture;
+gps::CascadedShadowMap shadowMap;
+//1 shows the cascades along the bottom of the screen, M is held to turn the sun
 bool showDepthMap;
-const unsigned int SHADOW_WIDTH = 2048;
-const unsigned int SHADOW_HEIGHT = 2048;
+gps::Shader depthMapViewShader;
+GLuint depthMapViewVAO;
+//H turns the sun shadows off, the lookups are compiled out and the render graph culls the shadow pass unless 1 shows it
+bool shadows = true;
+const int SHADOW_RESOLUTION = 2048;
+const int SHADOW_CASCADES = 4;
+//no shadows are drawn further than this from the camera
+const float SHADOW_DISTANCE = 80.0f;
+//after the units used by the mesh textures
+const int SHADOW_TEXTURE_UNIT = 8;
+//bvh objects inside the light frustum of the cascade being rendered
+std::vector<bool> shadowCasters;
+//the village is only rendered into a cascade when its light frustum changes, the lances every frame
+bool shadowCaching = true;
+int shadowFrames = 0;
 
 //skybox
 gps::SkyBox mySkyBox;
 gps::Shader skyboxShader;
 
+//spatial index over every mesh, one bvh object per placed mesh
+gps::ThreadPool workerPool;
+gps::Bvh sceneBvh;
+std::vector<bool> visibleObjects;
+
+//the draws of the shadow and scene passes are recorded on the worker pool into command lists, one per chunk of
+//COMMAND_LIST_MESHES meshes of a model, then replayed in order on this thread
+std::vector<gps::CommandBuffer> commandLists;
+const size_t COMMAND_LIST_MESHES = 64;
+//what the cpu writes for the gpu every frame, the instance data of the command lists and the draws the gpu driven
+//path moved; persistently mapped where the driver has OpenGL 4.4 buffer storage
+gps::RingBuffer frameUploads;
+const size_t FRAME_UPLOAD_SIZE = 1024 * 1024;
+
+//software occlusion culling, the large walls and the terrain of the village hide what is behind them
+gps::OcclusionCuller occlusionCuller;
+bool occlusionCulling = true;
+std::vector<int> occluderMeshes;
+//renderable and placed mesh of its model rasterized by each occluder
+std::vector<int> occluderRenderables;
+std::vector<int> occluderPlacements;
+const float OCCLUDER_MIN_SIZE = 4.0f;
+const size_t OCCLUDER_MAX_TRIANGLES = 2048;
+
+//gpu driven path, culled by a compute shader and drawn with multi draw indirect (needs OpenGL 4.3)
+gps::IndirectRenderer indirectRenderer;
+gps::Shader indirectShader;
+gps::Shader cullShader;
+gps::Shader depthPyramidShader;
+bool gpuDrivenAvailable = false;
+bool gpuDriven = false;
+
+//depth pre-pass, the visible meshes lay down their depth first so basic.frag runs once per covered pixel
+gps::Shader depthPrepassShader;
+bool depthPrepass = false;
+
+//cpu and gpu time of every pass, R prints the averages and writes the last frames to PROFILE_TRACE_FILE
+gps::Profiler profiler;
+const char* PROFILE_TRACE_FILE = "profile.json";
+
+//the passes of a frame and what they read and write, declared again every frame; U prints the last one
+gps::RenderGraph frameGraph;
+//transient depth array the cascades of the frame are rendered into
+int shadowCascadeResource;
+
+//the input, the simulation and the window belong to the main thread and the GL context to the render thread; the main
+//thread copies everything a frame is drawn from into a snapshot and hands it over, the render thread never reads
+//what the main thread is changing
+struct FrameSnapshot {
+    SimulationState previous;
+    SimulationState current;
+    //glfwGetTime() at which the simulation reached current, the frame blends by the time since
+    double stepTime;
+    //view matrix of the camera moved to the origin, turned by the mouse between steps
+    glm::mat4 cameraOrientation;
+    int framebufferWidth;
+    int framebufferHeight;
+    float fov;
+    GLfloat fogDensity;
+    GLfloat is_light;
+    bool lanterns;
+    bool shadows;
+    bool showDepthMap;
+    bool shadowCaching;
+    bool occlusionCulling;
+    bool gpuDriven;
+    bool depthPrepass;
+    GLenum polygonMode;
+    int swapInterval;
+    unsigned int reportRequests[RENDER_REPORT_COUNT];
+};
+gps::TripleBuffer<FrameSnapshot> frameSnapshots;
+//the snapshot being drawn, owned by the render thread
+const FrameSnapshot* frame;
+std::thread renderThread;
+std::atomic<bool> rendering(false);
+//what the render thread last applied of the snapshot settings needing GL calls
+bool lanternsShown = false;
+GLenum polygonModeShown = GL_FILL;
+int viewportWidth = 0;
+int viewportHeight = 0;
+
+//headless benchmark, --benchmark [--frames N] [--resolution WxH]: the intro camera plays in a hidden window, one
+//simulation step per frame, drawn into benchmarkTarget instead of the window; then the frame times are printed
+bool benchmarkMode = false;
+//the intro is 16 s of simulation steps
+int benchmarkFrames = 960;
+int benchmarkWidth = 1280;
+int benchmarkHeight = 720;
+//frames drawn before the measured ones, while the shader variants compile
+const int BENCHMARK_WARMUP_FRAMES = 10;
+gps::RenderTarget benchmarkTarget;
+//the framebuffer the scene is drawn to, 0 for the window
+GLuint sceneFramebuffer = 0;
+
+//debug builds ask for a debug context, the driver then reports errors as they happen; --gl-debug asks in release too
+#ifdef NDEBUG
+bool glDebugContext = false;
+#else
+bool glDebugContext = true;
+#endif
+//--texture-arrays packs the material textures into texture arrays while loading, see gps::Model3D::PackTextureArrays
+bool textureArrays = false;
+//--texture-budget MB streams the mip levels of the material textures the visible meshes need, in that many megabytes;
+//the arrays load every level, so --texture-arrays goes without streaming
+size_t textureBudget = 0;
+gps::TextureStreamer textureStreamer;
+
 
 GLenum glCheckError_(const char *file, int line)
 {
@@ -141,17 +331,9 @@ GLenum glCheckError_(const char *file, int line)
 }
 #define glCheckError() glCheckError_(__FILE__, __LINE__)
 
+//the render thread follows the framebuffer size of the next snapshot
 void windowResizeCallback(GLFWwindow* window, int width, int height) {
 	fprintf(stdout, "Window resized! New width: %d , and height: %d\n", width, height);
-	//TODO
-    glfwGetFramebufferSize(window, &width, &height);
-
-    myBasicShader.useShaderProgram();
-    projection = glm::perspective(glm::radians(fov), (float)width / (float)height, 0.1f, 1000.0f);
-    projectionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "projection");
-    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    glViewport(0, 0, width, height);
 }
 
 void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int mode) {
@@ -167,8 +349,57 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
         }
     }
 
-    if (key == GLFW_KEY_M && action == GLFW_PRESS)
+    if (key == GLFW_KEY_1 && action == GLFW_PRESS)
         showDepthMap = !showDepthMap;
+
+    if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+        occlusionCulling = !occlusionCulling;
+        std::cout << "Occlusion culling " << (occlusionCulling ? "on" : "off") << std::endl;
+    }
+
+    if (key == GLFW_KEY_I && action == GLFW_PRESS) {
+        if (gpuDrivenAvailable) {
+            gpuDriven = !gpuDriven;
+            std::cout << "GPU driven rendering " << (gpuDriven ? "on" : "off") << std::endl;
+        } else {
+            std::cout << "GPU driven rendering needs OpenGL 4.3" << std::endl;
+        }
+    }
+
+    if (key == GLFW_KEY_Z && action == GLFW_PRESS) {
+        depthPrepass = !depthPrepass;
+        reportRequests[REPORT_DEPTH_PREPASS]++;
+    }
+
+    if (key == GLFW_KEY_R && action == GLFW_PRESS)
+        reportRequests[REPORT_PROFILE]++;
+
+    if (key == GLFW_KEY_T && action == GLFW_PRESS)
+        lanterns = !lanterns;
+
+    if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+        shadows = !shadows;
+        std::cout << "Shadows " << (shadows ? "on" : "off") << std::endl;
+    }
+
+    if (key == GLFW_KEY_U && action == GLFW_PRESS)
+        reportRequests[REPORT_RENDER_GRAPH]++;
+
+    if (key == GLFW_KEY_B && action == GLFW_PRESS)
+        reportRequests[REPORT_GL_STATS]++;
+
+    if (key == GLFW_KEY_V && action == GLFW_PRESS) {
+        swapInterval = swapInterval == 0 ? 1 : 0;
+        std::cout << "Vsync " << (swapInterval != 0 ? "on" : "off") << std::endl;
+    }
+
+    if (key == GLFW_KEY_X && action == GLFW_PRESS) {
+        shadowCaching = !shadowCaching;
+        reportRequests[REPORT_SHADOW_CACHE]++;
+    }
+
+    if (key == GLFW_KEY_Y && action == GLFW_PRESS)
+        reportRequests[REPORT_TEXTURE_STREAMING]++;
 }
 
 void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
@@ -196,10 +427,6 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
         pitch = -89.0f;  
 
     myCamera.rotate(pitch, yaw);
-    view = myCamera.getViewMatrix();
-    myBasicShader.useShaderProgram();
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
     glfwSetInputMode(myWindow.getWindow(), GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 }
 
@@ -212,85 +439,50 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
         fov = 45.0f;
 }
 
+//one simulation step of the held keys, the matrices are made from the result when a frame is drawn
 void processMovement() {
 	if (pressedKeys[GLFW_KEY_W]) {
 		myCamera.move(gps::MOVE_FORWARD, cameraSpeed);
-		//update view matrix
-        view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        // compute normal matrix for teapot
-        normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
 	}
       
 	if (pressedKeys[GLFW_KEY_S]) {
 		myCamera.move(gps::MOVE_BACKWARD, cameraSpeed);
-        //update view matrix
-        view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        // compute normal matrix for teapot
-        normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
 	}
 
 	if (pressedKeys[GLFW_KEY_A]) {
 		myCamera.move(gps::MOVE_LEFT, cameraSpeed);
-        //update view matrix
-        view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        // compute normal matrix for teapot
-        normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
 	}
 
 	if (pressedKeys[GLFW_KEY_D]) {
 		myCamera.move(gps::MOVE_RIGHT, cameraSpeed);
-        //update view matrix
-        view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        // compute normal matrix for teapot
-        normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
 	}
 
     if (pressedKeys[GLFW_KEY_Q]) {
         angle -= 1.0f;
-        // update model matrix for teapot
-        model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0, 1, 0));
-        // update normal matrix for teapot
-        normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
     }
     if (pressedKeys[GLFW_KEY_E]) {
         angle += 1.0f;
-        // update model matrix for teapot
-        model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0, 1, 0));
-        // update normal matrix for teapot
-        normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
     }
 
     if (pressedKeys[GLFW_KEY_F]) {
         fogDensity += 0.002f;
         if (fogDensity >= 0.3f)
             fogDensity = 0.3f; 
-        myBasicShader.useShaderProgram();
-        glUniform1fv(fogDensityLoc, 1, &fogDensity);
     }
     if (pressedKeys[GLFW_KEY_G]) {
         fogDensity -= 0.002f;
         if (fogDensity <= 0.0f)
             fogDensity = 0.0f;
-        myBasicShader.useShaderProgram();
-        glUniform1fv(fogDensityLoc, 1, &fogDensity);
     }
 
     if (pressedKeys[GLFW_KEY_J]) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); //solid
+        polygonMode = GL_FILL; //solid
     }
     if (pressedKeys[GLFW_KEY_K]) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE); //wireframe
+        polygonMode = GL_LINE; //wireframe
     }
     if (pressedKeys[GLFW_KEY_L]) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_POINT); //polygonal
+        polygonMode = GL_POINT; //polygonal
     }
 
     if (pressedKeys[GLFW_KEY_O]) {
@@ -310,7 +502,28 @@ void processMovement() {
 }
 
 void initOpenGLWindow() {
-    myWindow.Create(1324, 768, "Project - Village");
+    myWindow.Create(1324, 768, "Project - Village", 4, 3, !benchmarkMode, glDebugContext);
+}
+
+//the benchmark draws into a framebuffer object, the hidden window has nothing to show
+bool initBenchmarkTarget() {
+    if (!benchmarkTarget.Create(benchmarkWidth, benchmarkHeight)) {
+        std::cerr << "Could not create a " << benchmarkWidth << "x" << benchmarkHeight << " framebuffer" << std::endl;
+        return false;
+    }
+    sceneFramebuffer = benchmarkTarget.getFramebuffer();
+    benchmarkTarget.Bind();
+    WindowDimensions dimensions = { benchmarkWidth, benchmarkHeight };
+    myWindow.setWindowDimensions(dimensions);
+    swapInterval = 0;
+    myWindow.setSwapInterval(swapInterval);
+    return true;
+}
+
+//size of the framebuffer the scene is drawn to, as in the snapshot being drawn
+void getSceneFramebufferSize(int& width, int& height) {
+    width = frame->framebufferWidth;
+    height = frame->framebufferHeight;
 }
 
 void setWindowCallbacks() {
@@ -332,17 +545,70 @@ void initOpenGLState() {
 }
 
 void initModels() {
+    villageModel = entities.CreateModel("village");
+    lanceModel = entities.CreateModel("lances");
+    //created last, dropped again when it is a copy of lance1.obj
+    lance2Model = entities.CreateModel("lance2");
+    if (textureBudget > 0 && !textureArrays) {
+        textureStreamer.Start(textureBudget);
+        for (int i = 0; i < entities.getModelCount(); i++)
+            entities.getModel(i).SetTextureStreamer(&textureStreamer);
+    } else if (textureBudget > 0) {
+        std::cout << "Texture streaming is off with --texture-arrays" << std::endl;
+    }
     //teapot.LoadModel("models/teapot/teapot20segUT.obj");
-    scene.LoadModel("models/scene/scene.obj");
-    lance1.LoadModel("models/scene/lance1.obj");
-    lance2.LoadModel("models/scene/lance2.obj");
+    entities.getModel(villageModel).LoadModel("models/scene/scene.obj");
+    //the export bakes every house, barrel and fence post into its own shape, copies become instances of one mesh
+    entities.getModel(villageModel).MergeDuplicateMeshes();
+    entities.getModel(lanceModel).LoadModel("models/scene/lance1.obj");
+    entities.getModel(lance2Model).LoadModel("models/scene/lance2.obj");
+    if (entities.getModel(lanceModel).FindRigidCopy(entities.getModel(lance2Model), lance2Placement)) {
+        entities.RemoveLastModel();
+        lance2Model = -1;
+    } else {
+        std::cout << "lance2.obj is not a copy of lance1.obj, it is drawn as its own model" << std::endl;
+    }
+    //every model or none, the gpu driven path draws them with one shader
+    if (textureArrays) {
+        for (int i = 0; i < entities.getModelCount(); i++)
+            entities.getModel(i).PackTextureArrays();
+    }
+}
+
+//the features every textured variant has, the fallback while the others compile
+unsigned int getTexturedFeatures() {
+    return gps::SHADER_TEXTURED | (textureArrays ? gps::SHADER_TEXTURE_ARRAYS : 0);
+}
+
+//the variants drawn with: untextured ones without SHADER_TEXTURE_ARRAYS, textured ones with it when the models were packed
+bool isVariantUsed(unsigned int features) {
+    if ((features & gps::SHADER_TEXTURED) == 0)
+        return (features & gps::SHADER_TEXTURE_ARRAYS) == 0;
+    return (features & gps::SHADER_TEXTURE_ARRAYS) == (getTexturedFeatures() & gps::SHADER_TEXTURE_ARRAYS);
 }
 
 void initShaders() {
-	myBasicShader.loadShader("shaders/basic.vert", "shaders/basic.frag");
+	//one program per combination of features, see useBasicShaderVariant
+	myBasicShader.loadShaderVariants("shaders/basic.vert", "shaders/basic.frag");
     skyboxShader.loadShader("shaders/skyboxShader.vert", "shaders/skyboxShader.frag");
     lightShader.loadShader("shaders/lightCube.vert", "shaders/lightCube.frag");
     depthMapShader.loadShader("shaders/depthMapShader.vert", "shaders/depthMapShader.frag");
+    depthPrepassShader.loadShader("shaders/depthPrepass.vert", "shaders/depthPrepass.frag");
+    depthMapViewShader.loadShader("shaders/depthMapView.vert", "shaders/depthMapView.frag");
+    //every variant is submitted now and compiles while the scene loads and the first frames are drawn
+    for (unsigned int features = 0; features < (1u << gps::SHADER_FEATURE_COUNT); features++) {
+        if (isVariantUsed(features))
+            myBasicShader.getVariant(features);
+    }
+
+    //only the fallbacks are waited for
+    skyboxShader.waitUntilReady();
+    lightShader.waitUntilReady();
+    depthMapShader.waitUntilReady();
+    depthPrepassShader.waitUntilReady();
+    depthMapViewShader.waitUntilReady();
+    myBasicShader.getVariant(0).waitUntilReady();
+    myBasicShader.getVariant(getTexturedFeatures()).waitUntilReady();
 }
 
 void initSkyBox() {
@@ -358,28 +624,24 @@ void initSkyBox() {
     mySkyBox.Load(faces);
 }
 
+//the locations move between variants of basic.frag, they are looked up again whenever myBasicShader changes program
+void getBasicShaderLocations() {
+    viewLoc = glGetUniformLocation(myBasicShader.shaderProgram, "view");
+    projectionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "projection");
+    lightDirLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightDir");
+    lightColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightColor");
+    fogDensityLoc = glGetUniformLocation(myBasicShader.shaderProgram, "fogDensity");
+}
+
 void initUniforms() {
 	myBasicShader.useShaderProgram();
-
-    // create model matrix
-    model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-	modelLoc = glGetUniformLocation(myBasicShader.shaderProgram, "model");
-
-    modelLance1 = glm::rotate(glm::mat4(1.0f), glm::radians(lance_angle), glm::vec3(0.0f, 1.0f, 0.0f));
-    //modelLance1 = glm::rotate(modelLance1, glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-    modelLance2 = glm::rotate(glm::mat4(1.0f), glm::radians(lance_angle), glm::vec3(0.0f, 1.0f, 0.0f));
-    //modelLance2 = glm::rotate(modelLance2, glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
+	getBasicShaderLocations();
 
 	// get view matrix for current camera
 	view = myCamera.getViewMatrix();
-	viewLoc = glGetUniformLocation(myBasicShader.shaderProgram, "view");
 	// send view matrix to shader
     glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
 
-    // compute normal matrix
-    normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
-	normalMatrixLoc = glGetUniformLocation(myBasicShader.shaderProgram, "normalMatrix");
-
     // light direction matrix
     //lightDirMatrixLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightDirMatrix");
 
@@ -387,57 +649,27 @@ void initUniforms() {
 	projection = glm::perspective(glm::radians(45.0f),
                                (float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height,
                                0.1f, 100.0f);
-	projectionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "projection");
 	// send projection matrix to shader
 	glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));	
 
 	//set the light direction (direction towards the light)
 	lightDir = glm::vec3(0.0f, 1.0f, 1.0f);
     lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(light_angle), glm::vec3(1.0f, 0.0f, 0.0f));
-	lightDirLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightDir");
-	// send light dir to shader
-    glUniform3fv(lightDirLoc, 1, glm::value_ptr(glm::inverseTranspose(glm::mat3(view * lightRotation)) * lightDir));
-    //glUniform3fv(lightDirLoc, 1, glm::value_ptr(lightDir));
+	// send light dir to shader, in world space like the shadow cascades (basic.frag moves it to eye space)
+    glUniform3fv(lightDirLoc, 1, glm::value_ptr(glm::mat3(lightRotation) * lightDir));
 
 	//set light color
 	lightColor = glm::vec3(1.0f, 1.0f, 1.0f); //white light
-	lightColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightColor");
 	// send light color to shader
 	glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
 
     fogDensity = 0.0f;
-    fogDensityLoc = glGetUniformLocation(myBasicShader.shaderProgram, "fogDensity");
     glUniform1fv(fogDensityLoc, 1, &fogDensity);
 
     is_light = 0.0f;
-    is_lightLoc = glGetUniformLocation(myBasicShader.shaderProgram, "is_light");
-    glUniform1fv(is_lightLoc, 1, &is_light);
-
-    //////////////point light 1
-    pointLightColor1 = glm::vec3(1.0f, 1.0f, 0.0f);
-    pointLightColorLoc1 = glGetUniformLocation(myBasicShader.shaderProgram, "pointLightColor1");
-    // send light color to shader
-    glUniform3fv(pointLightColorLoc1, 1, glm::value_ptr(pointLightColor1));
-    //-5.77464 m
-    //0.85487 m
-    //2.01812 m
-    pointLightPosition1 = glm::vec3(-5.77464f, 2.01812f, -0.85487f);
-    pointLightPositionLoc1 = glGetUniformLocation(myBasicShader.shaderProgram, "pointLightPosition1");
-    // send light color to shader
-    glUniform3fv(pointLightPositionLoc1, 1, glm::value_ptr(pointLightPosition1));
-
-    //////////////point light 2
-    pointLightColor2 = glm::vec3(1.0f, 1.0f, 0.0f);
-    pointLightColorLoc2 = glGetUniformLocation(myBasicShader.shaderProgram, "pointLightColor2");
-    // send light color to shader
-    glUniform3fv(pointLightColorLoc2, 1, glm::value_ptr(pointLightColor2));
-    //-5.77464 m
-    //5.8723 m
-    //2.01812 m
-    pointLightPosition2 = glm::vec3(-5.77464f, 2.01812f, -5.8723f);
-    pointLightPositionLoc2 = glGetUniformLocation(myBasicShader.shaderProgram, "pointLightPosition2");
-    // send light color to shader
-    glUniform3fv(pointLightPositionLoc2, 1, glm::value_ptr(pointLightPosition2));
+
+    //////////////point lights, set from the light entities every time one moves
+    clusteredLights.Create();
 
     //////skybox
     skyboxShader.useShaderProgram();
@@ -456,95 +688,497 @@ void initUniforms() {
     glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
 }
 
+void initFrameUploads() {
+    frameUploads.Create(FRAME_UPLOAD_SIZE, true, "frame uploads");
+    std::cout << "Frame uploads: " << (frameUploads.isPersistent() ? "persistently mapped ring buffer" : "glBufferSubData")
+        << std::endl;
+}
+
 void initFBO() {
-    //TODO - Create the FBO, the depth texture and attach the depth texture to the FBO
+    //one depth layer per cascade
+    shadowMap.Create(SHADOW_RESOLUTION, SHADOW_CASCADES);
+    //the depth map view has no vertex attributes, the core profile still wants a vertex array bound to draw
+    glGenVertexArrays(1, &depthMapViewVAO);
+}
+
+//direction towards the sun in world space, turned by light_angle (N/M)
+glm::vec3 computeLightDirection() {
+    return glm::mat3(lightRotation) * lightDir;
+}
 
-    // generate FBO ID
-    glGenFramebuffers(1, &shadowMapFBO);
+//the box around the placed meshes of a model, in its own space
+gps::BoundingBox getModelBounds(const gps::Model3D& model3D) {
+    gps::BoundingBox bounds;
+    const std::vector<gps::MeshInstance>& placedMeshes = model3D.getMeshInstances();
+    for (size_t i = 0; i < placedMeshes.size(); i++)
+        bounds.expand(model3D.getMeshes()[placedMeshes[i].mesh].getBounds().transform(placedMeshes[i].transform));
+    return bounds;
+}
 
-    // create depth texture for FBO
-    glGenTextures(1, &depthMapTexture);
-    glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-        SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+void initEntities() {
+    villageEntity = entities.CreateEntity(-1, glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f)));
+    entities.AddRenderable(villageEntity, villageModel);
+    entities.AddBounds(villageEntity, getModelBounds(entities.getModel(villageModel)));
+
+    //every lance is moved from its pivot to the origin of its hub, whatever the hub turns it with; lance1.obj drawn in
+    //place of lance2.obj is first put over it
+    for (int i = 0; i < LANCE_COUNT; i++) {
+        int hub = entities.CreateEntity(villageEntity, glm::translate(glm::mat4(1.0f), lancePivots[i]));
+        entities.AddAnimator(hub, glm::vec3(0.0f, 0.0f, 1.0f), LANCE_SPEED);
+        int model = lanceModel;
+        glm::mat4 localTransform = glm::translate(glm::mat4(1.0f), -lancePivots[i]);
+        if (i == 1 && lance2Model >= 0)
+            model = lance2Model;
+        else if (i == 1)
+            localTransform = localTransform * lance2Placement;
+        int lanceEntity = entities.CreateEntity(hub, localTransform);
+        entities.AddRenderable(lanceEntity, model);
+        entities.AddBounds(lanceEntity, getModelBounds(entities.getModel(model)));
+    }
 
-    //attach texture to FBO
-    glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMapTexture,
-        0);
+    //the lamps, lit until 15 m away
+    gps::PointLight lamp;
+    lamp.position = glm::vec3(0.0f);
+    lamp.radius = 15.0f;
+    lamp.color = glm::vec3(1.0f, 1.0f, 0.0f);
+    for (int i = 0; i < LAMP_COUNT; i++)
+        entities.AddLight(entities.CreateEntity(villageEntity, glm::translate(glm::mat4(1.0f), lampPositions[i])), lamp, true);
+
+    //a lantern over the center of every cell of a grid laid on the village, at the height of the lamps, lit by T
+    const gps::BoundingBox& bounds = entities.getLocalBounds(villageEntity);
+    gps::PointLight lantern;
+    lantern.position = glm::vec3(0.0f);
+    lantern.radius = 8.0f;
+    lantern.color = glm::vec3(1.0f, 0.6f, 0.2f);
+    for (int z = 0; z < LANTERN_GRID; z++) {
+        for (int x = 0; x < LANTERN_GRID; x++) {
+            glm::vec3 position(bounds.min.x + (bounds.max.x - bounds.min.x) * (x + 0.5f) / LANTERN_GRID,
+                lampPositions[0].y,
+                bounds.min.z + (bounds.max.z - bounds.min.z) * (z + 0.5f) / LANTERN_GRID);
+            lanternEntities.push_back(entities.CreateEntity(villageEntity, glm::translate(glm::mat4(1.0f), position)));
+            entities.AddLight(lanternEntities.back(), lantern, false);
+        }
+    }
 
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
+    entities.UpdateTransforms();
+    entities.UpdateBounds(&workerPool);
+    for (int i = 0; i < entities.getModelCount(); i++) {
+        const std::vector<int>& renderables = entities.getModelRenderables(i);
+        std::vector<glm::mat4> transforms;
+        for (size_t r = 0; r < renderables.size(); r++)
+            transforms.push_back(entities.getWorldTransform(entities.getRenderableEntity(renderables[r])));
+        entities.getModel(i).SetInstances(transforms);
+    }
+    std::cout << "Entities: " << entities.getEntityCount() << ", " << entities.getRenderableCount() << " of them drawing "
+        << entities.getModelCount() << " models" << std::endl;
+}
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+int addModelToBvh(const gps::Model3D& model3D, glm::mat4 transform) {
+    const std::vector<gps::Mesh>& meshes = model3D.getMeshes();
+    const std::vector<gps::MeshInstance>& placedMeshes = model3D.getMeshInstances();
+    int firstObject = sceneBvh.getObjectCount();
+
+    for (size_t i = 0; i < placedMeshes.size(); i++) {
+        const gps::Mesh& mesh = meshes[placedMeshes[i].mesh];
+        std::vector<glm::vec3> positions(mesh.vertices.size());
+        for (size_t v = 0; v < positions.size(); v++)
+            positions[v] = mesh.vertices[v].Position;
+        sceneBvh.AddObject(positions, mesh.indices, transform * placedMeshes[i].transform);
+    }
+
+    return firstObject;
 }
 
-/*glm::mat4 computeLightSpaceTrMatrix() {
-    //TODO - Return the light-space transformation matrix
+void initBvh() {
+    for (int i = 0; i < entities.getRenderableCount(); i++) {
+        const gps::Model3D& model3D = entities.getModel(entities.getRenderableModel(i));
+        entities.SetRenderableFirstObject(i, addModelToBvh(model3D, entities.getWorldTransform(entities.getRenderableEntity(i))));
+    }
 
-    const GLfloat near_plane = 1.0f, far_plane = 10.0f;
-    glm::mat4 lightProjection = glm::ortho(-20.0f, 20.0f, -20.0f, 20.0f, near_plane, far_plane);
-    glm::vec3 lightDirTr = glm::vec3(glm::rotate(glm::mat4(1.0f), glm::radians(light_angle), glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(lightDir, 1.0f));
-    glm::mat4 lightView = glm::lookAt(lightDir, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-    return lightProjection * lightView;
-}*/
+    double start = glfwGetTime();
+    sceneBvh.Build(&workerPool);
+    std::cout << "BVH: " << sceneBvh.getTriangleCount() << " triangles, " << sceneBvh.getNodeCount() << " nodes, built in "
+        << (glfwGetTime() - start) * 1000.0 << " ms on " << workerPool.getThreadCount() + 1 << " threads" << std::endl;
+}
 
-void renderSceneObject(gps::Shader shader) {
-    shader.useShaderProgram();
+void setModelTransformInBvh(const gps::Model3D& model3D, int firstObject, glm::mat4 transform) {
+    const std::vector<gps::MeshInstance>& placedMeshes = model3D.getMeshInstances();
+    for (size_t i = 0; i < placedMeshes.size(); i++)
+        sceneBvh.SetTransform(firstObject + (int)i, transform * placedMeshes[i].transform);
+}
 
-    //send scene object model matrix data to shader
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+//picks the meshes of the models that do not animate large in at least two directions (walls, roofs, terrain) and
+//cheap enough to rasterize
+void initOcclusionCulling() {
+    size_t stillMeshCount = 0;
+    for (int r = 0; r < entities.getRenderableCount(); r++) {
+        if (entities.isModelAnimated(entities.getRenderableModel(r)))
+            continue;
+        const gps::Model3D& model3D = entities.getModel(entities.getRenderableModel(r));
+        const std::vector<gps::Mesh>& meshes = model3D.getMeshes();
+        const std::vector<gps::MeshInstance>& placedMeshes = model3D.getMeshInstances();
+        stillMeshCount += placedMeshes.size();
+        for (size_t i = 0; i < placedMeshes.size(); i++) {
+            const gps::Mesh& mesh = meshes[placedMeshes[i].mesh];
+            glm::vec3 extent = mesh.getBounds().getExtent();
+            float middleExtent = glm::max(glm::min(extent.x, extent.y), glm::min(glm::max(extent.x, extent.y), extent.z));
+            if (middleExtent < OCCLUDER_MIN_SIZE || mesh.indices.size() / 3 > OCCLUDER_MAX_TRIANGLES)
+                continue;
+
+            std::vector<glm::vec3> positions(mesh.vertices.size());
+            for (size_t v = 0; v < positions.size(); v++)
+                positions[v] = mesh.vertices[v].Position;
+            occluderMeshes.push_back(occlusionCuller.AddOccluder(positions, mesh.indices));
+            occluderRenderables.push_back(r);
+            occluderPlacements.push_back((int)i);
+        }
+    }
 
-    //send scene normal matrix data to shader
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+    std::cout << "Occlusion culling: " << occluderMeshes.size() << " occluders out of " << stillMeshCount << " meshes" << std::endl;
+}
 
-    // draw scene
-    scene.Draw(shader);
+void cullOccludedMeshes(int renderable) {
+    const gps::Model3D& model3D = entities.getModel(entities.getRenderableModel(renderable));
+    const std::vector<gps::Mesh>& meshes = model3D.getMeshes();
+    const std::vector<gps::MeshInstance>& placedMeshes = model3D.getMeshInstances();
+    int firstObject = entities.getRenderableFirstObject(renderable);
+    const glm::mat4& transform = entities.getWorldTransform(entities.getRenderableEntity(renderable));
+    for (size_t i = 0; i < placedMeshes.size(); i++) {
+        if (visibleObjects[firstObject + i] &&
+            !occlusionCuller.IsVisible(meshes[placedMeshes[i].mesh].getBounds().transform(transform * placedMeshes[i].transform)))
+            visibleObjects[firstObject + i] = false;
+    }
 }
 
-void renderLance1(gps::Shader shader) {
-    shader.useShaderProgram();
+//moves the instances, the bvh objects and the gpu driven draws of the renderables the last entities.UpdateTransforms
+//moved; the gpu driven draws follow with the path off, it can be turned on any frame
+void updateSceneTransforms() {
+    for (int i = 0; i < entities.getRenderableCount(); i++) {
+        int entity = entities.getRenderableEntity(i);
+        if (!entities.isMoved(entity))
+            continue;
+        int model = entities.getRenderableModel(i);
+        gps::Model3D& model3D = entities.getModel(model);
+        const glm::mat4& transform = entities.getWorldTransform(entity);
+        setModelTransformInBvh(model3D, entities.getRenderableFirstObject(i), transform);
+        model3D.SetInstanceTransform(entities.getRenderableInstance(i), transform, entities.getNormalMatrix(entity));
+        if (gpuDrivenAvailable) {
+            indirectRenderer.SetTransform(entities.getRenderableFirstDraw(i), (int)model3D.getMeshInstances().size(), transform,
+                entities.getNormalMatrix(entity));
+        }
+        //the cascades cache the models that do not animate, the village only moves when rotated with Q/E
+        if (!entities.isModelAnimated(model))
+            shadowMap.InvalidateStaticCache();
+    }
+    sceneBvh.Refit();
+}
 
-    //send lance1 model matrix data to shader
-    //modelLance1 = glm::translate(modelLance1, glm::vec3(15.7653f, 6.41739f, -16.9036f));
-        //  18.9 m
-        //  16.7575 m
-        //  6.41205 m
-    modelLance1 = glm::translate(glm::mat4(1.0f), glm::vec3(18.9f, 6.41205f, -16.7575f));
-    modelLance1 = glm::rotate(modelLance1, glm::radians(lance_angle), glm::vec3(0.0f, 0.0f, 1.0f));
-    modelLance1 = glm::translate(modelLance1, glm::vec3(-18.9f, -6.41205f, 16.7575f));
-    
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelLance1));
+//flags the meshes inside the view frustum
+void updateVisibility() {
+    sceneBvh.QueryFrustum(gps::Frustum(projection * view), visibleObjects);
+
+    //then drop the meshes in the frustum hidden behind the occluders
+    if (frame->occlusionCulling) {
+        for (size_t i = 0; i < occluderMeshes.size(); i++) {
+            int renderable = occluderRenderables[i];
+            const gps::Model3D& model3D = entities.getModel(entities.getRenderableModel(renderable));
+            occlusionCuller.SetOccluderTransform(occluderMeshes[i], entities.getWorldTransform(entities.getRenderableEntity(renderable)) *
+                model3D.getMeshInstances()[occluderPlacements[i]].transform);
+        }
+        occlusionCuller.Render(projection * view, &workerPool);
 
-    //send lance1 normal matrix data to shader
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+        for (int i = 0; i < entities.getRenderableCount(); i++)
+            cullOccludedMeshes(i);
+    }
+}
 
-    // draw scene
-    lance1.Draw(shader);
+//asks the streamer for the mip levels the visible meshes of a renderable need: a texture coordinate spans the world
+//units of its mesh, seen from the camera at the distance of the nearest point of its bounds
+void requestTextureLevels(int renderable, const gps::Frustum& frustum, glm::vec3 cameraPosition, float pixelsPerUnit) {
+    int entity = entities.getRenderableEntity(renderable);
+    if (!frustum.intersects(entities.getWorldBounds(entity)))
+        return;
+    const gps::Model3D& model3D = entities.getModel(entities.getRenderableModel(renderable));
+    const std::vector<gps::Mesh>& meshes = model3D.getMeshes();
+    const std::vector<gps::MeshInstance>& placedMeshes = model3D.getMeshInstances();
+    int firstObject = entities.getRenderableFirstObject(renderable);
+    const glm::mat4& transform = entities.getWorldTransform(entity);
+    for (size_t i = 0; i < placedMeshes.size(); i++) {
+        const gps::Mesh& mesh = meshes[placedMeshes[i].mesh];
+        if (!visibleObjects[firstObject + i] || mesh.textures.empty() || mesh.getTexCoordDensity() <= 0.0f)
+            continue;
+        glm::mat4 placement = transform * placedMeshes[i].transform;
+        gps::BoundingBox bounds = mesh.getBounds().transform(placement);
+        float distance = std::max(glm::distance(cameraPosition, glm::clamp(cameraPosition, bounds.min, bounds.max)), 0.1f);
+        float texCoordsPerUnit = mesh.getTexCoordDensity() / glm::length(glm::vec3(placement[0]));
+        float texCoordsPerPixel = texCoordsPerUnit * distance / pixelsPerUnit;
+        for (size_t t = 0; t < mesh.textures.size(); t++)
+            textureStreamer.Request(mesh.textures[t].id, texCoordsPerPixel);
+    }
 }
 
-void renderLance2(gps::Shader shader) {
-    shader.useShaderProgram();
-    //  14.1481 m
-    //  16.6224 m
-    //  6.25291 m
-    //send lance1 model matrix data to shader
-    modelLance2 = glm::translate(glm::mat4(1.0f), glm::vec3(14.1481f, 6.25291f, -16.6224f));
-    modelLance2 = glm::rotate(modelLance2, glm::radians(lance_angle), glm::vec3(0.0f, 0.0f, 1.0f));
-    modelLance2 = glm::translate(modelLance2, glm::vec3(-14.1481f, -6.25291f, 16.6224f));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelLance2));
+//the mip levels of the material textures, after the visibility of the frame
+void updateTextureStreaming() {
+    //the gpu driven path culls on the gpu, the frustum is enough to pick the textures
+    gps::Frustum frustum(projection * view);
+    if (frame->gpuDriven)
+        sceneBvh.QueryFrustum(frustum, visibleObjects);
+
+    //pixels covered by one world unit at a distance of one
+    int width, height;
+    getSceneFramebufferSize(width, height);
+    float pixelsPerUnit = (float)height / (2.0f * std::tan(glm::radians(frame->fov) / 2.0f));
+    glm::vec3 cameraPosition = glm::vec3(glm::inverse(view)[3]);
+    for (int i = 0; i < entities.getRenderableCount(); i++)
+        requestTextureLevels(i, frustum, cameraPosition, pixelsPerUnit);
+    textureStreamer.Update();
+}
 
-    //send lance1 normal matrix data to shader
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+//the flags of the placed meshes of every instance of a model, one instance after the other as DrawInstanced expects them
+std::vector<bool> getVisibleInstances(int model, const std::vector<bool>& objects) {
+    size_t placedCount = entities.getModel(model).getMeshInstances().size();
+    const std::vector<int>& renderables = entities.getModelRenderables(model);
+    std::vector<bool> visibleInstances;
+    for (size_t i = 0; i < renderables.size(); i++) {
+        int firstObject = entities.getRenderableFirstObject(renderables[i]);
+        visibleInstances.insert(visibleInstances.end(), objects.begin() + firstObject, objects.begin() + firstObject + placedCount);
+    }
+    return visibleInstances;
+}
 
-    // draw scene
-    lance2.Draw(shader);
+//meshes [firstMesh, lastMesh) of a model, recorded into one command list
+struct CommandListChunk {
+    const gps::Model3D* model;
+    gps::Shader shader;
+    gps::MeshUniformLocations locations;
+    const std::vector<bool>* visibleInstances;
+    size_t firstMesh;
+    size_t lastMesh;
+};
+
+//splits the meshes of a model into chunks drawn with shader, appended after the chunks already in the list
+void addCommandListChunks(std::vector<CommandListChunk>& chunks, const gps::Model3D& model3D, gps::Shader shader,
+                          const gps::MeshUniformLocations& locations, const std::vector<bool>& visibleInstances) {
+    CommandListChunk chunk;
+    chunk.model = &model3D;
+    chunk.shader = shader;
+    chunk.locations = locations;
+    chunk.visibleInstances = &visibleInstances;
+    size_t meshCount = model3D.getMeshes().size();
+    for (size_t first = 0; first < meshCount; first += COMMAND_LIST_MESHES) {
+        chunk.firstMesh = first;
+        chunk.lastMesh = std::min(first + COMMAND_LIST_MESHES, meshCount);
+        chunks.push_back(chunk);
+    }
+}
+
+//records chunk i into commandLists[i], on the workers and this thread
+void recordCommandLists(const std::vector<CommandListChunk>& chunks) {
+    if (commandLists.size() < chunks.size()) {
+        commandLists.resize(chunks.size());
+        for (size_t i = 0; i < commandLists.size(); i++)
+            commandLists[i].SetUploadBuffer(&frameUploads);
+    }
+    workerPool.ParallelFor(chunks.size(), 1, [&chunks](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            commandLists[i].Reset();
+            chunks[i].model->RecordInstanced(commandLists[i], chunks[i].shader, chunks[i].locations,
+                *chunks[i].visibleInstances, chunks[i].firstMesh, chunks[i].lastMesh);
+        }
+    });
+    frameUploads.Flush();
+}
+
+void replayCommandLists(size_t firstList, size_t lastList) {
+    gps::GLCommandBackend::Replay(commandLists.data() + firstList, lastList - firstList);
+}
+
+//renders the casters of every cascade, each cascade only draws the meshes inside its own light frustum
+//the cached village of a cascade is kept until the sun (N/M), the village (Q/E) or the camera moves its light frustum
+void renderShadows() {
+    shadowMap.SetDepthTexture(frameGraph.getTexture(shadowCascadeResource));
+    int width, height;
+    getSceneFramebufferSize(width, height);
+    shadowMap.Update(view, glm::radians(frame->fov),
+        (float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height,
+        0.1f, SHADOW_DISTANCE, computeLightDirection(), sceneBvh.getBounds());
+
+    if (!frame->shadowCaching)
+        shadowMap.InvalidateStaticCache();
+    shadowFrames++;
+
+    //the casters of every cascade are recorded at once, the models that do not animate only for the cascades whose
+    //cached layer is out of date; listBounds holds where the still and the animated lists of every cascade start, then
+    //the end
+    int cascadeCount = shadowMap.getCascadeCount();
+    int modelCount = entities.getModelCount();
+    std::vector<bool> animatedModels(modelCount);
+    for (int m = 0; m < modelCount; m++)
+        animatedModels[m] = entities.isModelAnimated(m);
+    std::vector<std::vector<std::vector<bool> > > casters(cascadeCount, std::vector<std::vector<bool> >(modelCount));
+    std::vector<CommandListChunk> chunks;
+    std::vector<size_t> listBounds;
+    {
+        gps::ProfilerScope pass(profiler, "shadow commands");
+        gps::MeshUniformLocations locations = gps::Mesh::getUniformLocations(depthMapShader);
+        for (int i = 0; i < cascadeCount; i++) {
+            sceneBvh.QueryFrustum(gps::Frustum(shadowMap.getLightSpaceMatrix(i)), shadowCasters);
+            for (int animated = 0; animated < 2; animated++) {
+                listBounds.push_back(chunks.size());
+                if (!animated && shadowMap.isStaticCacheValid(i))
+                    continue;
+                for (int m = 0; m < modelCount; m++) {
+                    if (animatedModels[m] != (animated != 0))
+                        continue;
+                    casters[i][m] = getVisibleInstances(m, shadowCasters);
+                    addCommandListChunks(chunks, entities.getModel(m), depthMapShader, locations, casters[i][m]);
+                }
+            }
+        }
+        listBounds.push_back(chunks.size());
+        recordCommandLists(chunks);
+    }
+
+    depthMapShader.useShaderProgram();
+
+    //open meshes like the terrain cast from both sides, the offset keeps lit surfaces from shadowing themselves
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+    for (int i = 0; i < cascadeCount; i++) {
+        glUniformMatrix4fv(glGetUniformLocation(depthMapShader.shaderProgram, "lightSpaceTrMatrix"), 1, GL_FALSE,
+            glm::value_ptr(shadowMap.getLightSpaceMatrix(i)));
+
+        if (!shadowMap.isStaticCacheValid(i)) {
+            shadowMap.BeginStaticCascade(i);
+            replayCommandLists(listBounds[i * 2], listBounds[i * 2 + 1]);
+        }
+
+        shadowMap.BeginCascade(i);
+        replayCommandLists(listBounds[i * 2 + 1], listBounds[i * 2 + 2]);
+    }
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glEnable(GL_CULL_FACE);
+    shadowMap.End(width, height, sceneFramebuffer);
+}
+
+//the basic.frag features needed this frame, the code of the others is compiled out of the variant drawn
+unsigned int getShaderFeatures() {
+    unsigned int features = 0;
+    if (frame->is_light == 1.0f)
+        features |= gps::SHADER_POINT_LIGHTS;
+    if (frame->fogDensity > 0.0f)
+        features |= gps::SHADER_FOG;
+    if (frame->shadows)
+        features |= gps::SHADER_SHADOWS;
+    return features;
+}
+
+//every variant is a program of its own, the per frame uniforms are sent to the one about to draw
+void sendFrameUniforms(gps::Shader shader) {
+    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform3fv(glGetUniformLocation(shader.shaderProgram, "lightDir"), 1, glm::value_ptr(computeLightDirection()));
+    glUniform3fv(glGetUniformLocation(shader.shaderProgram, "lightColor"), 1, glm::value_ptr(lightColor));
+    if ((shader.getFeatures() & gps::SHADER_FOG) != 0)
+        glUniform1fv(glGetUniformLocation(shader.shaderProgram, "fogDensity"), 1, &frame->fogDensity);
+    if ((shader.getFeatures() & gps::SHADER_SHADOWS) != 0)
+        shadowMap.BindForSampling(shader, SHADOW_TEXTURE_UNIT);
+    if ((shader.getFeatures() & gps::SHADER_POINT_LIGHTS) != 0) {
+        int width, height;
+        getSceneFramebufferSize(width, height);
+        clusteredLights.BindForSampling(shader, CLUSTER_TEXTURE_UNIT, width, height);
+    }
+}
+
+//the variant with the given features, or the one without the optional features while it is still compiling
+gps::Shader getReadyVariant(gps::Shader shader, unsigned int features) {
+    gps::Shader variant = shader.getVariant(features);
+    if (!variant.isReady())
+        variant = shader.getVariant(features & getTexturedFeatures());
+    return variant;
+}
+
+//the features of the variant drawing a model on top of those of the frame
+unsigned int getModelFeatures(const gps::Model3D& model) {
+    if (!model.isTextured())
+        return 0;
+    return gps::SHADER_TEXTURED | (model.hasTextureArrays() ? gps::SHADER_TEXTURE_ARRAYS : 0);
+}
+
+//makes myBasicShader the given variant and sends it the frame uniforms
+void useBasicShaderVariant(gps::Shader variant) {
+    if (variant.shaderProgram != myBasicShader.shaderProgram) {
+        myBasicShader = variant;
+        getBasicShaderLocations();
+    }
+    myBasicShader.useShaderProgram();
+    sendFrameUniforms(myBasicShader);
+}
+
+//draws a model from the command lists [firstList, lastList), one draw per mesh for every instance
+void renderModel(int model, size_t firstList, size_t lastList) {
+    gps::ProfilerScope pass(profiler, entities.getModelName(model).c_str());
+    myBasicShader.useShaderProgram();
+    //model and normal matrices come from the instance buffer
+    replayCommandLists(firstList, lastList);
+}
+
+//draws the depth of the meshes basic.frag is about to shade, the main pass then only shades the nearest fragment
+void renderDepthPrepass() {
+    gps::ProfilerScope pass(profiler, "depth prepass");
+    depthPrepassShader.useShaderProgram();
+    glUniformMatrix4fv(glGetUniformLocation(depthPrepassShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(depthPrepassShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    for (int i = 0; i < entities.getModelCount(); i++)
+        entities.getModel(i).DrawInstanced(depthPrepassShader, getVisibleInstances(i, visibleObjects));
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(GL_FALSE);
+}
+
+void initIndirectRendering() {
+    gpuDrivenAvailable = myWindow.isGLVersionSupported(4, 3);
+    if (!gpuDrivenAvailable)
+        return;
+
+    indirectShader.loadShaderVariants("shaders/indirect.vert", "shaders/basic.frag");
+    for (unsigned int features = 0; features < (1u << gps::SHADER_FEATURE_COUNT); features++) {
+        if ((features & gps::SHADER_TEXTURED) != 0 && isVariantUsed(features))
+            indirectShader.getVariant(features);
+    }
+    indirectShader.getVariant(getTexturedFeatures()).waitUntilReady();
+    cullShader.loadComputeShader("shaders/cull.comp");
+    depthPyramidShader.loadComputeShader("shaders/depthPyramid.comp");
+
+    for (int i = 0; i < entities.getRenderableCount(); i++) {
+        const gps::Model3D& model3D = entities.getModel(entities.getRenderableModel(i));
+        entities.SetRenderableFirstDraw(i, indirectRenderer.AddModel(model3D, entities.getWorldTransform(entities.getRenderableEntity(i))));
+    }
+    indirectRenderer.Build();
+    indirectRenderer.SetUploadBuffer(&frameUploads);
+    std::cout << "GPU driven rendering: " << indirectRenderer.getDrawCount() << " draws in "
+        << indirectRenderer.getBatchCount() << " multi draw calls, press I to toggle" << std::endl;
+}
+
+//indirect.vert writes the same outputs as basic.vert, the lighting uniforms of basic.frag are sent again to this program
+void renderIndirect() {
+    indirectRenderer.Cull(cullShader, view, projection);
+
+    //the batches are textured, meshes without textures read black as on the basic path
+    indirectShader = getReadyVariant(indirectShader, getShaderFeatures() | getTexturedFeatures());
+    indirectShader.useShaderProgram();
+    sendFrameUniforms(indirectShader);
+
+    indirectRenderer.Draw(indirectShader);
+
+    //the depth of this frame culls the next one
+    int width, height;
+    getSceneFramebufferSize(width, height);
+    indirectRenderer.BuildDepthPyramid(depthPyramidShader, width, height, projection * view, sceneFramebuffer);
 }
 
 void do_start_animation(int direction) {
@@ -552,91 +1186,499 @@ void do_start_animation(int direction) {
         myCamera.move(gps::MOVE_BACKWARD, cameraSpeed);
     else
         myCamera.move(gps::MOVE_FORWARD, cameraSpeed);
-    //update view matrix
-    view = myCamera.getViewMatrix();
-    myBasicShader.useShaderProgram();
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    // compute normal matrix for teapot
-    normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 }
 
-void renderScene() {
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+SimulationState getSimulationState() {
+    SimulationState state;
+    state.cameraPosition = myCamera.getPosition();
+    state.angle = angle;
+    state.lightAngle = light_angle;
+    state.animatorAngles = entities.getAnimatorAngles();
+    return state;
+}
 
-    lance_angle += 0.4f;
+void updateSimulation() {
+    previousState = getSimulationState();
 
-    //render objects
-    renderSceneObject(myBasicShader);
-    renderLance1(myBasicShader);
-    renderLance2(myBasicShader);
+    processMovement();
+    entities.Animate();
 
-    //send the maxtrix for directional light
-    lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(light_angle), glm::vec3(1.0f, 0.0f, 0.0f));
-    glUniform3fv(lightDirLoc, 1, glm::value_ptr(glm::inverseTranspose(glm::mat3(view * lightRotation)) * lightDir));
+    //the intro camera, timed in simulated seconds
+    if (simulationTime <= 10.0) {
+        do_start_animation(1);
+    }
+    if (simulationTime > 11.5 && simulationTime <= 16.0) {
+        do_start_animation(0);
+    }
+    simulationTime += SIMULATION_STEP;
+}
+
+//copies what the frame is drawn from into the write slot and hands it to the render thread
+void publishSnapshot(double stepTime) {
+    FrameSnapshot& snapshot = frameSnapshots.getWriteSlot();
+    snapshot.previous = previousState;
+    snapshot.current = getSimulationState();
+    snapshot.stepTime = stepTime;
+    snapshot.cameraOrientation = myCamera.getViewMatrix(glm::vec3(0.0f));
+    if (sceneFramebuffer != 0) {
+        snapshot.framebufferWidth = benchmarkTarget.getWidth();
+        snapshot.framebufferHeight = benchmarkTarget.getHeight();
+    } else {
+        glfwGetFramebufferSize(myWindow.getWindow(), &snapshot.framebufferWidth, &snapshot.framebufferHeight);
+    }
+    snapshot.fov = fov;
+    snapshot.fogDensity = fogDensity;
+    snapshot.is_light = is_light;
+    snapshot.lanterns = lanterns;
+    snapshot.shadows = shadows;
+    snapshot.showDepthMap = showDepthMap;
+    snapshot.shadowCaching = shadowCaching;
+    snapshot.occlusionCulling = occlusionCulling;
+    snapshot.gpuDriven = gpuDriven;
+    snapshot.depthPrepass = depthPrepass;
+    snapshot.polygonMode = polygonMode;
+    snapshot.swapInterval = swapInterval;
+    for (int i = 0; i < RENDER_REPORT_COUNT; i++)
+        snapshot.reportRequests[i] = reportRequests[i];
+    frameSnapshots.Publish();
+}
+
+//makes the newest snapshot the one drawn, the last one is drawn again when none was published since
+void acquireSnapshot() {
+    frameSnapshots.Acquire();
+    frame = &frameSnapshots.getReadSlot();
+}
+
+//the matrices of the frame, alpha of the way from the previous simulation step to the last one; the camera only
+//blends its position, turning it with the mouse is not a step and shows with the next snapshot
+void interpolateSimulationState(float alpha) {
+    const SimulationState& previous = frame->previous;
+    const SimulationState& current = frame->current;
+    glm::vec3 cameraPosition = glm::mix(previous.cameraPosition, current.cameraPosition, alpha);
+    view = frame->cameraOrientation * glm::translate(glm::mat4(1.0f), -cameraPosition);
+    entities.SetLocalTransform(villageEntity,
+        glm::rotate(glm::mat4(1.0f), glm::radians(glm::mix(previous.angle, current.angle, alpha)), glm::vec3(0, 1, 0)));
+    lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(glm::mix(previous.lightAngle, current.lightAngle, alpha)),
+        glm::vec3(1.0f, 0.0f, 0.0f));
+    entities.ApplyAnimators(previous.animatorAngles, current.animatorAngles, alpha);
+    entities.UpdateTransforms();
+    entities.UpdateBounds(&workerPool);
+}
+
+//the settings of the snapshot that need GL calls or new data, applied when they change
+void applySnapshotSettings() {
+    if (frame->swapInterval != myWindow.getSwapInterval())
+        myWindow.setSwapInterval(frame->swapInterval);
+
+    if (frame->polygonMode != polygonModeShown) {
+        glPolygonMode(GL_FRONT_AND_BACK, frame->polygonMode);
+        polygonModeShown = frame->polygonMode;
+    }
+
+    if (frame->framebufferWidth != viewportWidth || frame->framebufferHeight != viewportHeight) {
+        viewportWidth = frame->framebufferWidth;
+        viewportHeight = frame->framebufferHeight;
+        glViewport(0, 0, viewportWidth, viewportHeight);
+    }
 
-    //send is_light for turning on or off the point light
-    glUniform1fv(is_lightLoc, 1, &is_light);
+    if (frame->lanterns != lanternsShown) {
+        lanternsShown = frame->lanterns;
+        for (size_t i = 0; i < lanternEntities.size(); i++)
+            entities.SetLightEnabled(lanternEntities[i], lanternsShown);
+        std::cout << entities.getEnabledLightCount() << " point lights" << std::endl;
+    }
+}
+
+//the lights reaching each cluster of the view
+void updateLightClusters() {
+    if (entities.UpdateLights(&workerPool))
+        clusteredLights.SetLights(entities.getWorldLights());
+    clusteredLights.Update(view, glm::radians(frame->fov),
+        (float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height, 0.1f, 100.0f);
+}
+
+//the visible meshes with basic.frag, the cpu path
+void renderSceneObjects() {
+    if (frame->depthPrepass)
+        renderDepthPrepass();
+    unsigned int features = getShaderFeatures();
+    int modelCount = entities.getModelCount();
+    std::vector<gps::Shader> variants;
+    std::vector<std::vector<bool> > visibleInstances(modelCount);
+    for (int i = 0; i < modelCount; i++)
+        variants.push_back(getReadyVariant(myBasicShader, features | getModelFeatures(entities.getModel(i))));
+
+    //every model is recorded at once, then drawn one after the other; firstLists holds where the lists of every model
+    //start, then the end
+    std::vector<CommandListChunk> chunks;
+    std::vector<size_t> firstLists;
+    {
+        gps::ProfilerScope pass(profiler, "scene commands");
+        for (int i = 0; i < modelCount; i++) {
+            visibleInstances[i] = getVisibleInstances(i, visibleObjects);
+            firstLists.push_back(chunks.size());
+            addCommandListChunks(chunks, entities.getModel(i), variants[i], gps::Mesh::getUniformLocations(variants[i]), visibleInstances[i]);
+        }
+        firstLists.push_back(chunks.size());
+        recordCommandLists(chunks);
+    }
+
+    for (int i = 0; i < modelCount; i++) {
+        useBasicShaderVariant(variants[i]);
+        renderModel(i, firstLists[i], firstLists[i + 1]);
+    }
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+}
+
+void renderSkyBox() {
+    skyboxShader.useShaderProgram();
+    mySkyBox.Draw(skyboxShader, view, projection);
+}
+
+//the cascades side by side along the bottom of the scene, the nearest on the left
+void renderDepthMapView() {
+    int width, height;
+    getSceneFramebufferSize(width, height);
+    int size = width / shadowMap.getCascadeCount();
+
+    depthMapViewShader.useShaderProgram();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, frameGraph.getTexture(shadowCascadeResource));
+    glUniform1i(glGetUniformLocation(depthMapViewShader.shaderProgram, "shadowMap"), 0);
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(depthMapViewVAO);
+    for (int i = 0; i < shadowMap.getCascadeCount(); i++) {
+        glViewport(i * size, 0, size, size);
+        glUniform1i(glGetUniformLocation(depthMapViewShader.shaderProgram, "cascade"), i);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glViewport(0, 0, width, height);
+}
+
+//declares the passes of the frame; what a pass reads follows the features drawn with, so the passes producing
+//something nothing reads this frame (the shadows with H, the light clusters with the lights off) are culled
+void buildFrameGraph() {
+    frameGraph.Reset();
+    int sceneColor = frameGraph.ImportResource("scene", sceneFramebuffer);
+    frameGraph.MarkOutput(sceneColor);
+    gps::TransientTextureDesc cascades = { GL_TEXTURE_2D_ARRAY, GL_DEPTH_COMPONENT24, shadowMap.getResolution(),
+        shadowMap.getResolution(), shadowMap.getCascadeCount() };
+    shadowCascadeResource = frameGraph.CreateTexture("shadow cascades", cascades);
+    int lightClusters = frameGraph.ImportResource("light clusters");
+    int visibleMeshes = frameGraph.ImportResource("visible meshes");
+    int depthPyramid = frameGraph.ImportResource("depth pyramid");
+    int materialTextures = frameGraph.ImportResource("material textures");
+
+    int pass = frameGraph.AddPass("shadow", renderShadows);
+    frameGraph.Write(pass, shadowCascadeResource);
+
+    pass = frameGraph.AddPass("light clusters", updateLightClusters);
+    frameGraph.Write(pass, lightClusters);
+
+    if (!frame->gpuDriven) {
+        pass = frameGraph.AddPass("visibility", updateVisibility);
+        frameGraph.Write(pass, visibleMeshes);
+    }
+    if (textureStreamer.isStarted()) {
+        pass = frameGraph.AddPass("texture streaming", updateTextureStreaming);
+        if (!frame->gpuDriven)
+            frameGraph.Read(pass, visibleMeshes);
+        frameGraph.Write(pass, materialTextures);
+    }
+
+    if (frame->gpuDriven) {
+        pass = frameGraph.AddPass("gpu driven", renderIndirect);
+        //culled against the pyramid of the last frame, then builds the one of this frame
+        frameGraph.Read(pass, depthPyramid);
+        frameGraph.Write(pass, depthPyramid);
+    } else {
+        pass = frameGraph.AddPass("scene", renderSceneObjects);
+        frameGraph.Read(pass, visibleMeshes);
+    }
+    if (textureStreamer.isStarted())
+        frameGraph.Read(pass, materialTextures);
+    unsigned int features = getShaderFeatures();
+    if ((features & gps::SHADER_SHADOWS) != 0)
+        frameGraph.Read(pass, shadowCascadeResource);
+    if ((features & gps::SHADER_POINT_LIGHTS) != 0)
+        frameGraph.Read(pass, lightClusters);
+    frameGraph.Write(pass, sceneColor);
+
+    pass = frameGraph.AddPass("skybox", renderSkyBox);
+    frameGraph.Write(pass, sceneColor);
+
+    if (frame->showDepthMap) {
+        pass = frameGraph.AddPass("depth map view", renderDepthMapView);
+        frameGraph.Read(pass, shadowCascadeResource);
+        frameGraph.Write(pass, sceneColor);
+    }
+}
+
+//draws the snapshot taken by acquireSnapshot
+void renderScene(float alpha) {
+    applySnapshotSettings();
+    frameUploads.BeginFrame();
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    interpolateSimulationState(alpha);
 
     //update de projection matrix for scrolling
-    projection = glm::perspective(glm::radians(fov),
+    projection = glm::perspective(glm::radians(frame->fov),
         (float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height,
         0.1f, 100.0f);
-    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
 
-    skyboxShader.useShaderProgram();
-    //renderSkyBox
-    mySkyBox.Draw(skyboxShader, view, projection);
+    //send the maxtrix for directional light
+    myBasicShader.useShaderProgram();
+    glUniform3fv(lightDirLoc, 1, glm::value_ptr(computeLightDirection()));
 
-    //for start position of camera
-    if (first_render) {
-        mouseCallback(myWindow.getWindow(), 400, 100);
-        startTime = static_cast<float>(glfwGetTime());
-        first_render = false;
+    updateSceneTransforms();
+    buildFrameGraph();
+    frameGraph.Compile();
+    frameGraph.Execute(profiler);
+}
+
+void printTextureStreaming() {
+    if (!textureStreamer.isStarted()) {
+        std::cout << "Texture streaming is off, see --texture-budget" << std::endl;
+        return;
     }
+    std::cout << "Textures: " << textureStreamer.getResidentBytes() / 1024 << " KB resident of "
+        << textureStreamer.getFullBytes() / 1024 << " KB fully loaded, budget " << textureStreamer.getBudget() / 1024
+        << " KB, " << textureStreamer.getStreamedLevelCount() << " levels streamed in, "
+        << textureStreamer.getDroppedLevelCount() << " dropped" << std::endl;
+}
 
-    currentTime = static_cast<float>(glfwGetTime());
-    if (currentTime - startTime <= 10.0f) {
-        do_start_animation(1);
+//what the keys asked for since the last snapshot drawn, printed after its frame
+void printRenderReports() {
+    for (int report = 0; report < RENDER_REPORT_COUNT; report++) {
+        if (frame->reportRequests[report] == reportsPrinted[report])
+            continue;
+        reportsPrinted[report] = frame->reportRequests[report];
+        switch (report) {
+            case REPORT_PROFILE:
+                profiler.PrintAverages(std::cout);
+                if (profiler.WriteTrace(PROFILE_TRACE_FILE))
+                    std::cout << "Trace written to " << PROFILE_TRACE_FILE << std::endl;
+                break;
+            case REPORT_RENDER_GRAPH:
+                frameGraph.Print(std::cout);
+                break;
+            case REPORT_GL_STATS:
+                std::cout << "Last frame: ";
+                gps::RenderStats::Print(std::cout, gps::RenderStats::getLastFrame());
+                break;
+            case REPORT_DEPTH_PREPASS:
+                std::cout << "Depth pre-pass " << (frame->depthPrepass ? "on" : "off") << ", the scene passes took "
+                    << profiler.getAverageGpuTime("scene") << " ms of gpu time per frame "
+                    << (frame->depthPrepass ? "without" : "with") << " it" << std::endl;
+                break;
+            case REPORT_SHADOW_CACHE:
+                std::cout << "Shadow caching " << (frame->shadowCaching ? "on" : "off") << ", "
+                    << shadowMap.getStaticRebuildCount() << " cascade rebuilds in " << shadowFrames << " frames" << std::endl;
+                break;
+            case REPORT_TEXTURE_STREAMING:
+                printTextureStreaming();
+                break;
+        }
     }
-    if (currentTime - startTime > 11.5f && currentTime - startTime <= 16.0f) {
-        do_start_animation(0);
+}
+
+//the render thread, it owns the GL context until rendering is cleared; every frame draws the newest snapshot at the
+//time it starts, so the simulation steps keep their pace however long a frame takes
+void renderLoop() {
+    glfwMakeContextCurrent(myWindow.getWindow());
+    while (rendering.load()) {
+        acquireSnapshot();
+        //the time since the last step is blended in, past one step the last step is shown until the next snapshot
+        double alpha = (glfwGetTime() - frame->stepTime) / SIMULATION_STEP;
+        profiler.BeginFrame();
+        renderScene((float)std::min(std::max(alpha, 0.0), 1.0));
+        profiler.BeginPass("swap");
+		glfwSwapBuffers(myWindow.getWindow());
+        profiler.EndPass();
+        profiler.EndFrame();
+        gps::RenderStats::EndFrame();
+        printRenderReports();
+
+        //glGetError waits for the driver to catch up, release builds and the debug callback go without it
+#ifndef NDEBUG
+        if (!myWindow.isDebugOutputEnabled())
+            glCheckError();
+#endif
+    }
+    glfwMakeContextCurrent(NULL);
+}
+
+//nearest rank percentile of sorted values
+double getPercentile(const std::vector<double>& sorted, double percent) {
+    int rank = (int)std::ceil(percent / 100.0 * sorted.size());
+    return sorted[std::min(std::max(rank - 1, 0), (int)sorted.size() - 1)];
+}
+
+//plays the intro for benchmarkFrames frames; every frame is finished before the next starts, so a frame time is the
+//time the frame took to draw and not the time it took to queue
+void runBenchmark() {
+    std::vector<double> frameTimes;
+    long long drawCalls = 0;
+    GLuint64 triangles = 0;
+    GLuint primitivesQuery;
+    glGenQueries(1, &primitivesQuery);
+
+    glFinish();
+    double previousTime = glfwGetTime();
+    for (int frameIndex = 0; frameIndex < BENCHMARK_WARMUP_FRAMES + benchmarkFrames; frameIndex++) {
+        profiler.BeginFrame();
+        //every triangle sent to the gpu, by every pass
+        glBeginQuery(GL_PRIMITIVES_GENERATED, primitivesQuery);
+        profiler.BeginPass("simulation");
+        updateSimulation();
+        publishSnapshot(glfwGetTime());
+        acquireSnapshot();
+        profiler.EndPass();
+        renderScene(1.0f);
+        glEndQuery(GL_PRIMITIVES_GENERATED);
+        profiler.EndFrame();
+        gps::RenderStats::EndFrame();
+        glFinish();
+
+        double now = glfwGetTime();
+        if (frameIndex >= BENCHMARK_WARMUP_FRAMES) {
+            GLuint64 generated = 0;
+            glGetQueryObjectui64v(primitivesQuery, GL_QUERY_RESULT, &generated);
+            frameTimes.push_back((now - previousTime) * 1000.0);
+            drawCalls += gps::RenderStats::getLastFrame().drawCalls;
+            triangles += generated;
+        }
+        previousTime = now;
+    }
+    glDeleteQueries(1, &primitivesQuery);
+
+    std::vector<double> sorted = frameTimes;
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0.0;
+    for (size_t i = 0; i < sorted.size(); i++)
+        total += sorted[i];
+    double mean = sorted.empty() ? 0.0 : total / sorted.size();
+    std::cout << "Benchmark: " << frameTimes.size() << " frames at " << benchmarkWidth << "x" << benchmarkHeight << std::endl;
+    if (!sorted.empty()) {
+        std::cout << "frame time ms: mean " << mean << ", p50 " << getPercentile(sorted, 50.0) << ", p90 " << getPercentile(sorted, 90.0)
+            << ", p95 " << getPercentile(sorted, 95.0) << ", p99 " << getPercentile(sorted, 99.0) << ", max " << sorted.back()
+            << " (" << 1000.0 / mean << " fps)" << std::endl;
+        std::cout << "per frame: " << (double)drawCalls / sorted.size() << " draw calls, "
+            << (double)triangles / sorted.size() << " triangles" << std::endl;
+        std::cout << "last frame: ";
+        gps::RenderStats::Print(std::cout, gps::RenderStats::getLastFrame());
     }
+    if (textureStreamer.isStarted())
+        printTextureStreaming();
+    profiler.PrintAverages(std::cout);
+}
 
+//returns false on an unknown argument
+bool parseArguments(int argc, const char * argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--benchmark") == 0) {
+            benchmarkMode = true;
+        } else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            benchmarkFrames = std::max(std::atoi(argv[++i]), 1);
+        } else if (std::strcmp(argv[i], "--resolution") == 0 && i + 1 < argc) {
+            int width, height;
+            if (std::sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+                return false;
+            benchmarkWidth = width;
+            benchmarkHeight = height;
+        } else if (std::strcmp(argv[i], "--gl-debug") == 0) {
+            glDebugContext = true;
+        } else if (std::strcmp(argv[i], "--texture-arrays") == 0) {
+            textureArrays = true;
+        } else if (std::strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc) {
+            int megabytes = std::atoi(argv[++i]);
+            if (megabytes <= 0)
+                return false;
+            textureBudget = (size_t)megabytes * 1024 * 1024;
+        } else {
+            return false;
+        }
+    }
+    return true;
 }
 
 void cleanup() {
+    textureStreamer.Delete();
     myWindow.Delete();
     //cleanup code for your own data
 }
 
 int main(int argc, const char * argv[]) {
 
+    if (!parseArguments(argc, argv)) {
+        std::cerr << "usage: " << argv[0] << " [--benchmark [--frames N] [--resolution WxH]] [--gl-debug] [--texture-arrays] [--texture-budget MB]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
     try {
         initOpenGLWindow();
     } catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
         return EXIT_FAILURE;
     }
+    if (benchmarkMode && !initBenchmarkTarget()) {
+        cleanup();
+        return EXIT_FAILURE;
+    }
 
     initOpenGLState();
 	initModels();
+    initEntities();
 	initShaders();
     initFBO();
     initSkyBox();
 	initUniforms();
+    initBvh();
+    initOcclusionCulling();
+    initFrameUploads();
+    initIndirectRendering();
     setWindowCallbacks();
+    profiler.Create();
 
 	glCheckError();
-	// application loop
-	while (!glfwWindowShouldClose(myWindow.getWindow())) {
-        processMovement();
-	    renderScene();
-
-		glfwPollEvents();
-		glfwSwapBuffers(myWindow.getWindow());
+    //for start position of camera
+    mouseCallback(myWindow.getWindow(), 400, 100);
+    previousState = getSimulationState();
+    if (benchmarkMode) {
+        runBenchmark();
+        cleanup();
+        return EXIT_SUCCESS;
+    }
 
-		glCheckError();
+	// application loop: this thread handles the input and runs the simulation, the render thread draws its snapshots
+    double previousTime = glfwGetTime();
+    double accumulator = 0.0;
+    publishSnapshot(previousTime);
+    glfwMakeContextCurrent(NULL);
+    rendering = true;
+    renderThread = std::thread(renderLoop);
+	while (!glfwWindowShouldClose(myWindow.getWindow())) {
+        //sleeps until an event or the next simulation step is due
+        glfwWaitEventsTimeout(SIMULATION_STEP - accumulator);
+
+        //the time since the last wake up is spent in whole simulation steps, the rest carries over
+        double now = glfwGetTime();
+        accumulator += std::min(now - previousTime, MAX_FRAME_TIME);
+        previousTime = now;
+        while (accumulator >= SIMULATION_STEP) {
+            updateSimulation();
+            accumulator -= SIMULATION_STEP;
+        }
+        publishSnapshot(now - accumulator);
 	}
+    rendering = false;
+    renderThread.join();
+    glfwMakeContextCurrent(myWindow.getWindow());
 
 	cleanup();
 
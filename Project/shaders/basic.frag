@@ -3,30 +3,59 @@
 in vec3 fPosition;
 in vec3 fNormal;
 in vec2 fTexCoords;
-//in vec4 fPosEye;
-//in vec4 fragPosLightSpace;
+in vec4 fPosEye;
+in vec3 fNormalEye;
+in vec3 fPosWorld;
+#ifdef TEXTURE_ARRAYS
+//layers of the ambient, diffuse and specular textures
+flat in ivec3 fTextureLayers;
+#endif
 
 out vec4 fColor;
 
 //matrices
-uniform mat4 model;
 uniform mat4 view;
-uniform mat3 normalMatrix;
 //lighting
 uniform vec3 lightDir;
 uniform vec3 lightColor;
+//compiled in as variants by gps::Shader: POINT_LIGHTS, FOG, SHADOWS, TEXTURED, TEXTURE_ARRAYS
+#ifdef TEXTURED
 // textures
+#ifdef TEXTURE_ARRAYS
+uniform sampler2DArray diffuseTexture;
+uniform sampler2DArray specularTexture;
+#else
 uniform sampler2D diffuseTexture;
 uniform sampler2D specularTexture;
-
-uniform vec3 pointLightPosition1;
-uniform vec3 pointLightColor1;
-uniform vec3 pointLightPosition2;
-uniform vec3 pointLightColor2;
-//uniform sampler2D shadowMap;
-//fog
+#endif
+#else
+uniform vec3 materialDiffuse;
+uniform vec3 materialSpecular;
+#endif
+
+#ifdef POINT_LIGHTS
+//clustered point lights (ClusteredLights): per light (eye position, radius) and (color, 0) texels, per cluster
+//(first index, count) into lightIndices
+uniform samplerBuffer pointLights;
+uniform usamplerBuffer lightClusters;
+uniform usamplerBuffer lightIndices;
+//the three are views of one ring buffer, the texel each of them starts at this frame
+uniform ivec3 clusterOffsets;
+uniform ivec3 clusterGrid;
+uniform vec2 clusterTileScale;
+uniform vec2 clusterDepthScaleBias;
+#endif
+#ifdef SHADOWS
+//shadow cascades (CascadedShadowMap)
+uniform sampler2DArrayShadow shadowMap;
+uniform int cascadeCount;
+uniform mat4 lightSpaceTrMatrices[4];
+uniform float cascadeSplits[4];
+uniform float cascadeTexelSizes[4];
+#endif
+#ifdef FOG
 uniform float fogDensity;
-uniform float is_light;
+#endif
 
 //components
 vec3 ambient;
@@ -40,13 +69,9 @@ float constant = 1.0f;
 float linear = 0.09f;
 float quadratic = 0.04f;
 
-vec4 fPosEye;
-
 void computeDirLight()
 {
-    //compute eye space coordinates
-    fPosEye = view * model * vec4(fPosition, 1.0f);
-    vec3 normalEye = normalize(normalMatrix * fNormal);
+    vec3 normalEye = normalize(fNormalEye);
     //normalize light direction
     vec3 lightDirN = vec3(normalize(view * vec4(lightDir, 0.0f)));
     //compute view direction (in eye coordinates, the viewer is situated at the origin
@@ -62,59 +87,47 @@ void computeDirLight()
 
 }
 
-vec3 computePointLight1()
+#ifdef POINT_LIGHTS
+vec3 computePointLight(int light, vec3 normalEye, vec3 viewDir, vec3 diffuseColor, vec3 specularColor)
 {
-	vec3 lightDir = normalize(pointLightPosition1 - fPosition);
+    vec4 positionRadius = texelFetch(pointLights, clusterOffsets.x + light * 2);
+    vec3 color = texelFetch(pointLights, clusterOffsets.x + light * 2 + 1).rgb;
 
-    //////////////
-    fPosEye = view * model * vec4(fPosition, 1.0f);
-    vec3 normalEye = normalize(normalMatrix * fNormal);
-    vec3 viewDir = normalize(- fPosEye.xyz);
-    /////////////
+    vec3 toLight = positionRadius.xyz - fPosEye.xyz;
+    float distance = length(toLight);
+    vec3 lightDir = toLight / distance;
 
     float diff = max(dot(normalEye, lightDir), 0.0);
-    
+
     vec3 reflectDir = reflect(-lightDir, normalEye);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
-   
-    float distance    = length(pointLightPosition1 - fPosition);
-    float attenuation = 1.0 / (constant + linear * distance + quadratic * (distance * distance));    
- 
-    vec3 ambient2  = vec3(texture(diffuseTexture, fTexCoords));
-    vec3 diffuse2  = diff * vec3(texture(diffuseTexture, fTexCoords));
-    vec3 specular2 = spec * vec3(texture(specularTexture, fTexCoords));
-    ambient2  *= attenuation;
-    diffuse2  *= attenuation;
-    specular2 *= attenuation;
-    return (ambient2 + diffuse2 + specular2);
+
+    //the attenuation is faded out to 0 at the radius, past it the light is not in the cluster lists
+    float attenuation = 1.0 / (constant + linear * distance + quadratic * (distance * distance));
+    float window = clamp(1.0 - pow(distance / positionRadius.w, 4.0), 0.0, 1.0);
+    attenuation *= window * window;
+
+    return color * (diffuseColor + diff * diffuseColor + spec * specularColor) * attenuation;
 }
-vec3 computePointLight2()
+
+vec3 computePointLights(vec3 diffuseColor, vec3 specularColor)
 {
-	vec3 lightDir = normalize(pointLightPosition2 - fPosition);
+    // the cluster of the fragment: its screen tile and the exponential depth slice of its distance
+    ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterTileScale), clusterGrid.xy - 1);
+    int slice = clamp(int(log(-fPosEye.z) * clusterDepthScaleBias.x + clusterDepthScaleBias.y), 0, clusterGrid.z - 1);
+    uvec2 cluster = texelFetch(lightClusters, clusterOffsets.y + (slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x).xy;
 
-    //////////////
-    fPosEye = view * model * vec4(fPosition, 1.0f);
-    vec3 normalEye = normalize(normalMatrix * fNormal);
+    vec3 normalEye = normalize(fNormalEye);
     vec3 viewDir = normalize(- fPosEye.xyz);
-    /////////////
 
-    float diff = max(dot(normalEye, lightDir), 0.0);
-    
-    vec3 reflectDir = reflect(-lightDir, normalEye);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
-   
-    float distance    = length(pointLightPosition2 - fPosition);
-    float attenuation = 1.0 / (constant + linear * distance + quadratic * (distance * distance));    
- 
-    vec3 ambient2  = vec3(texture(diffuseTexture, fTexCoords));
-    vec3 diffuse2  = diff * vec3(texture(diffuseTexture, fTexCoords));
-    vec3 specular2 = spec * vec3(texture(specularTexture, fTexCoords));
-    ambient2  *= attenuation;
-    diffuse2  *= attenuation;
-    specular2 *= attenuation;
-    return (ambient2 + diffuse2 + specular2);
+    vec3 color = vec3(0.0f);
+    for (uint i = 0u; i < cluster.y; i++)
+        color += computePointLight(int(texelFetch(lightIndices, clusterOffsets.z + int(cluster.x + i)).r), normalEye, viewDir, diffuseColor, specularColor);
+    return color;
 }
+#endif
 
+#ifdef FOG
 float computeFog()
 {
     //float fogDensity = 0.01f;
@@ -123,54 +136,82 @@ float computeFog()
 
     return clamp(fogFactor, 0.0f, 1.0f);
 }
+#endif
 
-/*float computeShadow()
-{	
-	// perform perspective divide
-    vec3 normalizedCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
-    
-    if(normalizedCoords.z > 1.0f)
+#ifdef SHADOWS
+float computeShadow()
+{
+    // the first cascade reaching past the fragment, nothing is shadowed after the last one
+    float fragmentDistance = -fPosEye.z;
+    int cascade = cascadeCount;
+    for (int i = cascadeCount - 1; i >= 0; i--) {
+        if (fragmentDistance <= cascadeSplits[i])
+            cascade = i;
+    }
+    if (cascade == cascadeCount)
         return 0.0f;
-        
-    // Transform to [0,1] range
-    normalizedCoords = normalizedCoords * 0.5f + 0.5f;
-    
-    // Get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
-    float closestDepth = texture(shadowMap, normalizedCoords.xy).r; 
-    
-    // Get depth of current fragment from light's perspective
-    float currentDepth = normalizedCoords.z;
-    
-    // Check whether current frag pos is in shadow
-    float bias = max(0.05f * (1.0f - dot(normal, lightDir)), 0.005f);
-    float shadow = currentDepth - bias> closestDepth  ? 1.0f : 0.0f;
 
+    // offset along the normal by a texel and a half, so a surface does not shadow itself
+    vec3 normalWorld = normalize(transpose(mat3(view)) * fNormalEye);
+    vec4 fragPosLightSpace = lightSpaceTrMatrices[cascade] * vec4(fPosWorld + normalWorld * 1.5f * cascadeTexelSizes[cascade], 1.0f);
+
+    // perform perspective divide and transform to [0,1] range
+    vec3 normalizedCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
+    normalizedCoords = normalizedCoords * 0.5f + 0.5f;
     if (normalizedCoords.z > 1.0f)
         return 0.0f;
 
-    return shadow;	
-}*/
+    // 3x3 percentage closer filtering, every lookup already compares and blends 2x2 texels
+    vec2 texelSize = 1.0f / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0f;
+    for (int x = -1; x <= 1; x++) {
+        for (int y = -1; y <= 1; y++)
+            lit += texture(shadowMap, vec4(normalizedCoords.xy + vec2(x, y) * texelSize, float(cascade), normalizedCoords.z));
+    }
+
+    return 1.0f - lit / 9.0f;
+}
+#endif
 
 void main() 
 {
     computeDirLight();
 
-    //float shadow = computeShadow();
-
-    ambient *= texture(diffuseTexture, fTexCoords).rgb;
-	diffuse *= texture(diffuseTexture, fTexCoords).rgb;
-	specular *= texture(specularTexture, fTexCoords).rgb;
+#ifdef TEXTURED
+#ifdef TEXTURE_ARRAYS
+    vec3 diffuseColor = texture(diffuseTexture, vec3(fTexCoords, float(fTextureLayers.y))).rgb;
+    vec3 specularColor = texture(specularTexture, vec3(fTexCoords, float(fTextureLayers.z))).rgb;
+#else
+    vec3 diffuseColor = texture(diffuseTexture, fTexCoords).rgb;
+    vec3 specularColor = texture(specularTexture, fTexCoords).rgb;
+#endif
+#else
+    vec3 diffuseColor = materialDiffuse;
+    vec3 specularColor = materialSpecular;
+#endif
+
+#ifdef SHADOWS
+    float shadow = computeShadow();
+#else
+    float shadow = 0.0f;
+#endif
+
+    ambient *= diffuseColor;
+	diffuse *= diffuseColor;
+	specular *= specularColor;
 	
-    vec3 color = min((ambient + diffuse) + specular, 1.0f);
+    vec3 color = min((ambient + (1.0f - shadow) * diffuse) + (1.0f - shadow) * specular, 1.0f);
 
-    if(is_light == 1.0f){
-        color += computePointLight1();
-        color += computePointLight2();
-    }
+#ifdef POINT_LIGHTS
+    color += computePointLights(diffuseColor, specularColor);
+#endif
 
+#ifdef FOG
     float fogFactor = computeFog();
     vec4 fogColor = vec4(0.5f, 0.5f, 0.5f, 1.0f);
 
     fColor = mix(fogColor, vec4(color, 1.0f), fogFactor);
-   
+#else
+    fColor = vec4(color, 1.0f);
+#endif
 }
@@ -3,27 +3,42 @@
 layout(location=0) in vec3 vPosition;
 layout(location=1) in vec3 vNormal;
 layout(location=2) in vec2 vTexCoords;
+//per instance model and normal matrices (Model3D::DrawInstanced)
+layout(location=3) in mat4 vInstanceModel;
+layout(location=7) in mat3 vInstanceNormalMatrix;
 
 out vec3 fPosition;
 out vec3 fNormal;
 out vec2 fTexCoords;
-//out vec4 fPosEye;
-//out vec4 fragPosLightSpace;//////////////////////////
+out vec4 fPosEye;
+out vec3 fNormalEye;
+//world space position, looked up in the shadow cascades by basic.frag
+out vec3 fPosWorld;
+#ifdef TEXTURE_ARRAYS
+//layers of the ambient, diffuse and specular textures, set per mesh
+flat out ivec3 fTextureLayers;
+uniform ivec3 textureLayers;
+#endif
+
+//depthPrepass.vert computes the same position, the depth pre-pass relies on both being equal
+invariant gl_Position;
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
-//uniform mat4 lightSpaceTrMatrix;
-//uniform	mat3 normalMatrix;
 
 void main() 
 {
-	gl_Position = projection * view * model * vec4(vPosition, 1.0f);
+	mat4 modelMatrix = vInstanceModel;
+	gl_Position = projection * view * modelMatrix * vec4(vPosition, 1.0f);
 	fNormal = vNormal;
 	fTexCoords = vTexCoords;
 	fPosition = vPosition;
 	
-	//fPosEye = view * model * vec4(vPosition, 1.0f);
-	//fNormal = normalize(normalMatrix * vNormal);
-	//fragPosLightSpace = lightSpaceTrMatrix * model * vec4(vPosition, 1.0f);////////////////
+	//eye space position and normal, also written by indirect.vert so both paths share basic.frag
+	fPosEye = view * modelMatrix * vec4(vPosition, 1.0f);
+	fNormalEye = mat3(view) * vInstanceNormalMatrix * vNormal;
+	fPosWorld = vec3(modelMatrix * vec4(vPosition, 1.0f));
+#ifdef TEXTURE_ARRAYS
+	fTextureLayers = textureLayers;
+#endif
 }
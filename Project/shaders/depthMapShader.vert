@@ -1,11 +1,13 @@
 #version 410 core
 
 layout(location=0) in vec3 vPosition;
+//per instance model matrix (Model3D::DrawInstanced)
+layout(location=3) in mat4 vInstanceModel;
 
 uniform mat4 lightSpaceTrMatrix;
-uniform mat4 model;
 
 void main()
 {
-	gl_Position = lightSpaceTrMatrix * model * vec4(vPosition, 1.0f);
+	mat4 modelMatrix = vInstanceModel;
+	gl_Position = lightSpaceTrMatrix * modelMatrix * vec4(vPosition, 1.0f);
 }
@@ -0,0 +1,15 @@
+#version 410 core
+
+in vec2 fTexCoords;
+
+out vec4 fColor;
+
+//the shadow cascades, read without depth comparison
+uniform sampler2DArray shadowMap;
+uniform int cascade;
+
+void main()
+{
+	float depth = texture(shadowMap, vec3(fTexCoords, float(cascade))).r;
+	fColor = vec4(vec3(depth), 1.0f);
+}
@@ -0,0 +1,17 @@
+#version 410 core
+
+layout(location=0) in vec3 vPosition;
+//per instance model matrix (Model3D::DrawInstanced)
+layout(location=3) in mat4 vInstanceModel;
+
+//computed exactly as in basic.vert, the main pass tests its depth with GL_EQUAL
+invariant gl_Position;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+	mat4 modelMatrix = vInstanceModel;
+	gl_Position = projection * view * modelMatrix * vec4(vPosition, 1.0f);
+}
@@ -0,0 +1,56 @@
+#version 430 core
+#extension GL_ARB_shader_draw_parameters : enable
+
+layout(location=0) in vec3 vPosition;
+layout(location=1) in vec3 vNormal;
+layout(location=2) in vec2 vTexCoords;
+//index of the draw, fed per instance through baseInstance when gl_DrawIDARB is missing
+layout(location=3) in uint vDrawIndex;
+
+out vec3 fPosition;
+out vec3 fNormal;
+out vec2 fTexCoords;
+out vec4 fPosEye;
+out vec3 fNormalEye;
+out vec3 fPosWorld;
+#ifdef TEXTURE_ARRAYS
+flat out ivec3 fTextureLayers;
+#endif
+
+struct DrawInfo {
+	mat4 model;
+	mat4 normalModel;
+	vec4 boundsMin;
+	vec4 boundsMax;
+	//layers of the ambient, diffuse and specular textures
+	ivec4 textureLayers;
+};
+
+layout(std430, binding = 0) readonly buffer DrawInfos {
+	DrawInfo drawInfos[];
+};
+
+uniform mat4 view;
+uniform mat4 projection;
+//gl_DrawID restarts at 0 for every multi draw call, one call is made per texture batch
+uniform uint firstDraw;
+
+void main()
+{
+#ifdef GL_ARB_shader_draw_parameters
+	DrawInfo draw = drawInfos[firstDraw + uint(gl_DrawIDARB)];
+#else
+	DrawInfo draw = drawInfos[vDrawIndex];
+#endif
+
+	fPosWorld = vec3(draw.model * vec4(vPosition, 1.0f));
+	fPosEye = view * vec4(fPosWorld, 1.0f);
+	gl_Position = projection * fPosEye;
+	fNormal = vNormal;
+	fTexCoords = vTexCoords;
+	fPosition = vPosition;
+	fNormalEye = mat3(view) * mat3(draw.normalModel) * vNormal;
+#ifdef TEXTURE_ARRAYS
+	fTextureLayers = draw.textureLayers.xyz;
+#endif
+}